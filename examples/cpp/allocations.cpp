@@ -0,0 +1,147 @@
+//
+// Counts the heap allocations of evolution on the interpreter, once the first generation warmed the buffers up
+// breeding and scoring an individual must not allocate
+//
+// usage: gasm_allocations
+// every allocation between two individuals of a generation counts, the ones in between generations
+// (statistics, history, checkpoints) don't, exits with 1 when an individual allocated
+//
+
+#include <atomic>
+#include <cstdlib>
+#include <iostream>
+#include <new>
+#include <streambuf>
+#include <vector>
+#include "GAsm.h"
+
+static std::atomic<uint64_t> allocations{0};
+
+void* operator new(std::size_t size) {
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    if (void* p = std::malloc(size == 0 ? 1 : size)) {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+
+void* operator new[](std::size_t size) {
+    return operator new(size);
+}
+
+void* operator new(std::size_t size, std::align_val_t alignment) {
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    const auto align = (std::size_t)alignment;
+    if (void* p = std::aligned_alloc(align, (size + align - 1) / align * align)) {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+
+void* operator new[](std::size_t size, std::align_val_t alignment) {
+    return operator new(size, alignment);
+}
+
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete[](void* p) noexcept { std::free(p); }
+void operator delete(void* p, std::size_t) noexcept { std::free(p); }
+void operator delete[](void* p, std::size_t) noexcept { std::free(p); }
+void operator delete(void* p, std::align_val_t) noexcept { std::free(p); }
+void operator delete[](void* p, std::align_val_t) noexcept { std::free(p); }
+void operator delete(void* p, std::size_t, std::align_val_t) noexcept { std::free(p); }
+void operator delete[](void* p, std::size_t, std::align_val_t) noexcept { std::free(p); }
+
+// the allocation count when every evaluation starts and ends, reserved up front so marking doesn't allocate
+static std::vector<uint64_t> starts;
+static std::vector<uint64_t> ends;
+
+static void mark(std::vector<uint64_t>& marks) {
+    if (marks.size() < marks.capacity()) {
+        marks.push_back(allocations.load(std::memory_order_relaxed));
+    }
+}
+
+class MarkingFitness : public FitnessSumSub {
+public:
+    std::pair<double, double> operator()(const GAsm* self, GAsmInterpreter& jit, const std::vector<uint8_t>& individual) override {
+        mark(starts);
+        std::pair<double, double> fitRank = FitnessSumSub::operator()(self, jit, individual);
+        mark(ends);
+        return fitRank;
+    }
+    std::pair<double, double> bounded(const GAsm* self, GAsmInterpreter& jit, const std::vector<uint8_t>& individual,
+                                      double cutoff) override {
+        mark(starts);
+        std::pair<double, double> fitRank = FitnessSumSub::bounded(self, jit, individual, cutoff);
+        mark(ends);
+        return fitRank;
+    }
+    [[nodiscard]] std::unique_ptr<FitnessFunction> clone() const override { return std::make_unique<MarkingFitness>(*this); }
+};
+
+// the progress bars go nowhere, and without allocating
+class NullBuffer : public std::streambuf {
+protected:
+    int overflow(int c) override { return c; }
+    std::streamsize xsputn(const char*, std::streamsize n) override { return n; }
+};
+
+// individuals of the generations after the first one that allocated
+static size_t allocatingIndividuals(const char* name, bool generational, bool racing) {
+    const size_t populationSize = 200;
+    const int generations = 6;
+    std::vector<std::vector<double>> inputs, targets;
+    for (int i = 0; i < 64; i++) {
+        inputs.push_back({(double)(i % 8), (double)(i / 8), 0, 0});
+        targets.push_back({(double)(i % 8 + 2 * (i / 8))});
+    }
+
+    GAsm gasm;
+    gasm.setCompile(false);
+    gasm.seed = 1;
+    gasm.minimize = true;
+    gasm.goalFitness = -1;  // never reached, every generation runs
+    gasm.populationSize = populationSize;
+    gasm.maxGenerations = generations;
+    gasm.individualMaxSize = 32;
+    gasm.generational = generational;
+    gasm.elitism = generational ? 2 : 0;
+    gasm.racing = racing;
+    gasm.setFitnessFunction(std::make_unique<MarkingFitness>());
+
+    // the elites are copied without scoring them again
+    const size_t perGeneration = populationSize - gasm.elitism;
+    const size_t evaluations = populationSize + perGeneration * generations;
+    starts.clear();
+    ends.clear();
+    starts.reserve(evaluations);
+    ends.reserve(evaluations);
+    NullBuffer null;
+    std::streambuf* out = std::cout.rdbuf(&null);
+    gasm.evolve(inputs, targets);
+    std::cout.rdbuf(out);
+
+    // the population is scored first, then every generation scores as many offspring,
+    // the first generation grows the buffers
+    size_t allocating = 0;
+    for (size_t k = populationSize + perGeneration; k < starts.size() && k < ends.size(); k++) {
+        const bool firstOfGeneration = (k - populationSize) % perGeneration == 0;
+        if (ends[k] != starts[k] || (!firstOfGeneration && starts[k] != ends[k - 1])) {
+            allocating++;
+        }
+    }
+    std::cout << name << ": " << starts.size() << " evaluations, " << allocating
+              << " individuals allocated after the first generation" << std::endl;
+    if (starts.size() != evaluations) {
+        std::cout << name << ": expected " << evaluations << " evaluations" << std::endl;
+        allocating++;
+    }
+    return allocating;
+}
+
+int main() {
+    size_t allocating = allocatingIndividuals("steady-state", false, false);
+    allocating += allocatingIndividuals("steady-state racing", false, true);
+    allocating += allocatingIndividuals("generational", true, false);
+    return allocating == 0 ? 0 : 1;
+}
@@ -0,0 +1,336 @@
+//
+// Deterministic checks of the evolution machinery on the interpreter, every one of them prints what went wrong
+//
+// usage: gasm_checks
+// exits with 1 when any check failed
+//
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <span>
+#include <streambuf>
+#include <string>
+#include <vector>
+#include "GAsm.h"
+
+static size_t failures = 0;
+
+static void check(bool ok, const std::string& what) {
+    if (!ok) {
+        failures++;
+        std::cout << "FAILED: " << what << std::endl;
+    }
+}
+
+static bool sameBits(double a, double b) {
+    return std::memcmp(&a, &b, sizeof(double)) == 0;
+}
+
+// y = x0 + 2 x1 over a grid, the errors of grown programs spread over many values
+static void gridCases(size_t caseCount, std::vector<std::vector<double>>& inputs, std::vector<std::vector<double>>& targets) {
+    inputs.clear();
+    targets.clear();
+    for (size_t i = 0; i < caseCount; i++) {
+        inputs.push_back({(double)(i % 10), (double)(i / 10), 0, 0});
+        targets.push_back({(double)(i % 10 + 2 * (i / 10))});
+    }
+}
+
+// a race stops once the cases run so far are worse than the cutoff, the verdict has to be the one of the
+// full run and a race that isn't lost has to score exactly like it, across the reorders of the cases
+static void checkRacing() {
+    GAsm gasm;
+    gasm.minimize = true;
+    gasm.individualMaxSize = 24;
+    gridCases(100, gasm.inputs, gasm.targets);
+    GAsmInterpreter jit(1);
+    jit.useCompile = false;
+    jit.setCng(std::make_unique<gen_fn_t>([]() { return 1.0; }));  // the default counter never repeats a run
+    FitnessSumSub fitness;
+    FullGrow grow;
+    Random random(7);
+    std::vector<uint8_t> program;
+
+    auto lost = [](double score, double cutoff) { return score > cutoff; };  // minimized
+    size_t stopped = 0;
+    const size_t races = 8 * CaseFitness::reorderInterval;
+    for (size_t r = 0; r < races; r++) {
+        grow(&gasm, random, program);
+        Random::local() = Random(r);  // the RNG instruction draws the same in both runs
+        const double full = fitness(&gasm, jit, program).first;
+        const std::vector<double> fullErrors(fitness.caseErrors().begin(), fitness.caseErrors().end());
+        // a half, the tie and a bit more of the score, and an unrelated one
+        const double cutoffs[] = {full / 2, full, full * 1.5 + 1, (double)random.below(1000)};
+        const double cutoff = cutoffs[r % 4];
+        Random::local() = Random(r);
+        const double raced = fitness.bounded(&gasm, jit, program, cutoff).first;
+        const std::string what = "race " + std::to_string(r) + " full " + std::to_string(full)
+                                 + " cutoff " + std::to_string(cutoff) + " raced " + std::to_string(raced);
+        check(lost(raced, cutoff) == lost(full, cutoff), what + ": verdict differs from the full run");
+        check(raced <= full, what + ": the cases run scored more than all of them");
+        if (!lost(raced, cutoff)) {
+            check(sameBits(raced, full), what + ": a race that isn't lost scores differently");
+        }
+        if (raced != full) {
+            stopped++;
+        }
+        // a stopped race leaves the errors of the full run, a finished one has the same
+        check(std::equal(fullErrors.begin(), fullErrors.end(), fitness.caseErrors().begin(), fitness.caseErrors().end()),
+              what + ": the case errors changed");
+    }
+    check(stopped > 0, "no race stopped early");
+}
+
+// the progress bars of evolve go nowhere
+class NullBuffer : public std::streambuf {
+protected:
+    int overflow(int c) override { return c; }
+    std::streamsize xsputn(const char*, std::streamsize n) override { return n; }
+};
+
+// generational evolution on the interpreter, the CNG is the same in every run and thread
+static void configureEvolution(GAsm& gasm, uint64_t seed) {
+    gasm.setCompile(false);
+    gasm.setCNG(std::make_unique<gen_fn_t>([]() { return 1.0; }));
+    gasm.seed = seed;
+    gasm.minimize = true;
+    gasm.goalFitness = -1;  // never reached, every generation runs
+    gasm.populationSize = 120;
+    gasm.maxGenerations = 8;
+    gasm.individualMaxSize = 24;
+    gasm.generational = true;
+    gasm.elitism = 2;
+}
+
+// the same seed breeds the same best individual serially and on any number of threads
+static void checkThreads() {
+    std::vector<std::vector<double>> inputs, targets;
+    gridCases(100, inputs, targets);
+    NullBuffer null;
+    std::streambuf* out = std::cout.rdbuf(&null);
+    // serial, then 1 and 3 threads
+    std::vector<std::vector<uint8_t>> best;
+    std::vector<std::vector<double>> fitnesses;
+    size_t generations = 0;
+    for (size_t threads : {0, 1, 3}) {
+        GAsm gasm;
+        configureEvolution(gasm, 11);
+        if (threads == 0) {
+            gasm.evolve(inputs, targets);
+        } else {
+            gasm.setThreads(threads);
+            gasm.parallelEvolve(inputs, targets);
+        }
+        generations = gasm.maxGenerations;
+        best.push_back(gasm.bestIndividual);
+        fitnesses.emplace_back();
+        for (const Entry& entry : gasm.hist.getEntries()) {
+            fitnesses.back().push_back(entry.getBestFitness());
+        }
+    }
+    std::cout.rdbuf(out);
+
+    const char* names[] = {"serial", "1 thread", "3 threads"};
+    check(!best[0].empty() && fitnesses[0].size() == generations, "serial: no best individual or not every generation in hist");
+    for (size_t run = 1; run < best.size(); run++) {
+        check(best[run] == best[0], std::string(names[run]) + ": best individual differs from the serial run");
+        check(fitnesses[run].size() == fitnesses[0].size()
+              && std::equal(fitnesses[run].begin(), fitnesses[run].end(), fitnesses[0].begin(), sameBits),
+              std::string(names[run]) + ": best fitness differs from the serial run");
+    }
+}
+
+// every mode picks as many distinct cases as asked for, in memory order, with and without difficulties
+static void checkSubsets() {
+    const size_t caseCount = 100;
+    CaseSampler sampler;
+    Random random(3);
+    std::vector<size_t> failures;
+    const char* names[] = {"Random", "Dynamic", "Interleaved"};
+    for (Sampling sampling : {Sampling::Random, Sampling::Dynamic, Sampling::Interleaved}) {
+        for (size_t sampleSize : {1, 17, 99, 100}) {
+            sampler.reset(caseCount);
+            for (int generation = 0; generation < 20; generation++) {
+                sampler.choose(sampling, caseCount, sampleSize, random);
+                const std::vector<size_t>& cases = sampler.cases();
+                check(cases.size() == sampleSize && std::is_sorted(cases.begin(), cases.end())
+                      && std::adjacent_find(cases.begin(), cases.end()) == cases.end() && cases.back() < caseCount,
+                      std::string(names[(int)sampling]) + " sample of " + std::to_string(sampleSize) + ": picked "
+                      + std::to_string(cases.size()) + " cases, or not distinct and sorted");
+                failures.resize(sampleSize);
+                for (size_t& failed : failures) {
+                    failed = random.below(11);
+                }
+                sampler.recordFailures(failures, 10);
+            }
+        }
+    }
+}
+
+// the sizes of the case sets evaluations run on
+static std::vector<size_t> evaluatedCaseCounts;
+
+class RecordingFitness : public FitnessSumSub {
+public:
+    std::pair<double, double> operator()(const GAsm* self, GAsmInterpreter& jit, const std::vector<uint8_t>& individual) override {
+        evaluatedCaseCounts.push_back(self->caseInputs().size());
+        return FitnessSumSub::operator()(self, jit, individual);
+    }
+    [[nodiscard]] std::unique_ptr<FitnessFunction> clone() const override { return std::make_unique<RecordingFitness>(*this); }
+};
+
+// evolution runs on the sample of every generation, the best individual it reports is scored on all the cases
+static void checkSampling() {
+    std::vector<std::vector<double>> inputs, targets;
+    gridCases(100, inputs, targets);
+    const char* names[] = {"Random", "Dynamic", "Interleaved"};
+    NullBuffer null;
+    for (Sampling sampling : {Sampling::Random, Sampling::Dynamic, Sampling::Interleaved}) {
+        const std::string name = names[(int)sampling];
+        GAsm gasm;
+        configureEvolution(gasm, 5);
+        gasm.setRNG(std::make_unique<gen_fn_t>([]() { return 0.5; }));
+        gasm.setFitnessFunction(std::make_unique<RecordingFitness>());
+        gasm.sampleSize = 30;
+        gasm.sampling = sampling;
+        gasm.fullInterval = 3;
+        evaluatedCaseCounts.clear();
+        std::streambuf* out = std::cout.rdbuf(&null);
+        gasm.evolve(inputs, targets);
+        std::cout.rdbuf(out);
+
+        const bool sampled = std::count(evaluatedCaseCounts.begin(), evaluatedCaseCounts.end(), gasm.sampleSize) > 0;
+        const bool full = std::count(evaluatedCaseCounts.begin(), evaluatedCaseCounts.end(), inputs.size()) > 0;
+        const bool others = std::any_of(evaluatedCaseCounts.begin(), evaluatedCaseCounts.end(),
+                                        [&](size_t count) { return count != gasm.sampleSize && count != inputs.size(); });
+        check(sampled && full && !others, name + ": evaluations didn't run on the sample and on all the cases only");
+
+        // the reported fitness is the one of all the cases, scored again here
+        GAsm all;
+        configureEvolution(all, 5);
+        all.inputs = inputs;
+        all.targets = targets;
+        GAsmInterpreter jit(gasm.getRegisterLength());
+        jit.useCompile = false;
+        jit.setCng(std::make_unique<gen_fn_t>([]() { return 1.0; }));
+        jit.setRng(std::make_unique<gen_fn_t>([]() { return 0.5; }));
+        FitnessSumSub fitness;
+        const Entry& last = gasm.hist.getLast();
+        const double expected = fitness(&all, jit, last.getBestBytecode()).first;
+        check(last.getBestBytecode() == gasm.bestIndividual, name + ": hist and the best individual differ");
+        check(sameBits(last.getBestFitness(), expected), name + ": best fitness " + std::to_string(last.getBestFitness())
+                                                         + ", on all the cases " + std::to_string(expected));
+    }
+}
+
+// errors of hand-built individuals, the grown program of the k-th individual is k + 1 instructions long
+static const std::vector<std::vector<double>> errorTable = {
+        {3, 1, 2, 2},
+        {4, 2, 1, 2},
+        {5, 2, 2, 1},
+        {6, 1, 1, 3},
+        {4, 3, 3, 3},
+        {0, 9, 9, 9},  // the specialist, the best on the first case and the worst sum but one
+        {9, 9, 9, 9},  // worse than the one above it on every case
+};
+static const size_t specialist = 5;
+static const size_t dominated = 6;
+static size_t grown = 0;
+
+class TableGrow : public GrowFunction {
+public:
+    void operator()(const GAsm*, Random&, std::vector<uint8_t>& individual) override {
+        individual.assign(grown++ % errorTable.size() + 1, MOV_A_R);
+    }
+    [[nodiscard]] std::unique_ptr<GrowFunction> clone() const override { return std::make_unique<TableGrow>(*this); }
+};
+
+class TableFitness : public CaseFitness {
+private:
+    size_t row_ = 0;
+public:
+    std::pair<double, double> operator()(const GAsm* self, GAsmInterpreter& jit, const std::vector<uint8_t>& individual) override {
+        row_ = (std::max<size_t>(individual.size(), 1) - 1) % errorTable.size();
+        return CaseFitness::operator()(self, jit, individual);
+    }
+    double caseError(const GAsm*, size_t i, std::span<const double>) override { return errorTable[row_][i]; }
+    [[nodiscard]] std::unique_ptr<FitnessFunction> clone() const override { return std::make_unique<TableFitness>(*this); }
+};
+
+// lexicase on the errors above, the specialist is picked whenever its case comes first and the dominated
+// individual never, epsilon is the median absolute deviation of the case
+static void checkLexicase() {
+    std::vector<std::vector<double>> inputs, targets;
+    gridCases(errorTable[0].size(), inputs, targets);
+    GAsm gasm;
+    configureEvolution(gasm, 9);
+    gasm.generational = false;
+    gasm.populationSize = errorTable.size();
+    gasm.maxGenerations = 1;  // the errors of the grown population are sorted at the start of it
+    gasm.setGrowFunction(std::make_unique<TableGrow>());
+    gasm.setFitnessFunction(std::make_unique<TableFitness>());
+    gasm.setSelectionFunction(std::make_unique<LexicaseSelection>());
+    grown = 0;
+    NullBuffer null;
+    std::streambuf* out = std::cout.rdbuf(&null);
+    gasm.evolve(inputs, targets);
+    std::cout.rdbuf(out);
+
+    // the matrix holds the table, individual by individual
+    const ErrorMatrix& matrix = gasm.caseErrors();
+    bool table = matrix.individuals() == errorTable.size() && matrix.cases() == errorTable[0].size();
+    for (size_t c = 0; table && c < matrix.cases(); c++) {
+        for (size_t i = 0; i < matrix.individuals(); i++) {
+            table = table && matrix.column(c)[i] == (float)errorTable[i][c];
+        }
+    }
+    check(table, "lexicase: the case errors aren't the ones of the table");
+    if (!table) {
+        return;
+    }
+
+    // the median of a case, then the median of the distances from it
+    for (size_t c = 0; c < matrix.cases(); c++) {
+        std::vector<float> column(matrix.column(c).begin(), matrix.column(c).end());
+        std::sort(column.begin(), column.end());
+        const float median = column[column.size() / 2];
+        for (float& error : column) {
+            error = std::fabs(error - median);
+        }
+        std::sort(column.begin(), column.end());
+        check(matrix.deviation(c) == column[column.size() / 2], "lexicase: epsilon of case " + std::to_string(c)
+                                                                + " isn't the median absolute deviation");
+    }
+    check(matrix.deviation(0) == 1.0f, "lexicase: epsilon of the first case isn't 1");
+
+    for (bool epsilon : {false, true}) {
+        const std::string name = epsilon ? "epsilon lexicase" : "lexicase";
+        LexicaseSelection selection(epsilon);
+        size_t specialists = 0;
+        size_t dominatedPicks = 0;
+        const size_t selections = 400;
+        for (size_t s = 0; s < selections; s++) {
+            Random random(s);
+            const size_t picked = selection(&gasm, random);
+            specialists += picked == specialist ? 1 : 0;
+            dominatedPicks += picked == dominated ? 1 : 0;
+        }
+        // a quarter of the orders start with the case of the specialist
+        check(specialists > selections / 8 && specialists < selections / 2,
+              name + ": the specialist was picked " + std::to_string(specialists) + " times out of "
+              + std::to_string(selections));
+        check(dominatedPicks == 0, name + ": the dominated individual was picked");
+    }
+}
+
+int main() {
+    checkRacing();
+    checkThreads();
+    checkSubsets();
+    checkSampling();
+    checkLexicase();
+    std::cout << (failures == 0 ? "all checks passed" : std::to_string(failures) + " checks failed") << std::endl;
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,136 @@
+//
+// Steady-state selection and replacement from several threads, the seqlocks of Population against a mutex per individual
+//
+// usage: gasm_contention [populationSize] [milliseconds per run] [replacements per 100 selections] [max threads]
+// every thread runs binary tournaments on the fitness and replaces the loser of every few of them with a
+// copy of the winner, as the runners of parallelEvolve do, without evaluating anything
+//
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+#include "Population.h"
+
+// the storage of GAsm before the seqlocks
+class LockedPopulation {
+private:
+    std::vector<std::vector<uint8_t>> genomes_;
+    std::vector<double> fitness_;
+    std::vector<std::unique_ptr<std::mutex>> mutexes_;
+public:
+    LockedPopulation(size_t count, size_t maxSize) : genomes_(count, std::vector<uint8_t>(maxSize)), fitness_(count) {
+        for (size_t i = 0; i < count; i++) {
+            mutexes_.push_back(std::make_unique<std::mutex>());
+            fitness_[i] = (double)i;
+        }
+    }
+    double fitnessOf(size_t i) const {
+        std::lock_guard<std::mutex> guard(*mutexes_[i]);
+        return fitness_[i];
+    }
+    void copy(size_t i, std::vector<uint8_t>& out) const {
+        std::lock_guard<std::mutex> guard(*mutexes_[i]);
+        out = genomes_[i];
+    }
+    void publish(size_t i, const std::vector<uint8_t>& genome, double fitness) {
+        std::lock_guard<std::mutex> guard(*mutexes_[i]);
+        genomes_[i] = genome;
+        fitness_[i] = fitness;
+    }
+};
+
+class SeqlockPopulation {
+private:
+    Population population_;
+public:
+    SeqlockPopulation(size_t count, size_t maxSize) {
+        population_.resize(count, maxSize);
+        std::vector<uint8_t> genome(maxSize);
+        for (size_t i = 0; i < count; i++) {
+            population_.publish(i, genome, (double)i, 0.0);
+        }
+    }
+    double fitnessOf(size_t i) const { return population_.fitnessOf(i); }
+    void copy(size_t i, std::vector<uint8_t>& out) const { population_.copy(i, out); }
+    void publish(size_t i, const std::vector<uint8_t>& genome, double fitness) { population_.publish(i, genome, fitness, 0.0); }
+};
+
+// selections per second of all the threads together
+template <typename Store>
+static double measure(Store& store, size_t count, size_t threads, std::chrono::milliseconds duration, size_t replacePercent) {
+    std::atomic<bool> stop = false;
+    std::atomic<size_t> selections = 0;
+    std::vector<std::thread> workers;
+    for (size_t t = 0; t < threads; t++) {
+        workers.emplace_back([&, t]() {
+            std::mt19937 engine((uint32_t)t + 1);
+            std::uniform_int_distribution<size_t> pick(0, count - 1);
+            std::uniform_int_distribution<size_t> percent(0, 99);
+            std::vector<uint8_t> child;
+            size_t done = 0;
+            while (!stop.load(std::memory_order_relaxed)) {
+                size_t a = pick(engine);
+                size_t b = pick(engine);
+                double fa = store.fitnessOf(a);
+                double fb = store.fitnessOf(b);
+                size_t winner = fa >= fb ? a : b;
+                size_t loser = fa >= fb ? b : a;
+                if (percent(engine) < replacePercent) {
+                    store.copy(winner, child);
+                    child[0] ^= 1;
+                    store.publish(loser, child, std::max(fa, fb));
+                }
+                done++;
+            }
+            selections += done;
+        });
+    }
+    std::this_thread::sleep_for(duration);
+    stop = true;
+    for (std::thread& worker : workers) {
+        worker.join();
+    }
+    return (double)selections / std::chrono::duration<double>(duration).count();
+}
+
+int main(int argc, char** argv) {
+    size_t count = argc > 1 ? std::stoul(argv[1]) : 1000;
+    std::chrono::milliseconds duration(argc > 2 ? std::stoul(argv[2]) : 500);
+    size_t replacePercent = argc > 3 ? std::stoul(argv[3]) : 10;
+    const size_t maxSize = 30;
+    size_t hardware = argc > 4 ? std::stoul(argv[4]) : std::max(1u, std::thread::hardware_concurrency());
+
+    std::vector<size_t> threadCounts;
+    for (size_t threads = 1; threads < hardware; threads *= 2) {
+        threadCounts.push_back(threads);
+    }
+    threadCounts.push_back(hardware);
+
+    std::cout << "population " << count << ", " << replacePercent << " replacements per 100 selections" << std::endl;
+    std::cout << std::setw(8) << "threads" << std::setw(18) << "mutex sel/s" << std::setw(18) << "seqlock sel/s"
+              << std::setw(10) << "ratio" << std::setw(16) << "seqlock scale" << std::endl;
+    double seqlockSingle = 0;
+    for (size_t threads : threadCounts) {
+        LockedPopulation locked(count, maxSize);
+        SeqlockPopulation seqlocked(count, maxSize);
+        double mutexRate = measure(locked, count, threads, duration, replacePercent);
+        double seqlockRate = measure(seqlocked, count, threads, duration, replacePercent);
+        if (threads == 1) {
+            seqlockSingle = seqlockRate;
+        }
+        std::cout << std::setw(8) << threads
+                  << std::setw(18) << std::scientific << std::setprecision(3) << mutexRate
+                  << std::setw(18) << seqlockRate
+                  << std::setw(10) << std::fixed << std::setprecision(2) << seqlockRate / mutexRate
+                  << std::setw(16) << seqlockRate / seqlockSingle << std::endl;
+    }
+    return 0;
+}
@@ -0,0 +1,406 @@
+//
+// Runs random programs on the interpreter and on the JIT, checks that they agree bit for bit and how much faster the JIT is
+//
+// usage: gasm_differential [programs] [seed] [--fast-math] [--no-passes] [--no-jit]
+// the seed picks the kinds, sizes, inputs and grown programs, so a seed always runs the same programs,
+// every mismatch prints its program too
+// the interpreter is also checked against itself without the IR passes, the lanes and the superinstructions,
+// the effective bytecode of individuals against their whole programs and the fast math kernels against libm,
+// --no-jit only runs these parts
+//
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+#include "GAsm.h"
+#include "GAsmParser.h"
+#include "GAsmInterpreter.h"
+#include "Individual.h"
+#include "FastMath.h"
+#include "Superinstructions.h"
+
+// generators restarted before every run, so both engines see the same values
+static size_t cngCounter = 0;
+static std::mt19937_64 rngEngine;
+static double cng() { return (double)cngCounter++; }
+static double rng() { return std::uniform_real_distribution<double>(0, 1)(rngEngine); }
+static void restartGenerators(uint64_t seed) {
+    cngCounter = 0;
+    rngEngine.seed(seed);
+}
+
+// bits of the doubles, NaNs only have to be NaN on both sides, the payload isn't observable
+static bool sameBits(const double* a, const double* b, size_t length) {
+    for (size_t i = 0; i < length; i++) {
+        if (std::isnan(a[i]) && std::isnan(b[i])) {
+            continue;
+        }
+        if (std::memcmp(&a[i], &b[i], sizeof(double)) != 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// whole grown programs, grown programs cut short and random bytes of every opcode the parser knows
+static std::vector<uint8_t> randomProgram(GAsm& gasm, std::mt19937& engine, Random& random) {
+    static FullGrow fullGrow;
+    static TreeGrow treeGrows[] = {TreeGrow(2), TreeGrow(4), TreeGrow(6)};
+    static const uint8_t opcodes[] = {MOV_GROUP, ARITHMETIC_R_GROUP, ARITHMETIC_I_GROUP, UNARY_GROUP,
+                                      LOOP_GROUP, IF_GROUP, TERMINATION_GROUP};
+    gasm.individualMaxSize = 1 + engine() % 40;
+    std::vector<uint8_t> program;
+    switch (engine() % 4) {
+        case 0: fullGrow(&gasm, random, program); break;
+        case 1: treeGrows[engine() % 3](&gasm, random, program); break;
+        case 2:
+            treeGrows[engine() % 3](&gasm, random, program);
+            program.resize(engine() % (program.size() + 1));  // unclosed blocks
+            break;
+        default:
+            program.resize(gasm.individualMaxSize);
+            for (uint8_t& opcode : program) {
+                opcode = opcodes[engine() % sizeof(opcodes)];
+            }
+            break;
+    }
+    return program;
+}
+
+static std::vector<double> randomInputs(size_t length, std::mt19937& engine) {
+    static const double special[] = {0.0, -0.0, 1.0, -1.0, 0.5, 1e300, -1e-300, INFINITY, -INFINITY, NAN};
+    std::vector<double> inputs(length);
+    for (double& x : inputs) {
+        switch (engine() % 3) {
+            case 0: x = special[engine() % (sizeof(special) / sizeof(double))]; break;
+            case 1: x = (double)((int)(engine() % 21) - 10); break;
+            default: x = std::normal_distribution<double>(0, 100)(engine); break;
+        }
+    }
+    return inputs;
+}
+
+static void printMismatch(const std::vector<uint8_t>& program, const std::string& what, size_t inputLength,
+                          size_t registerLength, size_t maxProcessTime, const char* nameA, size_t timeA,
+                          const char* nameB, size_t timeB) {
+    std::cout << "MISMATCH in " << what << ": inputLength " << inputLength
+              << ", registerLength " << registerLength
+              << ", maxProcessTime " << maxProcessTime
+              << ", process time " << timeA << " " << nameA << ", " << timeB << " " << nameB << std::endl;
+    std::cout << GAsmParser::bytecode2Text(program.data(), program.size()) << std::endl;
+    std::cout << "----------------------------------" << std::endl;
+}
+
+// what a program runs on, the same for every pair of engines compared
+struct Workload {
+    size_t registerLength = 0;
+    size_t inputLength = 0;
+    size_t budgets[3] = {};                   // of the single runs
+    std::vector<std::vector<double>> singles;  // inputs of the single runs
+    std::vector<double> cases;                 // of the batch, one after another
+    size_t caseCount = 0;
+    size_t maxProcessTime = 1000;              // of the batch
+    uint64_t generatorSeed = 0;
+};
+
+// the single runs and the batch of a program on two engines, the second one runs the compiled code when compiled
+// is set, returns the mismatches
+static size_t compare(const std::vector<uint8_t>& program, const Workload& work, GAsmInterpreter& engineA,
+                      const char* nameA, GAsmInterpreter& engineB, const char* nameB, bool compiled, size_t& runs) {
+    size_t mismatches = 0;
+    // the passes only keep the inputs, the outputs of the program, registers may differ between passes
+    const bool registers = engineA.getPasses() == engineB.getPasses();
+    for (size_t i = 0; i < work.singles.size(); i++) {
+        std::vector<double> a = work.singles[i];
+        std::vector<double> b = a;
+        restartGenerators(work.generatorSeed);
+        size_t timeA = engineA.runInterpreter(a, work.budgets[i]);
+        restartGenerators(work.generatorSeed);
+        size_t timeB = compiled ? engineB.runCompiled(b, work.budgets[i]) : engineB.runInterpreter(b, work.budgets[i]);
+        const std::vector<double>& ra = engineA.getRegisters();
+        const std::vector<double>& rb = engineB.getRegisters();
+        runs++;
+        if (timeA != timeB || !sameBits(a.data(), b.data(), work.inputLength)
+            || (registers && !sameBits(ra.data(), rb.data(), work.registerLength))) {
+            mismatches++;
+            printMismatch(program, "run", work.inputLength, work.registerLength, work.budgets[i],
+                          nameA, timeA, nameB, timeB);
+        }
+    }
+
+    std::vector<double> a = work.cases;
+    std::vector<double> b = work.cases;
+    std::vector<size_t> timesA(work.caseCount), timesB(work.caseCount);
+    restartGenerators(work.generatorSeed);
+    engineA.runBatch(a.data(), work.caseCount, work.inputLength, work.inputLength, timesA.data(), work.maxProcessTime);
+    restartGenerators(work.generatorSeed);
+    engineB.runBatch(b.data(), work.caseCount, work.inputLength, work.inputLength, timesB.data(), work.maxProcessTime);
+    runs++;
+    if (timesA != timesB || !sameBits(a.data(), b.data(), a.size())) {
+        mismatches++;
+        size_t c = 0;
+        while (c + 1 < work.caseCount && timesA[c] == timesB[c]
+               && sameBits(a.data() + c * work.inputLength, b.data() + c * work.inputLength, work.inputLength)) {
+            c++;
+        }
+        printMismatch(program, "batch", work.inputLength, work.registerLength, work.maxProcessTime,
+                      nameA, timesA[c], nameB, timesB[c]);
+    }
+    return mismatches;
+}
+
+// what an interpreter compared to the plain one turns on
+struct Configuration {
+    const char* name;
+    bool passes;
+    bool lanes;
+    bool superinstructions;
+};
+
+static double percentile(std::vector<double>& sorted, double p) {
+    return sorted[std::min(sorted.size() - 1, (size_t)(p * (double)(sorted.size() - 1) + 0.5))];
+}
+
+// the effective bytecode of an individual against the whole program, on the plain interpreter so the passes
+// can't make up for a bad splice, only runs that finish count, the effective one may get further otherwise
+static size_t compareEffective(const std::vector<uint8_t>& program, const Workload& work, size_t& runs) {
+    const std::vector<uint8_t> effective = Individual(program).getEffectiveBytecode();
+    GAsmInterpreter whole(program, work.registerLength);
+    GAsmInterpreter stripped(effective, work.registerLength);
+    for (GAsmInterpreter* runner : {&whole, &stripped}) {
+        runner->useCompile = false;
+        runner->setPasses(IrPasses{false, false, false, false, false});
+        runner->setCng(std::make_unique<gen_fn_t>(&cng));
+        runner->setRng(std::make_unique<gen_fn_t>(&rng));
+    }
+    const size_t budget = 1000000;
+    size_t mismatches = 0;
+    for (const std::vector<double>& inputs : work.singles) {
+        std::vector<double> a = inputs;
+        std::vector<double> b = inputs;
+        restartGenerators(work.generatorSeed);
+        const size_t wholeTime = whole.runInterpreter(a, budget);
+        restartGenerators(work.generatorSeed);
+        const size_t strippedTime = stripped.runInterpreter(b, budget);
+        if (wholeTime > budget) {
+            continue;
+        }
+        runs++;
+        if (!sameBits(a.data(), b.data(), work.inputLength)) {
+            mismatches++;
+            printMismatch(program, "effective bytecode", work.inputLength, work.registerLength, budget,
+                          "whole", wholeTime, "effective", strippedTime);
+            std::cout << GAsmParser::bytecode2Text(effective.data(), effective.size()) << std::endl;
+            std::cout << "----------------------------------" << std::endl;
+        }
+    }
+    return mismatches;
+}
+
+// distance in representable doubles, both finite and of the same sign
+static uint64_t ulps(double a, double b) {
+    uint64_t x, y;
+    std::memcpy(&x, &a, sizeof(double));
+    std::memcpy(&y, &b, sizeof(double));
+    return x > y ? x - y : y - x;
+}
+
+// the largest error of a FastMath kernel against libm on random arguments in [low, high], fails over the bound
+static size_t checkKernel(const char* name, double (*fast)(double), double (*exact)(double), double low, double high,
+                          uint64_t bound, std::mt19937_64& engine) {
+    std::uniform_real_distribution<double> argument(low, high);
+    uint64_t worst = 0;
+    double worstArgument = 0;
+    for (size_t i = 0; i < 1000000; i++) {
+        const double x = argument(engine);
+        const double f = fast(x);
+        const double e = exact(x);
+        // across zero the ulps don't count from one to the other, both are tiny there
+        const uint64_t error = std::signbit(f) == std::signbit(e) ? ulps(f, e) : ulps(std::fabs(f), 0) + ulps(std::fabs(e), 0);
+        if (error > worst) {
+            worst = error;
+            worstArgument = x;
+        }
+    }
+    std::cout << "FastMath::" << name << " on [" << low << ", " << high << "]: " << worst << " ulp at " << worstArgument
+              << std::endl;
+    if (worst > bound) {
+        std::cout << "MISMATCH: the bound is " << bound << " ulp" << std::endl;
+        return 1;
+    }
+    return 0;
+}
+
+// the kernels against libm over the arguments the engines give them, the documented bounds measure against the
+// exact result and libm is within half an ulp of it, so they get one more ulp here
+static size_t checkFastMath(uint64_t seed) {
+    auto exactExp = [](double x) { return std::exp(x); };
+    auto exactSin = [](double x) { return std::sin(x); };
+    auto exactCos = [](double x) { return std::cos(x); };
+    std::mt19937_64 engine(seed);
+    size_t failures = 0;
+    failures += checkKernel("exp", &FastMath::exp, exactExp, FastMath::expMin, FastMath::expMax, 2, engine);
+    failures += checkKernel("exp", &FastMath::exp, exactExp, -1, 1, 2, engine);
+    for (double limit : {10.0, FastMath::reductionLimit}) {
+        const uint64_t bound = limit == 10.0 ? 2 : 3;
+        failures += checkKernel("sin", &FastMath::sin, exactSin, -limit, limit, bound, engine);
+        failures += checkKernel("cos", &FastMath::cos, exactCos, -limit, limit, bound, engine);
+    }
+
+    // flushed results, and what goes to libm as it is
+    const double beyond[] = {FastMath::reductionLimit * 2, -1e10, 1e300, INFINITY, -INFINITY, NAN};
+    auto same = [](double a, double b) { return sameBits(&a, &b, 1); };
+    bool edges = same(FastMath::exp(FastMath::expMax + 1e-9), INFINITY) && same(FastMath::exp(INFINITY), INFINITY)
+                 && same(FastMath::exp(FastMath::expMin - 1e-9), 0.0) && same(FastMath::exp(-INFINITY), 0.0)
+                 && std::isnan(FastMath::exp(NAN));
+    for (double x : beyond) {
+        edges = edges && same(FastMath::sin(x), std::sin(x)) && same(FastMath::cos(x), std::cos(x));
+    }
+    if (!edges) {
+        std::cout << "MISMATCH: FastMath flushes or passes on to libm differently than documented" << std::endl;
+        failures++;
+    }
+    return failures;
+}
+
+int main(int argc, char** argv) {
+    size_t programs = 2000;
+    uint64_t seed = 1;
+    bool fastMath = false;
+    bool jit = true;
+    IrPasses passes;
+    size_t positional = 0;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--fast-math") {
+            fastMath = true;
+        } else if (arg == "--no-passes") {
+            passes = IrPasses{false, false, false, false, false};
+        } else if (arg == "--no-jit") {
+            jit = false;
+        } else if (positional++ == 0) {
+            programs = std::stoul(arg);
+        } else {
+            seed = std::stoull(arg);
+        }
+    }
+    std::mt19937 engine((uint32_t)seed);
+    Random random(seed);  // for the grow functions
+    GAsm gasm;  // only holds the size of the grown programs
+    const size_t caseCount = 64;
+    const size_t repetitions = 20;
+    const Configuration configurations[] = {
+            {"with passes", true, false, false},
+            {"in lanes", false, true, false},
+            {"with superinstructions", false, false, true},
+            {"with everything", true, true, true},
+    };
+    std::vector<size_t> allSuperinstructions;
+    for (size_t i = 0; i < Superinstructions::catalog().size(); i++) {
+        allSuperinstructions.push_back(i);
+    }
+
+    size_t runs = 0;
+    size_t mismatches = 0;
+    std::vector<double> speedups;
+    uint64_t compileNs = 0;
+    for (size_t p = 0; p < programs; p++) {
+        const std::vector<uint8_t> program = randomProgram(gasm, engine, random);
+        Workload work;
+        work.registerLength = 1 + engine() % 6;
+        work.inputLength = 1 + engine() % 8;
+        work.generatorSeed = p;
+        // single runs, budgets from cut in the middle to never reached
+        work.budgets[0] = engine() % 16;
+        work.budgets[1] = engine() % 200;
+        work.budgets[2] = 10000;
+        for (size_t i = 0; i < 3; i++) {
+            work.singles.push_back(randomInputs(work.inputLength, engine));
+        }
+        work.caseCount = caseCount;
+        for (size_t c = 0; c < caseCount; c++) {
+            std::vector<double> inputs = randomInputs(work.inputLength, engine);
+            work.cases.insert(work.cases.end(), inputs.begin(), inputs.end());
+        }
+        auto setUp = [&](GAsmInterpreter& runner) {
+            runner.setMathMode(fastMath ? MathMode::Fast : MathMode::Exact);
+            runner.setCng(std::make_unique<gen_fn_t>(&cng));
+            runner.setRng(std::make_unique<gen_fn_t>(&rng));
+        };
+
+        // the plain interpreter, one case after another, against the IR passes, the lanes and the superinstructions
+        GAsmInterpreter reference(program, work.registerLength);
+        reference.useCompile = false;
+        setUp(reference);
+        reference.setPasses(IrPasses{false, false, false, false, false});
+        reference.setCaseParallel(false);
+        for (const Configuration& configuration : configurations) {
+            GAsmInterpreter variant(program, work.registerLength);
+            variant.useCompile = false;
+            setUp(variant);
+            variant.setPasses(configuration.passes ? passes : IrPasses{false, false, false, false, false});
+            variant.setCaseParallel(configuration.lanes);
+            if (configuration.superinstructions) {
+                variant.setSuperinstructions(allSuperinstructions);
+            }
+            mismatches += compare(program, work, reference, "plain", variant, configuration.name, false, runs);
+        }
+        mismatches += compareEffective(program, work, runs);
+        if (!jit) {
+            continue;
+        }
+
+        GAsmInterpreter interpreted(program, work.registerLength);
+        GAsmInterpreter compiled(program, work.registerLength);
+        interpreted.useCompile = false;
+        compiled.tiered = false;
+        for (GAsmInterpreter* runner : {&interpreted, &compiled}) {
+            runner->setPasses(passes);
+            setUp(*runner);
+        }
+        mismatches += compare(program, work, interpreted, "interpreted", compiled, "compiled", true, runs);
+
+        // speed of the same batch, the compilation is left out
+        std::vector<double> a;
+        std::vector<size_t> times(caseCount);
+        double seconds[2];
+        for (int engineIndex = 0; engineIndex < 2; engineIndex++) {
+            GAsmInterpreter& runner = engineIndex == 0 ? interpreted : compiled;
+            auto start = std::chrono::steady_clock::now();
+            for (size_t r = 0; r < repetitions; r++) {
+                a = work.cases;
+                runner.runBatch(a.data(), caseCount, work.inputLength, work.inputLength, times.data(), work.maxProcessTime);
+            }
+            seconds[engineIndex] = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        }
+        speedups.push_back(seconds[0] / std::max(seconds[1], 1e-9));
+        compileNs += compiled.getTierStats().compileNs;
+    }
+
+    mismatches += checkFastMath(seed);
+
+    std::sort(speedups.begin(), speedups.end());
+    double logSum = 0;
+    for (double s : speedups) {
+        logSum += std::log(s);
+    }
+    std::cout << programs << " programs, " << runs << " runs, " << mismatches << " mismatches" << std::endl;
+    if (!speedups.empty()) {
+        std::cout << std::fixed << std::setprecision(2)
+                  << "JIT speedup: min " << speedups.front()
+                  << ", p10 " << percentile(speedups, 0.1)
+                  << ", median " << percentile(speedups, 0.5)
+                  << ", p90 " << percentile(speedups, 0.9)
+                  << ", max " << speedups.back()
+                  << ", geometric mean " << std::exp(logSum / (double)speedups.size()) << std::endl;
+        std::cout << "Compilation: " << (double)compileNs / 1e9 << "s, "
+                  << (double)compileNs / (double)programs / 1e3 << "us per program" << std::endl;
+    }
+    return mismatches == 0 ? 0 : 1;
+}
@@ -0,0 +1,51 @@
+//
+// Subsets of the fitness cases evolution runs on instead of all of them
+//
+
+#ifndef GASM_CASESAMPLER_H
+#define GASM_CASESAMPLER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <vector>
+#include "Random.h"
+
+enum class Sampling : uint8_t {
+    Random,       // a uniform subset every generation
+    Dynamic,      // weighted by how hard the cases are and how long they were left out
+    Interleaved,  // uniform subsets, every few generations all the cases
+};
+
+// Dynamic subset selection: a case is picked with weight difficulty^difficultyExponent + age^ageExponent.
+// Difficulty is the share of the last population scored on the case that did worse on it than on their
+// average case, age the generations since it was last picked over the generations a uniform draw leaves
+// a case out on average. A case as hard as they get weighs as much as one left out for as long as usual,
+// after that age takes over, so no case starves. Cases never scored count as hard as they can be.
+class CaseSampler {
+private:
+    std::vector<size_t> cases_;        // sorted, the rows of the subset
+    std::vector<double> difficulty_;   // by case, between 0 and 1
+    std::vector<uint32_t> age_;        // by case
+    std::vector<double> keys_;         // scratch of the weighted draw
+    std::vector<size_t> candidates_;
+public:
+    static constexpr double difficultyExponent = 1.0;
+    static constexpr double ageExponent = 3.5;
+
+    // methods
+    // forgets the difficulties and ages
+    void reset(size_t caseCount);
+    // picks sampleSize of the caseCount cases, the ages of all of them move on
+    void choose(Sampling sampling, size_t caseCount, size_t sampleSize, Random& random);
+    // failures[k] individuals out of population did worse than average on the k-th case of the subset
+    void recordFailures(std::span<const size_t> failures, size_t population);
+
+    // getters
+    [[nodiscard]] const std::vector<size_t>& cases() const { return cases_; }
+    [[nodiscard]] const std::vector<double>& difficulty() const { return difficulty_; }
+    [[nodiscard]] const std::vector<uint32_t>& age() const { return age_; }
+};
+
+
+#endif //GASM_CASESAMPLER_H
@@ -0,0 +1,40 @@
+//
+// Errors of the whole population case by case, sorted once a generation for lexicase selection
+//
+
+#ifndef GASM_ERRORMATRIX_H
+#define GASM_ERRORMATRIX_H
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <vector>
+#include "Population.h"
+
+// Case-major copy of the errors a population keeps, so the errors of all the individuals on one case are
+// adjacent. Every case also has its individuals sorted from the lowest error, the best or the worst on a
+// case are a run at one end of it, and the median absolute deviation of its errors, the epsilon of
+// epsilon lexicase. NaN errors count as infinite.
+class ErrorMatrix {
+private:
+    size_t individuals_ = 0;
+    size_t cases_ = 0;
+    std::vector<float> errors_;     // case by case
+    std::vector<uint32_t> order_;   // case by case, individuals from the lowest error
+    std::vector<float> deviation_;  // by case
+    std::vector<float> scratch_;
+public:
+    // methods
+    // copies and sorts the errors, nobody may write the population meanwhile
+    void prepare(const Population& population);
+
+    // getters
+    [[nodiscard]] size_t individuals() const { return individuals_; }
+    [[nodiscard]] size_t cases() const { return cases_; }
+    [[nodiscard]] std::span<const float> column(size_t c) const { return {errors_.data() + c * individuals_, individuals_}; }
+    [[nodiscard]] std::span<const uint32_t> order(size_t c) const { return {order_.data() + c * individuals_, individuals_}; }
+    [[nodiscard]] float deviation(size_t c) const { return deviation_[c]; }
+};
+
+
+#endif //GASM_ERRORMATRIX_H
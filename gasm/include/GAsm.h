@@ -23,17 +23,26 @@ unsigned int operator ""_max_gen(unsigned long long int);
 #include "Hist.h"
 #include "functions.h"
 #include "GAsmInterpreter.h"
+#include "Superinstructions.h"
 #include "Runner.h"
+#include "WorkerPool.h"
+#include "Placement.h"
+#include "Population.h"
+#include "CaseSampler.h"
+#include "ErrorMatrix.h"
 #include "Individual.h"
 
 class GAsm {
 private:
-    std::vector<std::vector<uint8_t>> population_;
-    std::vector<double> fitness_;
-    std::vector<double> rank_;  // other parameter determining the quality of individual
-    std::vector<std::unique_ptr<std::mutex>> individualMutexes_;
+    Population population_;  // rank is the other parameter determining the quality of individual
+    Population offspring_;   // the next generation of generational evolution, swapped with population_
+    std::vector<size_t> elites_;  // parents copied into the first slots of offspring_
+    std::vector<uint8_t> child_;  // offspring of evolve, keeps its capacity
+    uint64_t stream_ = 0;  // 0 while the population is grown, generation + 1 while it is bred
+    Random random_;        // stream of the individual evolve breeds
 
     GAsmInterpreter runner_;
+    std::shared_ptr<JitCache> jitCache_ = std::make_shared<JitCache>();  // compiled code shared by all the runners
 
     std::unique_ptr<FitnessFunction> fitnessFunction_ = std::make_unique<Fitness>();
     std::unique_ptr<SelectionFunction> selectionFunction_ = std::make_unique<TournamentSelection>(2);
@@ -42,17 +51,52 @@ private:
     std::unique_ptr<GrowFunction> growFunction_ = std::make_unique<FullGrow>();
 
     std::vector<Runner> runners_;
+    std::unique_ptr<WorkerPool> pool_;  // one worker per runner, started by the first parallel run
+
+    // copies of inputs and targets, by NUMA node, and the one the runner on this thread reads
+    struct CaseData {
+        std::vector<std::vector<double>> inputs;
+        std::vector<std::vector<double>> targets;
+    };
+    std::vector<std::unique_ptr<CaseData>> replicas_;
+    static thread_local const GAsm* localOwner_;
+    static thread_local const CaseData* localData_;
+    CaseSampler sampler_;
+    CaseData sample_;       // rows of the cases of this generation, small enough for one shared copy
+    bool sampled_ = false;  // the population is scored on sample_ instead of all the cases
+    bool collectErrors_ = false;  // the selection reads the errors of every individual on every case
+    ErrorMatrix caseErrors_;      // of the population at the start of the generation
+    std::vector<PlacementEntry> placement_;
+    std::vector<SuperinstructionGeneration> superinstructionReport_;
 
     double printGenerationStats(int gen, bool save = true);
+    void chooseSuperinstructions(int generation);
+    void reportSuperinstructions(int generation);
     void printHeader(const GAsm* self);
+    void printJitCacheStats() const;
+    void configureRunner(Runner& runner);
+    void dispatch(const std::function<void(Runner& runner, size_t begin, size_t end)>& work);
+    WorkerPool& pool();
+    void place();
+    void printPlacement() const;
+    void bestFirst(std::vector<size_t>& indices, size_t count) const;
+    void chooseElites();
+    void startSampling();
+    bool drawSample(int generation);
+    void rescore(bool parallel);
+    std::pair<double, size_t> bestOnAllCases();
+    void startCaseErrors();
+    bool keepCaseErrors();
+    [[nodiscard]] std::span<const double> lastCaseErrors() const;
+    void swapGenerations();
+    // index below the population size is the slot bred or grown, above it the slot scored again, past
+    // twice the size the sample and the individuals scored on all the cases
+    [[nodiscard]] Random stream(size_t index) const { return {seed, stream_, index}; }
+    [[nodiscard]] bool worse(double fitness, double than) const { return minimize ? fitness > than : fitness < than; }
 public:
     friend class Runner;
     // getters and setters
-//    [[nodiscard]] const std::vector<std::vector<uint8_t>>& getPopulation() const { return population_; }
-//    [[nodiscard]] const std::vector<double>& getFitness() const { return fitness_; }
-//    [[nodiscard]] const std::vector<double>& getRank() const { return rank_; }
-//    [[nodiscard]] const double& getFitness(size_t i) const { return fitness_[i]; }
-//    [[nodiscard]] const double& getRank(size_t i) const { return rank_[i]; }
+//    [[nodiscard]] const Population& getPopulation() const { return population_; }
     [[nodiscard]] const FitnessFunction& fitness() const { return *fitnessFunction_; }
     void setFitnessFunction(std::unique_ptr<FitnessFunction> f) { fitnessFunction_ = std::move(f);
         std::for_each(runners_.begin(), runners_.end(), [this](Runner& r){ r.setFitnessFunction(fitnessFunction_->clone()); }); }
@@ -73,42 +117,30 @@ public:
         ind.setRegisterLength(getRegisterLength());
         ind.maxProcessTime = maxProcessTime;
         ind.setCompile(getCompile());
+        ind.setMathMode(getMathMode());
         ind.setCNG(std::make_unique<gen_fn_t>(getCNG()));
         ind.setRNG(std::make_unique<gen_fn_t>(getRNG()));
         return ind;
     }
 
-    // thread safe setters and getters
+    // thread safe setters and getters, lock-free for readers
     std::vector<uint8_t> getIndividual(size_t idx) const {
-        std::lock_guard<std::mutex> guard(const_cast<std::mutex&>(*individualMutexes_[idx]));
-        return population_[idx];
+        std::vector<uint8_t> individual;
+        population_.copy(idx, individual);
+        return individual;
     }
-    void setIndividual(size_t idx, const std::vector<uint8_t>& bytecode, double newFitness, double newRank) {
-        std::lock_guard<std::mutex> guard(*individualMutexes_[idx]);
-        population_[idx] = bytecode;
-        fitness_[idx] = newFitness;
-        rank_[idx] = newRank;
+    void copyIndividual(size_t idx, std::vector<uint8_t>& out) const { population_.copy(idx, out); }
+    void setIndividual(size_t idx, std::span<const uint8_t> bytecode, double newFitness, double newRank,
+                       std::span<const double> errors = {}) {
+        population_.publish(idx, bytecode, newFitness, newRank, errors);
     }
 
-    [[nodiscard]] double getFitness(size_t idx) const {
-        std::lock_guard<std::mutex> guard(const_cast<std::mutex&>(*individualMutexes_[idx]));
-        return fitness_[idx];
-    }
+    [[nodiscard]] double getFitness(size_t idx) const { return population_.fitnessOf(idx); }
 
-    [[nodiscard]] double getRank(size_t idx) const {
-        std::lock_guard<std::mutex> guard(const_cast<std::mutex&>(*individualMutexes_[idx]));
-        return rank_[idx];
-    }
+    [[nodiscard]] double getRank(size_t idx) const { return population_.rankOf(idx); }
 
-    [[nodiscard]] std::pair<double, double> getFitnessRankSafe(size_t idx) const {
-        std::lock_guard<std::mutex> guard(const_cast<std::mutex&>(*individualMutexes_[idx]));
-        return {fitness_[idx], rank_[idx]};
-    }
-    void setFitnessRank(size_t idx, double f, double r) {
-        std::lock_guard<std::mutex> guard(*individualMutexes_[idx]);
-        fitness_[idx] = f;
-        rank_[idx] = r;
-    }
+    [[nodiscard]] std::pair<double, double> getFitnessRankSafe(size_t idx) const { return population_.scores(idx); }
+    void setFitnessRank(size_t idx, double f, double r) { population_.publishScores(idx, f, r); }
 
     // public attributes
     unsigned int populationSize = 1000;
@@ -125,6 +157,27 @@ public:
     std::vector<std::vector<double>> inputs;
     std::vector<std::vector<double>> targets;
     std::vector<uint8_t> bestIndividual;
+    // every that many generations the most frequent sequences of the population become superinstructions,
+    // 0 never mines them
+    size_t superinstructionInterval = 0;
+    size_t superinstructionCount = 8;  // superinstructions fused at once
+    // every generation breeds a whole new population from the current one, which nobody writes meanwhile,
+    // and the best elitism individuals survive unchanged; otherwise offspring replace individuals one by one
+    bool generational = false;
+    size_t elitism = 1;
+    // steady-state offspring only replace individuals they are at least as good as, and the fitness function
+    // may stop evaluating one as soon as it has lost
+    bool racing = false;
+    // the same seed, settings and data breed the same individuals, generational runs on any number of
+    // threads, steady-state ones only with evolve; the default CNG counts on across runs and threads,
+    // set one that doesn't for programs using it
+    uint64_t seed = Random::entropy();
+    // every generation is scored on sampleSize of the cases, 0 scores all of them; the population is scored
+    // again when the cases change, hist gets the best fitness over all the cases of the best elitism
+    // individuals by the sample, the avg fitness is over the sample
+    size_t sampleSize = 0;
+    Sampling sampling = Sampling::Random;
+    size_t fullInterval = 10;  // Interleaved scores all the cases every that many generations
 
     // runner setters and getters
     [[nodiscard]] size_t getRegisterLength() const { return runner_.getRegisterLength(); }
@@ -136,12 +189,58 @@ public:
     [[nodiscard]] const gen_fn_t& getRNG() const { return runner_.getRng(); }
     void setRNG(std::unique_ptr<gen_fn_t> rng) { runner_.setRng(std::make_unique<gen_fn_t>(*rng));
         std::for_each(runners_.begin(), runners_.end(), [&rng](Runner& r){ r.jit_.setCng(std::make_unique<gen_fn_t>(*rng)); }); }
+    [[nodiscard]] JitCacheStats getJitCacheStats() const { return jitCache_->getStats(); }
+    [[nodiscard]] size_t getJitCacheSize() const { return jitCache_->getMaxBytes(); }
+    void setJitCacheSize(size_t maxBytes) { jitCache_->setMaxBytes(maxBytes); }
+    [[nodiscard]] JitArenaStats getJitArenaStats() const { return JitArena::global().getStats(); }
+    [[nodiscard]] bool getJitHugePages() const { return JitArena::global().getHugePages(); }
+    void setJitHugePages(bool hugePages) { JitArena::global().setHugePages(hugePages); }
+    [[nodiscard]] const IrPasses& getPasses() const { return runner_.getPasses(); }
+    void setPasses(const IrPasses& passes) { runner_.setPasses(passes);
+        std::for_each(runners_.begin(), runners_.end(), [&passes](Runner& r){ r.jit_.setPasses(passes); }); }
+    [[nodiscard]] MathMode getMathMode() const { return runner_.getMathMode(); }
+    void setMathMode(MathMode mathMode) { runner_.setMathMode(mathMode);
+        std::for_each(runners_.begin(), runners_.end(), [mathMode](Runner& r){ r.jit_.setMathMode(mathMode); }); }
+    [[nodiscard]] bool getCaseParallel() const { return runner_.getCaseParallel(); }
+    void setCaseParallel(bool caseParallel) { runner_.setCaseParallel(caseParallel);
+        std::for_each(runners_.begin(), runners_.end(), [caseParallel](Runner& r){ r.jit_.setCaseParallel(caseParallel); }); }
     [[nodiscard]] const bool& getCompile() const { return runner_.useCompile; }
     void setCompile(const bool& useCompile) { runner_.useCompile = useCompile;
         std::for_each(runners_.begin(), runners_.end(), [&useCompile](Runner& r){ r.jit_.useCompile = useCompile; }); }
+    [[nodiscard]] bool getTiered() const { return runner_.tiered; }
+    void setTiered(bool tiered) { runner_.tiered = tiered;
+        std::for_each(runners_.begin(), runners_.end(), [tiered](Runner& r){ r.jit_.tiered = tiered; }); }
+    [[nodiscard]] TierStats getTierStats() const { TierStats stats = runner_.getTierStats();
+        std::for_each(runners_.begin(), runners_.end(), [&stats](const Runner& r){ stats += r.jit_.getTierStats(); });
+        return stats; }
+    // superinstructions fused in every generation since they were mined, and what they removed
+    [[nodiscard]] const std::vector<SuperinstructionGeneration>& getSuperinstructionReport() const {
+        return superinstructionReport_; }
+
+    // runners of parallelEvolve, one per thread, 0 uses every hardware thread
+    [[nodiscard]] size_t getThreads() const { return runners_.size(); }
+    void setThreads(size_t threads);
+    // batches of parallelEvolve stolen by another thread than the one they were dealt to
+    [[nodiscard]] size_t getSteals() const { return pool_ ? pool_->getSteals() : 0; }
+    // where the threads of the last parallelEvolve run and where their memory lives
+    [[nodiscard]] const std::vector<PlacementEntry>& getPlacement() const { return placement_; }
+    // errors of the population on the cases, sorted at the start of every generation when the selection
+    // function uses them
+    [[nodiscard]] const ErrorMatrix& caseErrors() const { return caseErrors_; }
+    // cases the fitness functions read, the sample of the generation when sampling, otherwise the copy on
+    // the NUMA node of the calling runner when data is replicated
+    [[nodiscard]] const std::vector<std::vector<double>>& caseInputs() const {
+        return sampled_ ? sample_.inputs : localOwner_ == this && localData_ != nullptr ? localData_->inputs : inputs; }
+    [[nodiscard]] const std::vector<std::vector<double>>& caseTargets() const {
+        return sampled_ ? sample_.targets : localOwner_ == this && localData_ != nullptr ? localData_->targets : targets; }
 
     // public runner attributes
     size_t maxProcessTime = 10000;
+    size_t workBatchSize = 4;  // individuals parallelEvolve hands to a thread at once
+    // placement of the parallelEvolve threads, the calling thread is runner 0 and gets its CPUs back at the end
+    bool pinThreads = false;
+    std::vector<std::vector<int>> threadCpus;  // CPUs of every runner, the missing ones get a CPU each, node by node
+    bool replicateData = false;  // every NUMA node with a runner gets its own copy of inputs and targets
 
     // constructors
     GAsm();
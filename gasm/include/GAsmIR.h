@@ -0,0 +1,100 @@
+//
+// Intermediate representation executed by the interpreter and the compiler
+//
+
+#ifndef GASM_GASMIR_H
+#define GASM_GASMIR_H
+
+#include <cstdint>
+#include <vector>
+#include "GAsmParser.h"
+
+// IR opcodes without a bytecode equivalent, they don't collide with GAsmParser's
+// JMP_* ... END block with nothing inside, only takes time
+#define EMPTY_JMP_I 0x70
+#define EMPTY_JMP_R 0x71
+#define EMPTY_JMP_P 0x72
+
+struct IrInstruction {
+    uint8_t opcode;
+    // bytecode instructions this one stands for, the ones folded into it ran right before it
+    // and had no effect, so the run may only stop before or after the whole group
+    uint32_t cost = 1;
+    // EMPTY_JMP_*: time of the END and of anything folded into it, taken only when the block isn't skipped
+    uint32_t bodyCost = 0;
+};
+
+// every pass can be switched off to measure what it gives
+struct IrPasses {
+    bool deadAccumulator = true;  // drop writes to A overwritten before any read
+    bool pointerFolding = true;   // cancel INC/DEC pairs, drop writes to P overwritten before any read
+    bool redundantLoads = true;   // drop loads and stores of a value A already holds
+    bool emptyBlocks = true;      // turn JMP_* END into a single instruction
+    bool effectiveCode = true;    // drop introns, instructions whose results never reach the inputs
+
+    bool operator==(const IrPasses& other) const = default;
+};
+
+// how the blocks of a program nest, an END closes the innermost open block,
+// blocks without END run till the end of the program and an END without a block does nothing
+struct IrBlocks {
+    std::vector<size_t> match;    // structural: its END, END: the block it closes, size of the program if there is none
+    std::vector<size_t> depth;    // structural and its END: blocks open around it, the saved state of the block
+    std::vector<size_t> forSlot;  // FOR and its END: FOR loops open around it, the counter of the loop
+    size_t maxDepth = 0;          // deepest block nesting
+    size_t forSlots = 0;          // deepest FOR nesting
+};
+
+// memory of the passes and the analyses, kept by the caller so lowering a program allocates nothing
+// once it has grown to the longest program
+struct IrScratch {
+    IrBlocks blocks;
+    std::vector<size_t> open;         // blocks open while matching
+    std::vector<size_t> pending;      // INC and DEC being folded
+    std::vector<uint8_t> opcodes;     // program of the liveness analysis
+    std::vector<uint8_t> liveIn;
+    std::vector<uint8_t> effective;   // by instruction, 1 when it is
+    std::vector<uint64_t> remaining;  // remainingCost
+
+    // room for programs of up to length instructions
+    void reserve(size_t length);
+};
+
+class GAsmIR {
+private:
+    static bool eliminateDeadAccumulator(std::vector<IrInstruction>& ir);
+    static bool foldPointer(std::vector<IrInstruction>& ir, IrScratch& scratch);
+    static bool eliminateRedundantLoads(std::vector<IrInstruction>& ir);
+    static bool removeEmptyBlocks(std::vector<IrInstruction>& ir);
+    static bool eliminateIntrons(std::vector<IrInstruction>& ir, IrScratch& scratch);
+public:
+    // fills ir with the optimized program, reuses its memory and the scratch
+    static void lower(const std::vector<uint8_t>& program, const IrPasses& passes, std::vector<IrInstruction>& ir,
+                      IrScratch& scratch);
+    static void lower(const std::vector<uint8_t>& program, const IrPasses& passes, std::vector<IrInstruction>& ir);
+    static std::vector<IrInstruction> lower(const std::vector<uint8_t>& program, const IrPasses& passes = IrPasses());
+    // backward liveness over the program, an instruction is effective if it can change the inputs,
+    // the control flow or the generators, the others can be removed without changing the outputs
+    static const std::vector<uint8_t>& effective(const std::vector<uint8_t>& program, IrScratch& scratch);
+    static std::vector<bool> effective(const std::vector<uint8_t>& program);
+    // matches every block with its END once, so nothing has to search for it at run time
+    static const IrBlocks& matchBlocks(const std::vector<uint8_t>& program, IrScratch& scratch);
+    static const IrBlocks& matchBlocks(const std::vector<IrInstruction>& ir, IrScratch& scratch);
+    static IrBlocks matchBlocks(const std::vector<uint8_t>& program);
+    static IrBlocks matchBlocks(const std::vector<IrInstruction>& ir);
+
+    // instructions in between jumps, no jump lands inside them
+    static bool endsStraightLine(uint8_t opcode) { return GAsmParser::isStructural(opcode) || opcode == END; }
+    // the most time an instruction can take
+    static uint64_t maxCost(const IrInstruction& instruction) { return (uint64_t)instruction.cost + instruction.bodyCost; }
+    // blocks end at an instruction that can jump, only their first instruction is jumped to
+    static bool isBlockStart(const std::vector<IrInstruction>& ir, size_t i) { return i == 0 || endsStraightLine(ir[i - 1].opcode); }
+    // time charged when the block starting at i is entered, empty JMP blocks add their body cost themselves
+    static uint64_t blockCost(const std::vector<IrInstruction>& ir, size_t i);
+    // the most time the instructions from i to the end can take when each runs once, for every i
+    static const std::vector<uint64_t>& remainingCost(const std::vector<IrInstruction>& ir, IrScratch& scratch);
+    static std::vector<uint64_t> remainingCost(const std::vector<IrInstruction>& ir);
+};
+
+
+#endif //GASM_GASMIR_H
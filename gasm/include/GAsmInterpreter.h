@@ -5,48 +5,186 @@
 #ifndef GASM_GASMINTERPRETER_H
 #define GASM_GASMINTERPRETER_H
 
+#include <chrono>
 #include <functional>
+#include <span>
 #include "xbyak.h"
 #include "functions.h"
-
-// function type returned by compile(...)
-using run_fn_t = size_t (*)(double* inputs, size_t inputLength,
-                            double* registers, size_t registerLength,
-                            double (*constants)(),
-                            double (*rng)(),
-                            size_t maxProcessTime);
+#include "JitCache.h"
+#include "GAsmIR.h"
+#include "FastMath.h"
+#include "Random.h"
 
 using gen_fn_t = double(*)();
 //using gen_fn_t = std::function<double()>;
 
+// runs, work and wall time of each tier, the tiering decisions are estimated from them
+struct TierStats {
+    size_t interpretedRuns = 0;
+    size_t compiledRuns = 0;
+    size_t interpretedCases = 0;
+    size_t compiledCases = 0;
+    size_t interpretedTime = 0;  // process time of the cases
+    size_t compiledTime = 0;
+    size_t compilations = 0;     // programs generated, cache hits not included
+    size_t compiledInstructions = 0;
+    uint64_t interpretedNs = 0;
+    uint64_t compiledNs = 0;
+    uint64_t compileNs = 0;
+
+    TierStats& operator+=(const TierStats& other);
+};
+
 
 class GAsmInterpreter {
 private:
     const std::vector<uint8_t>* program_;
+    std::vector<IrInstruction> ir_;  // program_ after the passes, lowered on first use
+    bool irReady_ = false;
+    IrPasses passes_;
+    IrScratch irScratch_;  // lowering and decoding keep their memory from one program to the next
+
+    // ir_ decoded for the interpreter, every entry knows its handler and where it jumps
+    struct DecodedInstruction {
+        const void* handler = nullptr;  // address of the handler, set by the first threaded run
+        uint8_t op = 0;                 // handler index
+        uint32_t cost = 0;              // process time of the IR instruction, 0 for the added entries
+        uint32_t bodyCost = 0;          // EMPTY_JMP_*
+        uint32_t target = 0;            // blocks: entry after the matching END, loop ENDs: first entry of the body
+        uint32_t slot = 0;              // FOR and its END: counter of the FOR
+        uint64_t amount = 0;            // block starts: time of the block, loop ENDs: time of the rest from the body
+    };
+    // registers of a run handed over from the fast to the checked interpreter
+    struct InterpreterState {
+        double A = 0;
+        size_t P = 0;
+        size_t PI = 0;  // P % inputLength
+        size_t PR = 0;  // P % registerLength
+        size_t processTime = 0;
+        size_t ip = 0;
+    };
+    std::vector<DecodedInstruction> decoded_;
+    std::vector<size_t> fused_;    // decode: superinstruction starting at every IR instruction
+    std::vector<uint32_t> entry_;  // decode: first entry of every IR instruction
+    bool decodedReady_ = false;
+    bool threaded_ = false;   // handler addresses are filled in
+    size_t forSlots_ = 0;     // deepest FOR nesting
+    // counter and counter % registerLength of every FOR nesting level, sized when the program is decoded,
+    // so runs of the interpreter don't allocate
+    std::vector<size_t> forCounters_;
+
+    // interpreter running cases in lanes, value j of lane l at j * caseLanes + l
+    std::vector<double> caseInputs_;
+    std::vector<double> caseRegisters_;
+    std::vector<uint8_t> caseMasks_;  // lanes outside of every open block, one mask per nesting level
+    bool casesInLanes_ = false;       // the decoded program can run in lanes
+    uint64_t entryLimit_ = 0; // time of the program run straight through
+    MathMode mathMode_ = MathMode::Exact;
+    bool caseParallel_ = true;
+    std::vector<size_t> superinstructions_;       // catalog indexes fused by decode, the first match wins
+    std::vector<uint64_t> superinstructionHits_;  // runs of every fused handler, by catalog index
     std::vector<double> registers_;
-    Xbyak::CodeGenerator code_;
+    std::shared_ptr<const CompiledProgram> code_;
+    std::shared_ptr<JitCache> cache_;
     run_fn_t compiled_;
+    batch_fn_t compiledBatch_;
+    size_t seenInputLength_ = 0;  // input length of the first compiled run
+    bool shapeVaries_ = false;    // compiled runs got inputs of different lengths
+    bool lanesDiverge_ = false;   // most groups of cases gave up running in lanes
+
+    // tiering, what the current program did so far
+    size_t programRuns_ = 0;
+    size_t programCases_ = 0;
+    size_t programTime_ = 0;
+    TierStats tierStats_;
+
+    // one group of cases in lanes, element j of lane l at j * lanes + l
+    std::vector<double> laneInputs_;
+    std::vector<double> laneRegisters_;
+
+    // flattened fitness cases used by runCases, case i lives in [caseOffsets_[i], caseOffsets_[i + 1])
+    std::vector<double> caseBuffer_;
+    std::vector<size_t> caseOffsets_;
+    std::vector<size_t> caseTimes_;
+    std::vector<uint8_t> key_;  // cache key of the program, reused by every lookup
 
     std::unique_ptr<gen_fn_t> cng_ = std::make_unique<gen_fn_t>([](){
                 static thread_local size_t counter = 0;
                 return (double) counter++;});
     std::unique_ptr<gen_fn_t> rng_ = std::make_unique<gen_fn_t>([](){
-                static thread_local std::mt19937 engine(std::random_device{}());
-                static std::uniform_real_distribution<double> dist(0, 1);
-                return dist(engine);});
+                return Random::local().unit();});
+
+    static std::shared_ptr<CompiledProgram> generate(const std::vector<IrInstruction>& program, const JitShape& shape,
+                                                    MathMode mathMode, bool caseParallel);
+    static bool lanesSupported(const std::vector<IrInstruction>& program);
+    static size_t generateLanes(Xbyak::CodeGenerator& code, const std::vector<IrInstruction>& program,
+                                const JitShape& shape, MathMode mathMode);
+    size_t runLanes(double* cases, size_t caseCount, size_t caseStride, size_t inputLength,
+                    size_t* processTimes, size_t maxProcessTime);
+    JitShape shapeFor(size_t inputLength);
+    void prepareCompiled(size_t inputLength);
+    const std::vector<uint8_t>& compiledKey(const JitShape& shape);
+    bool chooseCompiled(size_t caseCount, size_t inputLength);
+    void recordRun(bool compiled, size_t caseCount, size_t processTime, std::chrono::steady_clock::time_point start);
+    const std::vector<IrInstruction>& lowered();
+    void decode(const std::vector<IrInstruction>& ir);
+    const std::vector<DecodedInstruction>& decoded();
+    template<bool Checked>
+    size_t interpret(double* inputs, size_t inputLength, size_t maxProcessTime, size_t* counters,
+                     InterpreterState state);
+    size_t interpretLanes(double* cases, size_t caseCount, size_t caseStride, size_t inputLength,
+                          size_t* processTimes, size_t maxProcessTime);
+    bool interpretGroup(double* cases, size_t caseCount, size_t caseStride, size_t inputLength,
+                        size_t* processTimes, size_t maxProcessTime);
+    template<typename CaseAt>
+    size_t runCasesOf(size_t caseCount, CaseAt caseAt, size_t maxProcessTime);
 public:
     // getters and setters
-    [[nodiscard]] run_fn_t compile();
+    [[nodiscard]] run_fn_t compile(const JitShape& shape = JitShape());
     void setProgram(const std::vector<uint8_t>& program);
+    // sizes the buffers for programs of up to programLength bytes, running them allocates nothing afterwards
+    void reserve(size_t programLength);
     [[nodiscard]] size_t getRegisterLength() const { return registers_.size(); }
     void setRegisterLength(size_t registerLength);
+    // registers left by the last single run, interpreted or compiled
+    [[nodiscard]] const std::vector<double>& getRegisters() const { return registers_; }
     [[nodiscard]] const gen_fn_t& getCng() const { return *cng_; }
     void setCng(std::unique_ptr<gen_fn_t> cng) { cng_ = std::move(cng); }
     [[nodiscard]] const gen_fn_t& getRng() const { return *rng_; }
     void setRng(std::unique_ptr<gen_fn_t> rng) { rng_ = std::move(rng); }
+    [[nodiscard]] const std::shared_ptr<JitCache>& getJitCache() const { return cache_; }
+    void setJitCache(std::shared_ptr<JitCache> cache) { cache_ = std::move(cache); }
+    [[nodiscard]] const IrPasses& getPasses() const { return passes_; }
+    void setPasses(const IrPasses& passes);
+    [[nodiscard]] MathMode getMathMode() const { return mathMode_; }
+    void setMathMode(MathMode mathMode);
+    // runBatch evaluates groups of cases at once in SIMD lanes when the CPU and the program allow it,
+    // compiled or interpreted
+    [[nodiscard]] bool getCaseParallel() const { return caseParallel_; }
+    void setCaseParallel(bool caseParallel);
+    // sequences of Superinstructions::catalog() the fast interpreter runs with a single dispatch
+    [[nodiscard]] const std::vector<size_t>& getSuperinstructions() const { return superinstructions_; }
+    void setSuperinstructions(const std::vector<size_t>& superinstructions);
+    [[nodiscard]] const std::vector<uint64_t>& getSuperinstructionHits() const { return superinstructionHits_; }
+    void resetSuperinstructionHits();
+
+    [[nodiscard]] const TierStats& getTierStats() const { return tierStats_; }
+    void resetTierStats() { tierStats_ = TierStats(); }
+
+    // tiering estimates until the tier stats have enough samples
+    static constexpr double defaultInterpretedNs = 4.0;  // per unit of process time
+    static constexpr double defaultCompiledNs = 0.5;
+    static constexpr double defaultCompileNs = 1500.0;   // per IR instruction
+    static constexpr size_t minTierSamples = 100000;     // process time measured before the rates are trusted
+    // cases the interpreter runs at once, every instruction loops over them
+    static constexpr size_t caseLanes = 16;
 
     // public attributes
     bool useCompile = true;
+    // with useCompile, run and runBatch interpret a program until compiling it is expected to pay off
+    bool tiered = true;
+    size_t promoteAfterRuns = 4;  // compile a program run that many times anyway
+    bool specializeShapes = true;  // compile for the input and register lengths of the runs
 
     // constructors
     explicit GAsmInterpreter(const std::vector<uint8_t>& program, size_t registerLength);
@@ -60,7 +198,19 @@ public:
     // methods
     size_t run(std::vector<double> &inputs, size_t maxProcessTime);
     size_t runInterpreter(std::vector<double> &inputs, size_t maxProcessTime);
+    size_t runInterpreter(double* inputs, size_t inputLength, size_t maxProcessTime);
     size_t runCompiled(std::vector<double> &inputs, size_t maxProcessTime);
+    size_t runBatch(double* cases, size_t caseCount, size_t caseStride, size_t inputLength,
+                    size_t* processTimes, size_t maxProcessTime);
+    size_t runCases(const std::vector<std::vector<double>>& inputs, size_t maxProcessTime);
+    // only the listed cases, output k is the one of inputs[cases[k]]
+    size_t runCases(const std::vector<std::vector<double>>& inputs, std::span<const size_t> cases, size_t maxProcessTime);
+
+    // results of the last runCases call
+    [[nodiscard]] size_t getCaseCount() const { return caseTimes_.size(); }
+    [[nodiscard]] std::span<double> getCaseOutput(size_t i) {
+        return {caseBuffer_.data() + caseOffsets_[i], caseOffsets_[i + 1] - caseOffsets_[i]}; }
+    [[nodiscard]] size_t getCaseTime(size_t i) const { return caseTimes_[i]; }
 };
 
 
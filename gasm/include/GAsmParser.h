@@ -92,6 +92,10 @@ public:
     static constexpr uint8_t structuralOpcodes[structuralOpcodesLength] = {
             LOOP_GROUP,IF_GROUP
     };
+    // opcodes that open a block closed by END
+    static constexpr bool isStructural(uint8_t opcode) {
+        return (FOR <= opcode && opcode <= LOP_P) || (JMP_I <= opcode && opcode <= JMP_P);
+    }
 
     explicit GAsmParser(const std::string& filename);
     GAsmParser(const uint8_t* bytecode, size_t length);
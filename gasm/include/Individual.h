@@ -23,18 +23,21 @@ public:
         bytecode_.assign(bytes, bytes + len);
         jit_.setProgram(bytecode_);
     }
-    Individual(const Individual& other) : jit_(other.jit_), bytecode_(other.bytecode_) {}
+    // the interpreter has to run this individual's bytecode, not the one it was copied from
+    Individual(const Individual& other) : jit_(other.jit_), bytecode_(other.bytecode_) { jit_.setProgram(bytecode_); }
     Individual& operator=(const Individual& other) {
         if (this != &other) {
             jit_ = other.jit_;
             bytecode_ = other.bytecode_;
+            jit_.setProgram(bytecode_);
         }
         return *this;}
-    Individual(Individual&& other) noexcept : jit_(std::move(other.jit_)), bytecode_(std::move(other.bytecode_)) {}
+    Individual(Individual&& other) noexcept : jit_(std::move(other.jit_)), bytecode_(std::move(other.bytecode_)) { jit_.setProgram(bytecode_); }
     Individual& operator=(Individual&& other) noexcept {
         if (this != &other) {
             jit_ = std::move(other.jit_);
             bytecode_ = std::move(other.bytecode_);
+            jit_.setProgram(bytecode_);
         }
         return *this;}
     ~Individual() = default;
@@ -48,7 +51,12 @@ public:
     void setRNG(std::unique_ptr<gen_fn_t> rng) { jit_.setRng(std::move(rng)); }
     [[nodiscard]] const bool& getCompile() const { return jit_.useCompile; }
     void setCompile(const bool& useCompile) { jit_.useCompile = useCompile; }
+    [[nodiscard]] MathMode getMathMode() const { return jit_.getMathMode(); }
+    void setMathMode(MathMode mathMode) { jit_.setMathMode(mathMode); }
     [[nodiscard]] const std::vector<uint8_t>& getBytecode() const { return bytecode_; }
+    // bytecode without the introns, gives the same outputs for runs that finish within maxProcessTime,
+    // the process time of the dropped instructions is gone, so a run cut short by the budget may not
+    [[nodiscard]] std::vector<uint8_t> getEffectiveBytecode() const;
 
     // public runner attributes
     size_t maxProcessTime = 10000;
@@ -56,6 +64,7 @@ public:
     // methods
     size_t run(std::vector<double>& inputs) { return jit_.run(inputs, maxProcessTime); };
     std::string toString() { return GAsmParser::bytecode2Text(bytecode_.data(), bytecode_.size()); }
+    std::string effectiveToString() const;
 };
 
 
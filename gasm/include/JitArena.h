@@ -0,0 +1,113 @@
+//
+// Executable memory shared by all the compiled programs of the process
+//
+
+#ifndef GASM_JITARENA_H
+#define GASM_JITARENA_H
+
+#include <cstdint>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+class JitArena;
+
+struct JitArenaStats {
+    size_t regions = 0;      // mapped regions
+    size_t mappedBytes = 0;  // memory mapped by the regions
+    size_t usedBytes = 0;    // code of the programs still alive
+    size_t blocks = 0;       // programs still alive
+    size_t allocations = 0;  // programs copied into the arena so far
+    size_t freedRegions = 0; // regions emptied all at once when their last program died
+};
+
+// machine code of one program inside the arena, the space goes back to the arena when it's destroyed
+class JitBlock {
+private:
+    friend class JitArena;
+    JitArena* arena_ = nullptr;
+    void* region_ = nullptr;
+    const uint8_t* code_ = nullptr;
+    size_t size_ = 0;
+
+    JitBlock(JitArena* arena, void* region, const uint8_t* code, size_t size)
+        : arena_(arena), region_(region), code_(code), size_(size) {}
+public:
+    // constructors
+    JitBlock() = default;
+    JitBlock(const JitBlock& other) = delete;
+    JitBlock& operator=(const JitBlock& other) = delete;
+    JitBlock(JitBlock&& other) noexcept;
+    JitBlock& operator=(JitBlock&& other) noexcept;
+    ~JitBlock();
+
+    // getters
+    [[nodiscard]] const uint8_t* getCode() const { return code_; }
+    [[nodiscard]] size_t getSize() const { return size_; }
+};
+
+// Code of many programs is carved out of big regions instead of mapping memory for every program.
+// Every region is mapped twice: code is written through a read-write view and run from a read-execute
+// view of the same memory, so no page is ever writable and executable and the protection never changes.
+// Programs are packed one after another and never freed one by one, a region is emptied all at once
+// when its last program dies. newGeneration() starts a new region, so the programs of one generation
+// of the evolution live and die together.
+class JitArena {
+private:
+    struct Region {
+        uint8_t* write = nullptr;    // read-write view
+        uint8_t* execute = nullptr;  // read-execute view of the same memory
+        size_t size = 0;
+        size_t used = 0;
+        size_t blocks = 0;           // programs still alive
+        bool hugePages = false;
+    };
+
+    mutable std::mutex mutex_;
+    std::vector<std::unique_ptr<Region>> regions_;
+    Region* current_ = nullptr;  // region new programs are copied into
+    Region* spare_ = nullptr;    // one empty region is kept to be reused
+    size_t regionSize_ = defaultRegionSize;
+    bool hugePages_ = false;
+    size_t mappedBytes_ = 0;
+    size_t usedBytes_ = 0;
+    size_t blocks_ = 0;
+    size_t allocations_ = 0;
+    size_t freedRegions_ = 0;
+
+    Region* map(size_t size);
+    void unmap(Region* region);  // also forgets the region
+    void retire(Region* region);  // frees the region once it has no programs
+    void release(void* region, size_t size);
+    friend class JitBlock;
+public:
+    static constexpr size_t defaultRegionSize = 2 * 1024 * 1024;  // one huge page
+    static constexpr size_t alignment = 64;  // every program starts on its own cache line
+
+    // constructors
+    JitArena() = default;
+    JitArena(const JitArena& other) = delete;
+    JitArena& operator=(const JitArena& other) = delete;
+    ~JitArena();
+
+    // arena used by the compiler, never destroyed so blocks may outlive everything else
+    static JitArena& global();
+
+    // methods
+    // copies the code into executable memory, the code must not depend on where it's placed
+    JitBlock allocate(const uint8_t* code, size_t size);
+    // the next programs go to a new region, the current one is freed when its programs die
+    void newGeneration();
+
+    // getters and setters
+    [[nodiscard]] JitArenaStats getStats() const;
+    [[nodiscard]] size_t getRegionSize() const;
+    void setRegionSize(size_t regionSize);
+    // back new regions with huge pages when the system has them, falls back to normal pages
+    [[nodiscard]] bool getHugePages() const;
+    void setHugePages(bool hugePages);
+};
+
+
+#endif //GASM_JITARENA_H
@@ -0,0 +1,113 @@
+//
+// Cache of compiled programs shared between interpreters
+//
+
+#ifndef GASM_JITCACHE_H
+#define GASM_JITCACHE_H
+
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+#include "JitArena.h"
+
+// function type returned by compile(...)
+using run_fn_t = size_t (*)(double* inputs, size_t inputLength,
+                            double* registers, size_t registerLength,
+                            double (*constants)(),
+                            double (*rng)(),
+                            size_t maxProcessTime);
+
+// batched entry point emitted by compile(...) next to run_fn_t,
+// runs the program on every row of a row-major case matrix,
+// writes the process time of every case to processTimes and returns their sum
+using batch_fn_t = size_t (*)(double* cases, size_t caseCount, size_t caseStride,
+                              size_t inputLength,
+                              double* registers, size_t registerLength,
+                              double (*constants)(),
+                              double (*rng)(),
+                              size_t maxProcessTime,
+                              size_t* processTimes);
+
+// case-parallel entry point, every SIMD lane runs the program on its own case,
+// element j of the case in lane l is at inputs[j * lanes + l], the registers are laid out the same way,
+// writes the process time of every lane to processTimes, returns 0 when all the cases finished
+// and 1 when the group gave up and has to be run again by batch_fn_t
+using lanes_fn_t = size_t (*)(double* inputs, size_t inputLength,
+                              double* registers, size_t registerLength,
+                              size_t maxProcessTime,
+                              size_t* processTimes);
+
+// lengths the code is specialized for, 0 means the length is read at run time
+struct JitShape {
+    size_t inputLength = 0;
+    size_t registerLength = 0;
+
+    bool operator==(const JitShape& other) const = default;
+};
+
+// finished machine code of one program, immutable after compilation
+struct CompiledProgram {
+    static constexpr size_t lanes = 4;  // cases run at once by runLanes, doubles in an AVX2 register
+
+    JitBlock code;  // executable copy in the JitArena
+    JitShape shape;
+    run_fn_t run = nullptr;
+    batch_fn_t runBatch = nullptr;
+    lanes_fn_t runLanes = nullptr;  // only when the CPU has AVX2 and the program can run in lanes
+    size_t size = 0;  // arena memory taken by the code in bytes
+};
+
+struct JitCacheStats {
+    size_t hits = 0;
+    size_t misses = 0;
+    size_t evictions = 0;
+    size_t entries = 0;
+    size_t bytes = 0;
+    size_t maxBytes = 0;
+};
+
+class JitCache {
+private:
+    struct KeyHash {
+        size_t operator()(const std::vector<uint8_t>& key) const noexcept { return (size_t)hash(key.data(), key.size()); }
+    };
+    using Entry = std::pair<std::vector<uint8_t>, std::shared_ptr<const CompiledProgram>>;
+
+    mutable std::mutex mutex_;
+    std::list<Entry> lru_;  // most recently used at the front
+    std::unordered_map<std::vector<uint8_t>, std::list<Entry>::iterator, KeyHash> index_;
+    size_t bytes_ = 0;
+    size_t maxBytes_;
+    size_t hits_ = 0;
+    size_t misses_ = 0;
+    size_t evictions_ = 0;
+
+    void evict();
+public:
+    static constexpr size_t defaultMaxBytes = 64 * 1024 * 1024;
+
+    // constructors
+    explicit JitCache(size_t maxBytes = defaultMaxBytes) : maxBytes_(maxBytes) {}
+    JitCache(const JitCache& other) = delete;
+    JitCache& operator=(const JitCache& other) = delete;
+    ~JitCache() = default;
+
+    // methods
+    static uint64_t hash(const uint8_t* data, size_t length);
+    std::shared_ptr<const CompiledProgram> find(const std::vector<uint8_t>& key);
+    // doesn't count as a hit or a miss and doesn't touch the LRU order
+    bool contains(const std::vector<uint8_t>& key) const;
+    std::shared_ptr<const CompiledProgram> insert(const std::vector<uint8_t>& key, std::shared_ptr<const CompiledProgram> program);
+    void clear();
+
+    // getters and setters
+    [[nodiscard]] JitCacheStats getStats() const;
+    [[nodiscard]] size_t getMaxBytes() const;
+    void setMaxBytes(size_t maxBytes);
+};
+
+
+#endif //GASM_JITCACHE_H
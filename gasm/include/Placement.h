@@ -0,0 +1,35 @@
+//
+// Where threads run and where their memory lives on machines with several NUMA nodes
+//
+
+#ifndef GASM_PLACEMENT_H
+#define GASM_PLACEMENT_H
+
+#include <string>
+#include <vector>
+
+// where a thread or a buffer ended up, -1 when the system doesn't tell
+struct PlacementEntry {
+    std::string name;
+    int cpu = -1;   // threads only
+    int node = -1;
+};
+
+class Placement {
+public:
+    // CPUs of every NUMA node, a single node with every CPU when the system has no NUMA
+    static const std::vector<std::vector<int>>& nodes();
+    static int nodeOfCpu(int cpu);
+    // CPUs the process may run on, node by node
+    static std::vector<int> availableCpus();
+    // CPUs the calling thread may run on
+    static std::vector<int> threadCpus();
+    // restricts the calling thread to the CPUs, false when the system refused
+    static bool pinThread(const std::vector<int>& cpus);
+    static int currentCpu();
+    // node of the page holding the address, -1 when unknown
+    static int nodeOfAddress(const void* address);
+};
+
+
+#endif //GASM_PLACEMENT_H
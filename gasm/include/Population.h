@@ -0,0 +1,96 @@
+//
+// Genomes of the whole population in one slab, fitness and rank in arrays beside it
+//
+
+#ifndef GASM_POPULATION_H
+#define GASM_POPULATION_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <span>
+#include <utility>
+#include <vector>
+
+// Genome i starts at i * stride, the stride is maxSize rounded up to a cache line, so genomes written by
+// different threads never share a line. Resizing keeps the genomes, nothing else allocates.
+//
+// While threads evolve it, every slot is a seqlock: publish makes the sequence of the slot odd, writes
+// and makes it even again, readers retry when the sequence changed under them. Readers never block a
+// writer and a single fitness or rank is always read whole, so selection takes no lock at all.
+// Everything shared goes through relaxed atomics, 8 bytes of the genome at a time.
+//
+// Optionally every slot also keeps the error of its individual on every case, as floats, for selections
+// that look at the cases one by one. They are written with the genome and only read while nobody writes.
+class Population {
+public:
+    static constexpr size_t cacheLine = 64;
+private:
+    struct SlabDeleter {
+        void operator()(uint8_t* slab) const;
+    };
+
+    std::unique_ptr<uint8_t[], SlabDeleter> genomes_;
+    size_t count_ = 0;
+    size_t maxSize_ = 0;
+    size_t stride_ = 0;
+    std::vector<uint32_t> lengths_;
+    std::vector<double> fitness_;
+    std::vector<double> rank_;
+    size_t caseCount_ = 0;
+    std::vector<float> errors_;  // caseCount_ per slot
+    std::unique_ptr<std::atomic<uint64_t>[]> sequences_;  // odd while the slot is written
+
+    [[nodiscard]] uint64_t* words(size_t i) const { return reinterpret_cast<uint64_t*>(genomes_.get() + i * stride_); }
+    uint64_t beginWrite(size_t i);
+public:
+    // constructors
+    Population() = default;
+    Population(const Population& other) = delete;
+    Population& operator=(const Population& other) = delete;
+    Population(Population&& other) noexcept = default;
+    Population& operator=(Population&& other) noexcept = default;
+    ~Population() = default;
+
+    // methods
+    // count genomes of at most maxSize instructions, the ones kept have to fit
+    void resize(size_t count, size_t maxSize);
+    // throws when the genome is longer than maxSize, for slots nobody reads at the same time
+    void assign(size_t i, std::span<const uint8_t> genome);
+    [[nodiscard]] std::vector<std::span<const uint8_t>> genomes() const;
+    // caseCount errors per slot from now on, 0 keeps none, all of them are zero until assigned
+    void setCaseCount(size_t caseCount);
+    // ignored while the population keeps no errors, otherwise there has to be one per case
+    void assignErrors(size_t i, std::span<const double> errors);
+
+    // thread safe, the slot can be read and replaced by other threads meanwhile
+    // replaces the genome and its scores at once, writers of the same slot wait for each other
+    void publish(size_t i, std::span<const uint8_t> genome, double fitness, double rank,
+                 std::span<const double> errors = {});
+    void publishScores(size_t i, double fitness, double rank);
+    // a consistent copy into a buffer that keeps its capacity
+    void copy(size_t i, std::vector<uint8_t>& out) const;
+    [[nodiscard]] double fitnessOf(size_t i) const {
+        return std::atomic_ref<double>(const_cast<double&>(fitness_[i])).load(std::memory_order_relaxed); }
+    [[nodiscard]] double rankOf(size_t i) const {
+        return std::atomic_ref<double>(const_cast<double&>(rank_[i])).load(std::memory_order_relaxed); }
+    // fitness and rank of the same genome
+    [[nodiscard]] std::pair<double, double> scores(size_t i) const;
+
+    // getters, not synchronized
+    [[nodiscard]] std::span<const uint8_t> operator[](size_t i) const { return {genomes_.get() + i * stride_, lengths_[i]}; }
+    [[nodiscard]] size_t size() const { return count_; }
+    [[nodiscard]] bool empty() const { return count_ == 0; }
+    [[nodiscard]] size_t maxSize() const { return maxSize_; }
+    [[nodiscard]] size_t stride() const { return stride_; }
+    [[nodiscard]] std::span<double> fitness() { return fitness_; }
+    [[nodiscard]] std::span<const double> fitness() const { return fitness_; }
+    [[nodiscard]] std::span<double> rank() { return rank_; }
+    [[nodiscard]] std::span<const double> rank() const { return rank_; }
+    [[nodiscard]] size_t caseCount() const { return caseCount_; }
+    [[nodiscard]] std::span<const float> errors(size_t i) const { return {errors_.data() + i * caseCount_, caseCount_}; }
+};
+
+
+#endif //GASM_POPULATION_H
@@ -0,0 +1,68 @@
+//
+// Small, fast random streams that a seed and a few counters fully determine
+//
+
+#ifndef GASM_RANDOM_H
+#define GASM_RANDOM_H
+
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+// xoshiro256**, 32 bytes of state instead of the 5 KB of std::mt19937. A stream is keyed by the seed and
+// two counters, evolution uses the generation and the slot of the individual, so the same seed breeds the
+// same individuals whichever thread happens to run them.
+class Random {
+private:
+    uint64_t state_[4];
+public:
+    using result_type = uint64_t;
+
+    // constructors
+    explicit Random(uint64_t seed = 0);
+    Random(uint64_t seed, uint64_t stream, uint64_t index);
+
+    // UniformRandomBitGenerator, works with the std distributions too
+    static constexpr result_type min() { return 0; }
+    static constexpr result_type max() { return std::numeric_limits<result_type>::max(); }
+    result_type operator()() {
+        const uint64_t result = rotl(state_[1] * 5, 7) * 9;
+        const uint64_t t = state_[1] << 17;
+        state_[2] ^= state_[0];
+        state_[3] ^= state_[1];
+        state_[1] ^= state_[2];
+        state_[0] ^= state_[3];
+        state_[2] ^= t;
+        state_[3] = rotl(state_[3], 45);
+        return result;
+    }
+
+    // methods, the same numbers on every platform unlike the std distributions
+    // uniform in [0, n), n > 0
+    size_t below(size_t n) {
+        // high half of the 128-bit product, biased by at most n / 2^64
+#if defined(_MSC_VER)
+        uint64_t high;
+        _umul128((*this)(), n, &high);
+        return (size_t)high;
+#else
+        return (size_t)(((unsigned __int128)(*this)() * n) >> 64);
+#endif
+    }
+    // uniform in [0, 1)
+    double unit() { return (double)((*this)() >> 11) * 0x1.0p-53; }
+    bool chance(double p) { return unit() < p; }
+
+    // stream of the calling thread, the RNG instruction draws from it by default
+    static Random& local();
+    // a seed nobody chose
+    static uint64_t entropy();
+private:
+    static uint64_t rotl(uint64_t x, int k) { return (x << k) | (x >> (64 - k)); }
+};
+
+
+#endif //GASM_RANDOM_H
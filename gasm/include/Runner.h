@@ -17,6 +17,13 @@ private:
     std::unique_ptr<CrossoverFunction> crossoverFunction_ = std::make_unique<OnePointCrossover>();
     std::unique_ptr<MutationFunction> mutationFunction_ = std::make_unique<HardMutation>();
     std::unique_ptr<GrowFunction> growFunction_ = std::make_unique<FullGrow>();
+    // offspring and parents copied out of the population, they keep their capacity
+    std::vector<uint8_t> child_;
+    std::vector<uint8_t> parent1_;
+    std::vector<uint8_t> parent2_;
+    Random random_;  // stream of the individual being bred
+    std::vector<size_t> caseFailures_;  // by case of the sample, individuals doing worse on it than on average
+    std::vector<double> eliteErrors_;   // errors of an elite copied to the offspring
 public:
     friend class GAsm;
     // constructors
@@ -52,6 +59,11 @@ public:
     // methods
     void dispatchGrow(GAsm* gasm, size_t start, size_t end, bool verbose);
     void dispatchEvolve(GAsm* gasm, size_t start, size_t end, bool verbose);
+    void dispatchGenerational(GAsm* gasm, size_t start, size_t end, bool verbose);
+    void dispatchRescore(GAsm* gasm, size_t start, size_t end);
+private:
+    // errors on every case of the individual just scored, empty when the selection doesn't read them
+    [[nodiscard]] std::span<const double> caseErrors(const GAsm* gasm) const;
 };
 
 #endif //GASM_RUNNER_H
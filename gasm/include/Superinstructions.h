@@ -0,0 +1,70 @@
+//
+// Sequences of instructions the interpreter runs with a single dispatch, chosen by how often they appear in the population
+//
+
+#ifndef GASM_SUPERINSTRUCTIONS_H
+#define GASM_SUPERINSTRUCTIONS_H
+
+#include <cstdint>
+#include <span>
+#include <string>
+#include <vector>
+#include "GAsmIR.h"
+
+// sequences the interpreter has a fused handler for, X2(a, b) and X3(a, b, c) in the order of the catalog
+#define GASM_SUPERINSTRUCTIONS(X2, X3) \
+    /* load, then combine with the other memory */ \
+    X2(MOV_A_R, ADD_I) X2(MOV_A_R, SUB_I) X2(MOV_A_R, MUL_I) X2(MOV_A_R, DIV_I) \
+    X2(MOV_A_R, ADD_R) X2(MOV_A_R, SUB_R) X2(MOV_A_R, MUL_R) X2(MOV_A_R, DIV_R) \
+    X2(MOV_A_I, ADD_R) X2(MOV_A_I, SUB_R) X2(MOV_A_I, MUL_R) X2(MOV_A_I, DIV_R) \
+    X2(MOV_A_I, ADD_I) X2(MOV_A_I, SUB_I) X2(MOV_A_I, MUL_I) X2(MOV_A_I, DIV_I) \
+    /* combine, then store */ \
+    X2(ADD_I, MOV_R_A) X2(SUB_I, MOV_R_A) X2(MUL_I, MOV_R_A) X2(DIV_I, MOV_R_A) \
+    X2(ADD_R, MOV_R_A) X2(SUB_R, MOV_R_A) X2(MUL_R, MOV_R_A) X2(DIV_R, MOV_R_A) \
+    X2(ADD_R, MOV_I_A) X2(SUB_R, MOV_I_A) X2(MUL_R, MOV_I_A) X2(DIV_R, MOV_I_A) \
+    X2(ADD_I, MOV_I_A) X2(SUB_I, MOV_I_A) X2(MUL_I, MOV_I_A) X2(DIV_I, MOV_I_A) \
+    /* move the pointer, then use it */ \
+    X2(INC, MOV_A_I) X2(INC, MOV_A_R) X2(INC, ADD_I) X2(INC, ADD_R) \
+    X2(DEC, MOV_A_I) X2(DEC, MOV_A_R) X2(DEC, ADD_I) X2(DEC, ADD_R) \
+    X2(MOV_R_A, INC) X2(MOV_I_A, INC) X2(MOV_R_A, DEC) X2(MOV_I_A, DEC) \
+    /* read, modify, write */ \
+    X3(MOV_A_R, ADD_I, MOV_R_A) X3(MOV_A_R, SUB_I, MOV_R_A) X3(MOV_A_R, MUL_I, MOV_R_A) X3(MOV_A_R, DIV_I, MOV_R_A) \
+    X3(MOV_A_I, ADD_R, MOV_I_A) X3(MOV_A_I, SUB_R, MOV_I_A) X3(MOV_A_I, MUL_R, MOV_I_A) X3(MOV_A_I, DIV_R, MOV_I_A)
+
+struct Superinstruction {
+    uint8_t opcodes[3] = {};
+    size_t length = 0;
+    uint64_t count = 0;        // mined: times it appears in the programs
+    size_t catalogIndex = SIZE_MAX;  // fused handler of the interpreter, SIZE_MAX if it has none
+};
+
+// what one superinstruction did during a generation
+struct SuperinstructionUse {
+    size_t catalogIndex = 0;
+    uint64_t mined = 0;              // times it appeared in the population when it was chosen
+    uint64_t fired = 0;              // runs of the fused handler
+    uint64_t dispatchesRemoved = 0;  // dispatches of the instructions it stands for minus its own
+};
+
+struct SuperinstructionGeneration {
+    int generation = 0;
+    std::vector<SuperinstructionUse> uses;
+};
+
+class Superinstructions {
+public:
+    static constexpr size_t maxLength = 3;
+
+    // sequences with a fused handler, index of the handler in the catalog
+    static const std::vector<Superinstruction>& catalog();
+    // sequences of 2 and 3 instructions inside the straight-line code of the lowered programs, most frequent first
+    static std::vector<Superinstruction> mine(const std::vector<std::span<const uint8_t>>& programs,
+                                              const IrPasses& passes = IrPasses());
+    // catalog indexes of the mined sequences with a handler that remove the most dispatches, at most count
+    static std::vector<size_t> select(const std::vector<Superinstruction>& mined, size_t count);
+    // instructions of the sequence separated by semicolons
+    static std::string toString(const Superinstruction& superinstruction);
+};
+
+
+#endif //GASM_SUPERINSTRUCTIONS_H
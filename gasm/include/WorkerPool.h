@@ -0,0 +1,76 @@
+//
+// Threads kept alive between generations, they share the work through deques they steal from each other
+//
+
+#ifndef GASM_WORKERPOOL_H
+#define GASM_WORKERPOOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Every job is cut into small batches dealt round-robin to one deque per worker. A worker takes its
+// own batches from the front and, once its deque is empty, steals from the back of the others, so a
+// batch of slow individuals only holds up the batches behind it until somebody steals them.
+// The thread calling run is worker 0, the pool starts the other workers once and keeps them waiting
+// for the next job.
+class WorkerPool {
+public:
+    // called with the worker running the batch and the batch [begin, end)
+    using Job = std::function<void(size_t worker, size_t begin, size_t end)>;
+private:
+    struct Batch {
+        size_t begin;
+        size_t end;
+    };
+    struct Queue {
+        std::mutex mutex;
+        std::deque<Batch> batches;
+    };
+
+    std::vector<std::thread> threads_;
+    std::vector<std::unique_ptr<Queue>> queues_;
+    std::mutex mutex_;
+    std::condition_variable wake_;      // workers wait for a job
+    std::condition_variable finished_;  // run waits for the last batch
+    const Job* job_ = nullptr;
+    size_t round_ = 0;    // jobs handed out so far
+    size_t pending_ = 0;  // batches of the job not finished yet
+    bool stop_ = false;
+    std::exception_ptr error_;  // first exception thrown by the job
+    std::atomic<size_t> steals_ = 0;
+    std::atomic<bool> stealing_ = true;  // false while every worker has to run its own batch
+
+    bool take(size_t worker, Batch& batch);
+    void work(size_t worker);
+    void loop(size_t worker);
+    void runBatches(size_t count, size_t batchSize, const Job& job, bool stealing);
+public:
+    // constructors
+    explicit WorkerPool(size_t workers);
+    WorkerPool(const WorkerPool& other) = delete;
+    WorkerPool& operator=(const WorkerPool& other) = delete;
+    ~WorkerPool();
+
+    // methods
+    // runs the job over [0, count) in batches of batchSize, returns when all of them finished,
+    // rethrows the first exception of the job
+    void run(size_t count, size_t batchSize, const Job& job);
+    // runs job(worker, worker, worker + 1) once on every worker, for what has to happen on each thread
+    void runOnEach(const Job& job);
+
+    // getters
+    [[nodiscard]] size_t size() const { return queues_.size(); }
+    // batches run by another worker than the one they were dealt to
+    [[nodiscard]] size_t getSteals() const { return steals_; }
+};
+
+
+#endif //GASM_WORKERPOOL_H
@@ -11,6 +11,8 @@
 #include <chrono>
 #include <thread>
 #include <random>
+#include <span>
+#include "Random.h"
 
 class GAsmInterpreter;
 
@@ -20,59 +22,88 @@ class FitnessFunction {
 public:
     virtual ~FitnessFunction() = default;
     virtual std::pair<double, double> operator()(const GAsm* self, GAsmInterpreter& jit, const std::vector<uint8_t>& individual) = 0;
+    // may stop once the score is sure to be worse than cutoff, the score it returns then is only as bad as
+    // the cases it ran, by default every case runs
+    virtual std::pair<double, double> bounded(const GAsm* self, GAsmInterpreter& jit, const std::vector<uint8_t>& individual,
+                                              double /*cutoff*/) { return (*this)(self, jit, individual); }
     [[nodiscard]] virtual std::unique_ptr<FitnessFunction> clone() const = 0;
 };
 
-class Fitness : public FitnessFunction {
+// Score is the sum of an error of every case, no error is negative. Minimizing it, bounded runs the cases
+// a batch at a time and stops as soon as the sum passes the cutoff. It runs the cases with the largest
+// recent errors first, they are the ones most offspring fail, so the race is usually lost in the first batch.
+// Programs drawing from the generators get the cases in their order, the draws are the ones of a full run.
+class CaseFitness : public FitnessFunction {
+private:
+    std::vector<size_t> order_;     // cases in the order bounded runs them
+    std::vector<size_t> inOrder_;   // the cases one after another
+    std::vector<double> hardness_;  // recent error of every case
+    std::vector<double> errors_;    // by case, of the last evaluation that ran all of them
+    std::vector<double> raced_;     // by case, of the race being run, they become errors_ when it finishes
+    size_t races_ = 0;
+    void reorder();
 public:
-    Fitness() = default;
+    static constexpr double hardnessDecay = 0.1;  // weight of the newest error
+    static constexpr size_t reorderInterval = 32; // bounded evaluations between sorts of the cases
+    // error of case i, output is what the program left of its inputs
+    virtual double caseError(const GAsm* self, size_t i, std::span<const double> output) = 0;
     std::pair<double, double> operator()(const GAsm* self, GAsmInterpreter& jit, const std::vector<uint8_t>& individual) override;
+    std::pair<double, double> bounded(const GAsm* self, GAsmInterpreter& jit, const std::vector<uint8_t>& individual,
+                                      double cutoff) override;
+    // by case, of the last evaluation that ran all of them, a race stopped early leaves them as they were
+    [[nodiscard]] std::span<const double> caseErrors() const { return errors_; }
+};
+
+class Fitness : public CaseFitness {
+public:
+    Fitness() = default;
+    double caseError(const GAsm* self, size_t i, std::span<const double> output) override;
     [[nodiscard]] std::unique_ptr<FitnessFunction> clone() const override;
 };
 
-class FitnessAnyPositionConstant: public FitnessFunction {
+class FitnessAnyPositionConstant: public CaseFitness {
 public:
     FitnessAnyPositionConstant() = default;
-    std::pair<double, double> operator()(const GAsm* self, GAsmInterpreter& jit, const std::vector<uint8_t>& individual) override;
+    double caseError(const GAsm* self, size_t i, std::span<const double> output) override;
     [[nodiscard]] std::unique_ptr<FitnessFunction> clone() const override;
 };
 
-class FitnessSumSub: public FitnessFunction {
+class FitnessSumSub: public CaseFitness {
 public:
     FitnessSumSub() = default;
-    std::pair<double, double> operator()(const GAsm* self, GAsmInterpreter& jit, const std::vector<uint8_t>& individual) override;
+    double caseError(const GAsm* self, size_t i, std::span<const double> output) override;
     [[nodiscard]] std::unique_ptr<FitnessFunction> clone() const override;
 };
 
-
-class FitnessNegToZeroVec: public FitnessFunction {
+class FitnessNegToZeroVec: public CaseFitness {
 public:
     FitnessNegToZeroVec() = default;
-    std::pair<double, double> operator()(const GAsm* self, GAsmInterpreter& jit, const std::vector<uint8_t>& individual) override;
+    double caseError(const GAsm* self, size_t i, std::span<const double> output) override;
     [[nodiscard]] std::unique_ptr<FitnessFunction> clone() const override;
 };
 
-
-class FitnessBooleanK: public FitnessFunction {
+class FitnessBooleanK: public CaseFitness {
 public:
     FitnessBooleanK() = default;
-    std::pair<double, double> operator()(const GAsm* self, GAsmInterpreter& jit, const std::vector<uint8_t>& individual) override;
+    double caseError(const GAsm* self, size_t i, std::span<const double> output) override;
     [[nodiscard]] std::unique_ptr<FitnessFunction> clone() const override;
 };
 
-
-class FitnessArithSeq: public FitnessFunction {
+class FitnessArithSeq: public CaseFitness {
 public:
     FitnessArithSeq() = default;
-    std::pair<double, double> operator()(const GAsm* self, GAsmInterpreter& jit, const std::vector<uint8_t>& individual) override;
+    double caseError(const GAsm* self, size_t i, std::span<const double> output) override;
     [[nodiscard]] std::unique_ptr<FitnessFunction> clone() const override;
 };
 
+// the operators draw from the stream they are handed, the runner keys it to the individual being bred
 class SelectionFunction {
 public:
     bool selectMinimal = true;
     virtual ~SelectionFunction() = default;
-    virtual size_t operator()(const GAsm* self) = 0;
+    virtual size_t operator()(const GAsm* self, Random& random) = 0;
+    // the population then keeps the error of every individual on every case, see GAsm::caseErrors
+    [[nodiscard]] virtual bool usesCaseErrors() const { return false; }
     [[nodiscard]] virtual std::unique_ptr<SelectionFunction> clone() const = 0;
 };
 
@@ -81,21 +112,21 @@ private:
     size_t _tournamentSize;
 public:
     explicit TournamentSelection(size_t tournamentSize) noexcept : _tournamentSize(tournamentSize) {};
-    size_t operator()(const GAsm* self) override;
+    size_t operator()(const GAsm* self, Random& random) override;
     [[nodiscard]] std::unique_ptr<SelectionFunction> clone() const override;
 };
 
 class RouletteSelection : public SelectionFunction {
 public:
     explicit RouletteSelection() = default;
-    size_t operator()(const GAsm* self) override;
+    size_t operator()(const GAsm* self, Random& random) override;
     [[nodiscard]] std::unique_ptr<SelectionFunction> clone() const override;
 };
 
 class RankSelection : public SelectionFunction {
 public:
     explicit RankSelection() = default;
-    size_t operator()(const GAsm* self) override;
+    size_t operator()(const GAsm* self, Random& random) override;
     [[nodiscard]] std::unique_ptr<SelectionFunction> clone() const override;
 };
 
@@ -104,7 +135,7 @@ private:
     double _percent;  // e.g. 0.1 = top 10%
 public:
     explicit TruncationSelection(double percent) noexcept : _percent(percent) {}
-    size_t operator()(const GAsm* self) override;
+    size_t operator()(const GAsm* self, Random& random) override;
     [[nodiscard]] std::unique_ptr<SelectionFunction> clone() const override;
 };
 
@@ -113,79 +144,103 @@ private:
     double _temperature;
 public:
     explicit BoltzmannSelection(double T) noexcept : _temperature(T) {}
-    size_t operator()(const GAsm* self) override;
+    size_t operator()(const GAsm* self, Random& random) override;
+    [[nodiscard]] std::unique_ptr<SelectionFunction> clone() const override;
+};
+
+// Goes through the cases in a random order, each keeps only the candidates with the lowest error on it
+// (the highest when maximizing), until one candidate or no case is left. Epsilon lexicase also
+// keeps the ones within the median absolute deviation of the case from the best. The first case takes
+// its candidates straight from the sorted errors, the later ones find the best of the few left with a
+// reduction the compiler can vectorize and keep the candidates within the threshold without branching,
+// one after another. Needs a CaseFitness; steady-state evolution selects on the errors of
+// the population at the start of the generation and replaces the worse of two by fitness, lexicase on
+// the highest errors would throw out the specialists it keeps, often the best.
+class LexicaseSelection : public SelectionFunction {
+private:
+    bool _epsilon;
+    std::vector<uint32_t> pool_;    // candidates left
+    std::vector<float> values_;     // their errors on the case
+    std::vector<uint32_t> cases_;   // the order of the cases is drawn as far as it is needed
+    std::vector<uint32_t> swaps_;   // undone after every selection, it only depends on its random stream
+public:
+    explicit LexicaseSelection(bool epsilon = false) noexcept : _epsilon(epsilon) {}
+    size_t operator()(const GAsm* self, Random& random) override;
+    [[nodiscard]] bool usesCaseErrors() const override { return true; }
     [[nodiscard]] std::unique_ptr<SelectionFunction> clone() const override;
 };
 
 
 
+// the parents are read where they are stored, the child is written into a buffer of the runner that
+// keeps its capacity between offspring
 class CrossoverFunction {
 public:
     virtual ~CrossoverFunction() = default;
-    virtual void operator()(const GAsm* self, std::vector<uint8_t>& worstIndividual, const std::vector<uint8_t>& bestIndividual1, const std::vector<uint8_t>& bestIndividual2) = 0;
+    virtual void operator()(const GAsm* self, Random& random, std::vector<uint8_t>& worstIndividual, std::span<const uint8_t> bestIndividual1, std::span<const uint8_t> bestIndividual2) = 0;
     [[nodiscard]] virtual std::unique_ptr<CrossoverFunction> clone() const = 0;
 };
 
 class OnePointCrossover : public CrossoverFunction {
 public:
     OnePointCrossover() = default;
-    void operator()(const GAsm* self, std::vector<uint8_t>& worstIndividual, const std::vector<uint8_t>& bestIndividual1, const std::vector<uint8_t>& bestIndividual2) override;
+    void operator()(const GAsm* self, Random& random, std::vector<uint8_t>& worstIndividual, std::span<const uint8_t> bestIndividual1, std::span<const uint8_t> bestIndividual2) override;
     [[nodiscard]] std::unique_ptr<CrossoverFunction> clone() const override;
 };
 
 class TwoPointCrossover : public CrossoverFunction {
 public:
     TwoPointCrossover() = default;
-    void operator()(const GAsm* self, std::vector<uint8_t>& worstIndividual, const std::vector<uint8_t>& bestIndividual1, const std::vector<uint8_t>& bestIndividual2) override;
+    void operator()(const GAsm* self, Random& random, std::vector<uint8_t>& worstIndividual, std::span<const uint8_t> bestIndividual1, std::span<const uint8_t> bestIndividual2) override;
     [[nodiscard]] std::unique_ptr<CrossoverFunction> clone() const override;
 };
 
 class TwoPointSizeCrossover : public CrossoverFunction {
 public:
     TwoPointSizeCrossover() = default;
-    void operator()(const GAsm* self, std::vector<uint8_t>& worstIndividual, const std::vector<uint8_t>& bestIndividual1, const std::vector<uint8_t>& bestIndividual2) override;
+    void operator()(const GAsm* self, Random& random, std::vector<uint8_t>& worstIndividual, std::span<const uint8_t> bestIndividual1, std::span<const uint8_t> bestIndividual2) override;
     [[nodiscard]] std::unique_ptr<CrossoverFunction> clone() const override;
 };
 
 class UniformPointCrossover : public CrossoverFunction {
 public:
     UniformPointCrossover() = default;
-    void operator()(const GAsm* self, std::vector<uint8_t>& worstIndividual, const std::vector<uint8_t>& bestIndividual1, const std::vector<uint8_t>& bestIndividual2) override;
+    void operator()(const GAsm* self, Random& random, std::vector<uint8_t>& worstIndividual, std::span<const uint8_t> bestIndividual1, std::span<const uint8_t> bestIndividual2) override;
     [[nodiscard]] std::unique_ptr<CrossoverFunction> clone() const override;
 };
 
 class MutationFunction {
 public:
     virtual ~MutationFunction() = default;
-    virtual void operator()(const GAsm* self, std::vector<uint8_t>& worstIndividual, const std::vector<uint8_t>& bestIndividual) = 0;
+    virtual void operator()(const GAsm* self, Random& random, std::vector<uint8_t>& worstIndividual, std::span<const uint8_t> bestIndividual) = 0;
     [[nodiscard]] virtual std::unique_ptr<MutationFunction> clone() const = 0;
 };
 
 class HardMutation : public MutationFunction {
 public:
     HardMutation() = default;
-    void operator()(const GAsm* self, std::vector<uint8_t>& worstIndividual, const std::vector<uint8_t>& bestIndividual) override;
+    void operator()(const GAsm* self, Random& random, std::vector<uint8_t>& worstIndividual, std::span<const uint8_t> bestIndividual) override;
     [[nodiscard]] std::unique_ptr<MutationFunction> clone() const override;
 };
 
 class SoftMutation : public MutationFunction {
 public:
     SoftMutation() = default;
-    void operator()(const GAsm* self, std::vector<uint8_t>& worstIndividual, const std::vector<uint8_t>& bestIndividual) override;
+    void operator()(const GAsm* self, Random& random, std::vector<uint8_t>& worstIndividual, std::span<const uint8_t> bestIndividual) override;
     [[nodiscard]] std::unique_ptr<MutationFunction> clone() const override;
 };
 
 class GrowFunction {
 public:
     virtual ~GrowFunction() = default;
-    virtual void operator()(const GAsm* self, std::vector<uint8_t>& individual) = 0;
+    virtual void operator()(const GAsm* self, Random& random, std::vector<uint8_t>& individual) = 0;
     [[nodiscard]] virtual std::unique_ptr<GrowFunction> clone() const = 0;
 };
 
 class FullGrow : public GrowFunction {
 public:
     FullGrow() = default;
-    void operator()(const GAsm* self, std::vector<uint8_t>& individual) override;
+    void operator()(const GAsm* self, Random& random, std::vector<uint8_t>& individual) override;
     [[nodiscard]] std::unique_ptr<GrowFunction> clone() const override;
 };
 
@@ -194,17 +249,17 @@ private:
     size_t size_;
 public:
     explicit SizeGrow(size_t size) : size_(size) {}
-    void operator()(const GAsm* self, std::vector<uint8_t>& individual) override;
+    void operator()(const GAsm* self, Random& random, std::vector<uint8_t>& individual) override;
     [[nodiscard]] std::unique_ptr<GrowFunction> clone() const override;
 };
 
 class TreeGrow : public GrowFunction {
 private:
     size_t _depth;
-    void grow(std::vector<uint8_t>& individual, size_t maxSize);
+    void grow(Random& random, std::vector<uint8_t>& individual, size_t maxSize);
 public:
     explicit TreeGrow(size_t depth) : _depth(depth) {};
-    void operator()(const GAsm* self, std::vector<uint8_t>& individual) override;
+    void operator()(const GAsm* self, Random& random, std::vector<uint8_t>& individual) override;
     [[nodiscard]] std::unique_ptr<GrowFunction> clone() const override;
 };
 
@@ -151,6 +151,8 @@ static PyObject* PyGAsm_setSelection(PyGAsm* self, PyObject* args) {
     else if (m == "Boltzman") self->cpp->setSelectionFunction(std::make_unique<BoltzmannSelection>(param));
     else if (m == "Rank") self->cpp->setSelectionFunction(std::make_unique<RankSelection>());
     else if (m == "Roulette") self->cpp->setSelectionFunction(std::make_unique<RouletteSelection>());
+    else if (m == "Lexicase") self->cpp->setSelectionFunction(std::make_unique<LexicaseSelection>(false));
+    else if (m == "EpsilonLexicase") self->cpp->setSelectionFunction(std::make_unique<LexicaseSelection>(true));
     else {
         PyErr_SetString(PyExc_ValueError, "Invalid selection literal");
         return nullptr;
@@ -408,6 +410,302 @@ static int PyGAsm_set_useCompile(PyGAsm* self, PyObject* val, void*) {
     return 0;
 }
 
+static PyObject* PyGAsm_get_tiered(PyGAsm* self, void*) {
+    if (self->cpp->getTiered())
+        Py_RETURN_TRUE;
+    Py_RETURN_FALSE;
+}
+
+static int PyGAsm_set_tiered(PyGAsm* self, PyObject* val, void*) {
+    int isTrue = PyObject_IsTrue(val);
+    if (isTrue < 0) return -1;
+    self->cpp->setTiered((bool)isTrue);
+    return 0;
+}
+
+static PyObject* PyGAsm_get_tierStats(PyGAsm* self, void*) {
+    TierStats stats = self->cpp->getTierStats();
+    return Py_BuildValue("{s:n,s:n,s:n,s:n,s:n,s:n,s:n,s:n,s:K,s:K,s:K}",
+                         "interpretedRuns", (Py_ssize_t)stats.interpretedRuns,
+                         "compiledRuns", (Py_ssize_t)stats.compiledRuns,
+                         "interpretedCases", (Py_ssize_t)stats.interpretedCases,
+                         "compiledCases", (Py_ssize_t)stats.compiledCases,
+                         "interpretedTime", (Py_ssize_t)stats.interpretedTime,
+                         "compiledTime", (Py_ssize_t)stats.compiledTime,
+                         "compilations", (Py_ssize_t)stats.compilations,
+                         "compiledInstructions", (Py_ssize_t)stats.compiledInstructions,
+                         "interpretedNs", (unsigned long long)stats.interpretedNs,
+                         "compiledNs", (unsigned long long)stats.compiledNs,
+                         "compileNs", (unsigned long long)stats.compileNs);
+}
+
+static PyObject* PyGAsm_get_fastMath(PyGAsm* self, void*) {
+    if (self->cpp->getMathMode() == MathMode::Fast)
+        Py_RETURN_TRUE;
+    Py_RETURN_FALSE;
+}
+
+static int PyGAsm_set_fastMath(PyGAsm* self, PyObject* val, void*) {
+    int isTrue = PyObject_IsTrue(val);
+    if (isTrue < 0) return -1;
+    self->cpp->setMathMode(isTrue ? MathMode::Fast : MathMode::Exact);
+    return 0;
+}
+
+static PyObject* PyGAsm_get_caseParallel(PyGAsm* self, void*) {
+    if (self->cpp->getCaseParallel())
+        Py_RETURN_TRUE;
+    Py_RETURN_FALSE;
+}
+
+static int PyGAsm_set_caseParallel(PyGAsm* self, PyObject* val, void*) {
+    int isTrue = PyObject_IsTrue(val);
+    if (isTrue < 0) return -1;
+    self->cpp->setCaseParallel((bool)isTrue);
+    return 0;
+}
+
+static PyObject* PyGAsm_get_jitCacheSize(PyGAsm* self, void*) {
+    return PyLong_FromSize_t(self->cpp->getJitCacheSize());
+}
+
+static int PyGAsm_set_jitCacheSize(PyGAsm* self, PyObject* val, void*) {
+    size_t maxBytes = PyLong_AsSize_t(val);
+    if (PyErr_Occurred()) return -1;
+    self->cpp->setJitCacheSize(maxBytes);
+    return 0;
+}
+
+static PyObject* PyGAsm_get_jitCacheStats(PyGAsm* self, void*) {
+    JitCacheStats stats = self->cpp->getJitCacheStats();
+    return Py_BuildValue("{s:n,s:n,s:n,s:n,s:n,s:n}",
+                         "hits", (Py_ssize_t)stats.hits,
+                         "misses", (Py_ssize_t)stats.misses,
+                         "evictions", (Py_ssize_t)stats.evictions,
+                         "entries", (Py_ssize_t)stats.entries,
+                         "bytes", (Py_ssize_t)stats.bytes,
+                         "maxBytes", (Py_ssize_t)stats.maxBytes);
+}
+
+static PyObject* PyGAsm_get_jitArenaStats(PyGAsm* self, void*) {
+    JitArenaStats stats = self->cpp->getJitArenaStats();
+    return Py_BuildValue("{s:n,s:n,s:n,s:n,s:n,s:n}",
+                         "regions", (Py_ssize_t)stats.regions,
+                         "mappedBytes", (Py_ssize_t)stats.mappedBytes,
+                         "usedBytes", (Py_ssize_t)stats.usedBytes,
+                         "blocks", (Py_ssize_t)stats.blocks,
+                         "allocations", (Py_ssize_t)stats.allocations,
+                         "freedRegions", (Py_ssize_t)stats.freedRegions);
+}
+
+static PyObject* PyGAsm_get_jitHugePages(PyGAsm* self, void*) {
+    if (self->cpp->getJitHugePages())
+        Py_RETURN_TRUE;
+    Py_RETURN_FALSE;
+}
+
+static int PyGAsm_set_jitHugePages(PyGAsm* self, PyObject* val, void*) {
+    int isTrue = PyObject_IsTrue(val);
+    if (isTrue < 0) return -1;
+    self->cpp->setJitHugePages((bool)isTrue);
+    return 0;
+}
+
+static PyObject* PyGAsm_get_threads(PyGAsm* self, void*) {
+    return PyLong_FromSize_t(self->cpp->getThreads());
+}
+
+static int PyGAsm_set_threads(PyGAsm* self, PyObject* val, void*) {
+    size_t threads = PyLong_AsSize_t(val);
+    if (PyErr_Occurred()) return -1;
+    self->cpp->setThreads(threads);
+    return 0;
+}
+
+static PyObject* PyGAsm_get_workBatchSize(PyGAsm* self, void*) {
+    return PyLong_FromSize_t(self->cpp->workBatchSize);
+}
+
+static int PyGAsm_set_workBatchSize(PyGAsm* self, PyObject* val, void*) {
+    size_t size = PyLong_AsSize_t(val);
+    if (PyErr_Occurred()) return -1;
+    if (size == 0) {
+        PyErr_SetString(PyExc_ValueError, "workBatchSize must be greater than 0");
+        return -1;
+    }
+    self->cpp->workBatchSize = size;
+    return 0;
+}
+
+static PyObject* PyGAsm_get_generational(PyGAsm* self, void*) {
+    if (self->cpp->generational)
+        Py_RETURN_TRUE;
+    Py_RETURN_FALSE;
+}
+
+static int PyGAsm_set_generational(PyGAsm* self, PyObject* val, void*) {
+    int isTrue = PyObject_IsTrue(val);
+    if (isTrue < 0) return -1;
+    self->cpp->generational = (bool)isTrue;
+    return 0;
+}
+
+static PyObject* PyGAsm_get_elitism(PyGAsm* self, void*) {
+    return PyLong_FromSize_t(self->cpp->elitism);
+}
+
+static int PyGAsm_set_elitism(PyGAsm* self, PyObject* val, void*) {
+    size_t elitism = PyLong_AsSize_t(val);
+    if (PyErr_Occurred()) return -1;
+    self->cpp->elitism = elitism;
+    return 0;
+}
+
+static PyObject* PyGAsm_get_racing(PyGAsm* self, void*) {
+    if (self->cpp->racing)
+        Py_RETURN_TRUE;
+    Py_RETURN_FALSE;
+}
+
+static int PyGAsm_set_racing(PyGAsm* self, PyObject* val, void*) {
+    int isTrue = PyObject_IsTrue(val);
+    if (isTrue < 0) return -1;
+    self->cpp->racing = (bool)isTrue;
+    return 0;
+}
+
+static PyObject* PyGAsm_get_seed(PyGAsm* self, void*) {
+    return PyLong_FromUnsignedLongLong(self->cpp->seed);
+}
+
+static int PyGAsm_set_seed(PyGAsm* self, PyObject* val, void*) {
+    unsigned long long seed = PyLong_AsUnsignedLongLong(val);
+    if (PyErr_Occurred()) return -1;
+    self->cpp->seed = seed;
+    return 0;
+}
+
+static PyObject* PyGAsm_get_sampleSize(PyGAsm* self, void*) {
+    return PyLong_FromSize_t(self->cpp->sampleSize);
+}
+
+static int PyGAsm_set_sampleSize(PyGAsm* self, PyObject* val, void*) {
+    size_t sampleSize = PyLong_AsSize_t(val);
+    if (PyErr_Occurred()) return -1;
+    self->cpp->sampleSize = sampleSize;
+    return 0;
+}
+
+static PyObject* PyGAsm_get_sampling(PyGAsm* self, void*) {
+    switch (self->cpp->sampling) {
+        case Sampling::Dynamic: return PyUnicode_FromString("dynamic");
+        case Sampling::Interleaved: return PyUnicode_FromString("interleaved");
+        default: return PyUnicode_FromString("random");
+    }
+}
+
+static int PyGAsm_set_sampling(PyGAsm* self, PyObject* val, void*) {
+    const char* name = PyUnicode_AsUTF8(val);
+    if (name == nullptr) return -1;
+    std::string sampling(name);
+    if (sampling == "random") self->cpp->sampling = Sampling::Random;
+    else if (sampling == "dynamic") self->cpp->sampling = Sampling::Dynamic;
+    else if (sampling == "interleaved") self->cpp->sampling = Sampling::Interleaved;
+    else {
+        PyErr_SetString(PyExc_ValueError, "sampling should be 'random', 'dynamic' or 'interleaved'");
+        return -1;
+    }
+    return 0;
+}
+
+static PyObject* PyGAsm_get_fullInterval(PyGAsm* self, void*) {
+    return PyLong_FromSize_t(self->cpp->fullInterval);
+}
+
+static int PyGAsm_set_fullInterval(PyGAsm* self, PyObject* val, void*) {
+    size_t fullInterval = PyLong_AsSize_t(val);
+    if (PyErr_Occurred()) return -1;
+    self->cpp->fullInterval = fullInterval;
+    return 0;
+}
+
+static PyObject* PyGAsm_get_pinThreads(PyGAsm* self, void*) {
+    if (self->cpp->pinThreads)
+        Py_RETURN_TRUE;
+    Py_RETURN_FALSE;
+}
+
+static int PyGAsm_set_pinThreads(PyGAsm* self, PyObject* val, void*) {
+    int isTrue = PyObject_IsTrue(val);
+    if (isTrue < 0) return -1;
+    self->cpp->pinThreads = (bool)isTrue;
+    return 0;
+}
+
+static PyObject* PyGAsm_get_replicateData(PyGAsm* self, void*) {
+    if (self->cpp->replicateData)
+        Py_RETURN_TRUE;
+    Py_RETURN_FALSE;
+}
+
+static int PyGAsm_set_replicateData(PyGAsm* self, PyObject* val, void*) {
+    int isTrue = PyObject_IsTrue(val);
+    if (isTrue < 0) return -1;
+    self->cpp->replicateData = (bool)isTrue;
+    return 0;
+}
+
+static PyObject* PyGAsm_get_placement(PyGAsm* self, void*) {
+    const std::vector<PlacementEntry>& placement = self->cpp->getPlacement();
+    PyObject* list = PyList_New((Py_ssize_t)placement.size());
+    if (!list) return nullptr;
+    for (size_t i = 0; i < placement.size(); i++) {
+        PyObject* item = Py_BuildValue("{s:s,s:i,s:i}",
+                                       "name", placement[i].name.c_str(),
+                                       "cpu", placement[i].cpu,
+                                       "node", placement[i].node);
+        if (!item) { Py_DECREF(list); return nullptr; }
+        PyList_SET_ITEM(list, (Py_ssize_t)i, item);
+    }
+    return list;
+}
+
+static PyObject* PyGAsm_get_superinstructionInterval(PyGAsm* self, void*) {
+    return PyLong_FromSize_t(self->cpp->superinstructionInterval);
+}
+
+static int PyGAsm_set_superinstructionInterval(PyGAsm* self, PyObject* val, void*) {
+    size_t interval = PyLong_AsSize_t(val);
+    if (PyErr_Occurred()) return -1;
+    self->cpp->superinstructionInterval = interval;
+    return 0;
+}
+
+static PyObject* PyGAsm_get_superinstructionReport(PyGAsm* self, void*) {
+    const std::vector<SuperinstructionGeneration>& report = self->cpp->getSuperinstructionReport();
+    const std::vector<Superinstruction>& catalog = Superinstructions::catalog();
+    PyObject* list = PyList_New((Py_ssize_t)report.size());
+    if (!list) return nullptr;
+    for (size_t i = 0; i < report.size(); i++) {
+        PyObject* uses = PyList_New((Py_ssize_t)report[i].uses.size());
+        if (!uses) { Py_DECREF(list); return nullptr; }
+        for (size_t j = 0; j < report[i].uses.size(); j++) {
+            const SuperinstructionUse& use = report[i].uses[j];
+            PyObject* item = Py_BuildValue("{s:s,s:K,s:K,s:K}",
+                                           "instructions", Superinstructions::toString(catalog[use.catalogIndex]).c_str(),
+                                           "mined", (unsigned long long)use.mined,
+                                           "fired", (unsigned long long)use.fired,
+                                           "dispatchesRemoved", (unsigned long long)use.dispatchesRemoved);
+            if (!item) { Py_DECREF(uses); Py_DECREF(list); return nullptr; }
+            PyList_SET_ITEM(uses, (Py_ssize_t)j, item);
+        }
+        PyObject* generation = Py_BuildValue("{s:i,s:N}", "generation", report[i].generation, "superinstructions", uses);
+        if (!generation) { Py_DECREF(list); return nullptr; }
+        PyList_SET_ITEM(list, (Py_ssize_t)i, generation);
+    }
+    return list;
+}
+
 static PyObject* PyGAsm_get_checkpointInterval(PyGAsm* self, void*) {
     return PyLong_FromSize_t(self->cpp->checkPointInterval);
 }
@@ -471,7 +769,29 @@ static PyGetSetDef PyGAsm_getset[] = {
         {"outputFolder",    (getter)PyGAsm_get_outputFolder,    (setter)PyGAsm_set_outputFolder,    "output folder", nullptr},
         {"nanPenalty",      (getter)PyGAsm_get_nanPenalty,      (setter)PyGAsm_set_nanPenalty,      "NaN penalty", nullptr},
         {"useCompile",      (getter)PyGAsm_get_useCompile,      (setter)PyGAsm_set_useCompile,      "JIT compile flag", nullptr},
+        {"tiered",          (getter)PyGAsm_get_tiered,          (setter)PyGAsm_set_tiered,          "interpret programs until compiling them pays off", nullptr},
+        {"tierStats",       (getter)PyGAsm_get_tierStats,       nullptr,                            "runs and time of the interpreter and the JIT", nullptr},
+        {"fastMath",        (getter)PyGAsm_get_fastMath,        (setter)PyGAsm_set_fastMath,        "polynomial sin/cos/exp instead of libm", nullptr},
+        {"caseParallel",    (getter)PyGAsm_get_caseParallel,    (setter)PyGAsm_set_caseParallel,    "run groups of cases at once in SIMD lanes, compiled or interpreted", nullptr},
+        {"threads",         (getter)PyGAsm_get_threads,         (setter)PyGAsm_set_threads,         "threads of parallelEvolve, 0 uses every hardware thread", nullptr},
+        {"workBatchSize",   (getter)PyGAsm_get_workBatchSize,   (setter)PyGAsm_set_workBatchSize,   "individuals parallelEvolve hands to a thread at once", nullptr},
+        {"generational",    (getter)PyGAsm_get_generational,    (setter)PyGAsm_set_generational,    "breed whole generations from a frozen population instead of replacing individuals one by one", nullptr},
+        {"elitism",         (getter)PyGAsm_get_elitism,         (setter)PyGAsm_set_elitism,         "best individuals carried over unchanged by generational evolution", nullptr},
+        {"racing",          (getter)PyGAsm_get_racing,          (setter)PyGAsm_set_racing,          "steady-state offspring race the individual they replace and stop being evaluated once they lose", nullptr},
+        {"sampleSize",      (getter)PyGAsm_get_sampleSize,      (setter)PyGAsm_set_sampleSize,      "cases every generation is scored on, 0 scores all of them", nullptr},
+        {"sampling",        (getter)PyGAsm_get_sampling,        (setter)PyGAsm_set_sampling,        "how the cases are sampled: 'random', 'dynamic' or 'interleaved'", nullptr},
+        {"fullInterval",    (getter)PyGAsm_get_fullInterval,    (setter)PyGAsm_set_fullInterval,    "interleaved sampling scores all the cases every that many generations", nullptr},
+        {"seed",            (getter)PyGAsm_get_seed,            (setter)PyGAsm_set_seed,            "seed of the random streams, the same seed breeds the same individuals", nullptr},
+        {"pinThreads",      (getter)PyGAsm_get_pinThreads,      (setter)PyGAsm_set_pinThreads,      "pin the threads of parallelEvolve to CPUs node by node", nullptr},
+        {"replicateData",   (getter)PyGAsm_get_replicateData,   (setter)PyGAsm_set_replicateData,   "copy inputs and targets to every NUMA node running a thread", nullptr},
+        {"placement",       (getter)PyGAsm_get_placement,       nullptr,                            "CPUs and NUMA nodes of the threads and buffers of the last parallelEvolve", nullptr},
+        {"superinstructionInterval", (getter)PyGAsm_get_superinstructionInterval, (setter)PyGAsm_set_superinstructionInterval, "generations between minings of superinstructions, 0 never mines", nullptr},
+        {"superinstructionReport", (getter)PyGAsm_get_superinstructionReport, nullptr, "superinstructions fused in every generation and the dispatches they removed", nullptr},
         {"checkpointInterval", (getter)PyGAsm_get_checkpointInterval, (setter)PyGAsm_set_checkpointInterval, "checkpoint interval", nullptr},
+        {"jitCacheSize",    (getter)PyGAsm_get_jitCacheSize,    (setter)PyGAsm_set_jitCacheSize,    "JIT cache size in bytes", nullptr},
+        {"jitCacheStats",   (getter)PyGAsm_get_jitCacheStats,   nullptr,                            "JIT cache counters", nullptr},
+        {"jitArenaStats",   (getter)PyGAsm_get_jitArenaStats,   nullptr,                            "executable memory of the compiled programs", nullptr},
+        {"jitHugePages",    (getter)PyGAsm_get_jitHugePages,    (setter)PyGAsm_set_jitHugePages,    "back compiled code with huge pages", nullptr},
         {nullptr}
 };
 
@@ -96,6 +96,7 @@ static PyObject* PyIndividual_run(PyIndividual* self, PyObject* arg) {
     std::vector<uint8_t> code = self->cpp->getBytecode();
     GAsmInterpreter jit = GAsmInterpreter(code, self->cpp->getRegisterLength());
     jit.useCompile = self->cpp->getCompile();
+    jit.setMathMode(self->cpp->getMathMode());
     jit.setCng(std::make_unique<gen_fn_t>(self->cpp->getCNG()));
     jit.setRng(std::make_unique<gen_fn_t>(self->cpp->getRNG()));
     size_t result = jit.run(inputs, self->cpp->maxProcessTime);
@@ -112,6 +113,11 @@ static PyObject* PyIndividual_toString(PyIndividual* self,
     return PyUnicode_FromString(self->cpp->toString().c_str());
 }
 
+static PyObject* PyIndividual_effectiveToString(PyIndividual* self,
+                                                PyObject* /*unused*/) {
+    return PyUnicode_FromString(self->cpp->effectiveToString().c_str());
+}
+
 // ---------------------- Getters / Setters -------------------------
 
 static PyObject* PyIndividual_get_maxProcessTime(PyIndividual* self, void*) {
@@ -203,6 +209,7 @@ static PyObject* PyIndividual_setRNG(PyIndividual* self, PyObject* args) {
 static PyMethodDef PyIndividual_methods[] = {
         {"run",        (PyCFunction)PyIndividual_run,        METH_O,       "Run the individual"},
         {"toString",   (PyCFunction)PyIndividual_toString,   METH_NOARGS,  "Return bytecode textual form"},
+        {"effectiveToString", (PyCFunction)PyIndividual_effectiveToString, METH_NOARGS, "Return textual form without introns"},
         {"set_cng",    (PyCFunction)PyIndividual_setCNG,     METH_VARARGS, "Set CNG generator"},
         {"set_rng",    (PyCFunction)PyIndividual_setRNG,     METH_VARARGS, "Set RNG generator"},
         {nullptr}
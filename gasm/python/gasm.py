@@ -57,6 +57,72 @@ class GAsm:
     checkpointInterval : int
         Save a checkpoint every N generations (0 = disabled).
 
+    tiered : bool
+        With useCompile, interpret each program until compiling it is expected to pay off.
+
+    tierStats : dict[str, int] (read-only)
+        Runs, cases, process time and nanoseconds of each tier, and the compilations.
+
+    fastMath : bool
+        Polynomial sin/cos/exp, max error 2.4 ULP, instead of libm.
+
+    caseParallel : bool
+        Batches run groups of cases at once in lanes when the program allows, compiled or interpreted.
+
+    threads : int
+        Threads of parallelEvolve, setting 0 uses every hardware thread.
+
+    workBatchSize : int
+        Individuals parallelEvolve hands to a thread at once, idle threads steal them.
+
+    pinThreads : bool
+        Pin the threads of parallelEvolve to CPUs, node by node.
+
+    replicateData : bool
+        Every NUMA node running a thread gets its own copy of inputs and targets.
+
+    placement : list[dict] (read-only)
+        Name, cpu and node of the threads and buffers of the last parallelEvolve, -1 when unknown.
+
+    generational : bool
+        Breed whole generations from the frozen population instead of replacing individuals one by one.
+
+    elitism : int
+        Best individuals carried over unchanged by generational evolution.
+
+    racing : bool
+        Steady-state offspring race the individual they replace and stop being evaluated once they lose.
+
+    seed : int
+        Seed of the random streams, the same seed breeds the same individuals.
+
+    sampleSize : int
+        Cases every generation is scored on (0 = all of them).
+
+    sampling : str
+        How the cases are sampled: "random", "dynamic" or "interleaved".
+
+    fullInterval : int
+        Interleaved sampling scores all the cases every N generations.
+
+    superinstructionInterval : int
+        Generations between minings of the population for superinstructions (0 = never).
+
+    superinstructionReport : list[dict] (read-only)
+        Generation, then instructions, mined, fired and dispatchesRemoved of each superinstruction.
+
+    jitCacheSize : int
+        Bytes of compiled code kept for reuse across evaluations.
+
+    jitCacheStats : dict[str, int] (read-only)
+        Hits, misses and evictions of the JIT cache, used to size it.
+
+    jitArenaStats : dict[str, int] (read-only)
+        Regions, mapped and used bytes, blocks, allocations and freed regions of the JIT code arena.
+
+    jitHugePages : bool
+        Map new code regions with huge pages when the system has them.
+
     ---------------------------------------------------------------------
     Methods
     ---------------------------------------------------------------------
@@ -116,7 +182,7 @@ class GAsm:
 
         Parameters
         ----------
-        mode : Literal["Tournament", "Truncation", "Boltzman", "Rank", "Roulette"]
+        mode : Literal["Tournament", "Truncation", "Boltzman", "Rank", "Roulette", "Lexicase", "EpsilonLexicase"]
             Selection strategy.
 
         param :
@@ -126,6 +192,9 @@ class GAsm:
              - Boltzman: temperature parameter
              - Rank: unused or tuning parameter
              - Roulette: no parameter required
+             - Lexicase: no parameter required, filters by the cases in random order
+             - EpsilonLexicase: no parameter required, a case keeps everyone within
+               the median absolute deviation of its best error
         """
 
     # ------------------------------------------------------------------
@@ -16,10 +16,14 @@ class Individual:
 
     toString() -> str
         Return textual form of bytecode.
+
+    effectiveToString() -> str
+        Return textual form of bytecode without introns.
     """
 
     def run(self, inputs: list[int]) -> list[int]: ...
     def toString(self) -> str: ...
+    def effectiveToString(self) -> str: ...
 
 
 class Entry:
@@ -82,7 +86,29 @@ class GAsm:
     outputFolder: str
     nanPenalty: float
     useCompile: bool
+    tiered: bool              # with useCompile, interpret each program until compiling it is expected to pay off
+    tierStats: dict[str, int]  # read-only: runs, cases, process time and nanoseconds of each tier, compilations
+    fastMath: bool            # polynomial sin/cos/exp, max error 2.4 ULP, instead of libm
+    caseParallel: bool        # batches run groups of cases at once in lanes when the program allows, compiled or interpreted
+    threads: int              # threads of parallelEvolve, setting 0 uses every hardware thread
+    workBatchSize: int        # individuals parallelEvolve hands to a thread at once, idle threads steal them
+    generational: bool        # breed whole generations from the frozen population instead of replacing individuals one by one
+    elitism: int              # best individuals carried over unchanged by generational evolution
+    racing: bool              # steady-state offspring race the individual they replace and stop being evaluated once they lose
+    sampleSize: int           # cases every generation is scored on, 0 scores all of them
+    sampling: str             # how the cases are sampled: "random", "dynamic" or "interleaved"
+    fullInterval: int         # interleaved sampling scores all the cases every that many generations
+    seed: int                 # seed of the random streams, the same seed breeds the same individuals
+    pinThreads: bool          # pin the threads of parallelEvolve to CPUs, node by node
+    replicateData: bool       # every NUMA node running a thread gets its own copy of inputs and targets
+    placement: list[dict]     # read-only: name, cpu and node of the threads and buffers of the last parallelEvolve, -1 when unknown
+    superinstructionInterval: int  # generations between minings of the population for superinstructions, 0 never mines
+    superinstructionReport: list[dict]  # read-only: generation, then instructions, mined, fired, dispatchesRemoved of each superinstruction
     checkpointInterval: int
+    jitCacheSize: int         # bytes of compiled code kept for reuse
+    jitCacheStats: dict[str, int]  # read-only: hits, misses, evictions, entries, bytes, maxBytes
+    jitArenaStats: dict[str, int]  # read-only: regions, mappedBytes, usedBytes, blocks, allocations, freedRegions
+    jitHugePages: bool        # map new code regions with huge pages when the system has them
 
     # ------------------------------------------------------------------
     # Core Execution
@@ -112,7 +138,8 @@ class GAsm:
     # ------------------------------------------------------------------
     def setSelection(
             self,
-            mode: Literal["Tournament", "Truncation", "Boltzman", "Rank", "Roulette"],
+            mode: Literal["Tournament", "Truncation", "Boltzman", "Rank", "Roulette",
+                          "Lexicase", "EpsilonLexicase"],
             param: Optional[float | int] = None
     ) -> None:
         """
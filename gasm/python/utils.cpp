@@ -3,6 +3,7 @@
 //
 
 #include "utils.h"
+#include "Random.h"
 
 std::unique_ptr<gen_fn_t> makeCNG(const std::string& spec, double start) {
     if (spec == "increment") {
@@ -22,9 +23,7 @@ std::unique_ptr<gen_fn_t> makeCNG(const std::string& spec, double start) {
 std::unique_ptr<gen_fn_t> makeRNG(const std::string& spec, double start) {
     if (spec == "random") {
         return std::make_unique<gen_fn_t>([](){
-            static thread_local std::mt19937 engine(std::random_device{}());
-            static std::uniform_real_distribution<double> dist(0, 1);
-            return dist(engine);});
+            return Random::local().unit();});
     }
 
     if (spec == "constant") {
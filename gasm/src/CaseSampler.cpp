@@ -0,0 +1,63 @@
+//
+// Subsets of the fitness cases evolution runs on instead of all of them
+//
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <numeric>
+#include <stdexcept>
+#include <string>
+#include "CaseSampler.h"
+
+void CaseSampler::reset(size_t caseCount) {
+    cases_.clear();
+    difficulty_.assign(caseCount, 1.0);
+    age_.assign(caseCount, 0);
+    candidates_.resize(caseCount);
+    std::iota(candidates_.begin(), candidates_.end(), 0);
+}
+
+void CaseSampler::choose(Sampling sampling, size_t caseCount, size_t sampleSize, Random& random) {
+    if (sampleSize == 0 || sampleSize > caseCount) {
+        throw std::invalid_argument("Sample size should be between 1 and the number of cases " + std::to_string(caseCount));
+    }
+    if (candidates_.size() != caseCount) {
+        throw std::invalid_argument("Case sampler was reset for " + std::to_string(candidates_.size()) + " cases, not "
+                                    + std::to_string(caseCount));
+    }
+    if (sampling == Sampling::Dynamic) {
+        // Efraimidis-Spirakis, the sampleSize largest log(u) / weight are a weighted draw without replacement
+        keys_.resize(caseCount);
+        const double usualAge = (double)caseCount / (double)sampleSize;
+        for (size_t i = 0; i < caseCount; i++) {
+            const double weight = std::pow(difficulty_[i], difficultyExponent)
+                                  + std::pow((double)age_[i] / usualAge, ageExponent);
+            const double u = 1.0 - random.unit();  // (0, 1]
+            keys_[i] = weight > 0 ? std::log(u) / weight : -std::numeric_limits<double>::infinity();
+        }
+        std::iota(candidates_.begin(), candidates_.end(), 0);
+        std::nth_element(candidates_.begin(), candidates_.begin() + (std::ptrdiff_t)sampleSize - 1, candidates_.end(),
+                         [this](size_t a, size_t b) { return keys_[a] > keys_[b] || (keys_[a] == keys_[b] && a < b); });
+    } else {
+        // partial Fisher-Yates, shuffling any permutation further keeps every subset equally likely
+        for (size_t k = 0; k < sampleSize; k++) {
+            std::swap(candidates_[k], candidates_[k + random.below(caseCount - k)]);
+        }
+    }
+    cases_.assign(candidates_.begin(), candidates_.begin() + (std::ptrdiff_t)sampleSize);
+    std::sort(cases_.begin(), cases_.end());  // rows are copied in memory order
+
+    for (uint32_t& age : age_) {
+        age++;
+    }
+    for (size_t i : cases_) {
+        age_[i] = 0;
+    }
+}
+
+void CaseSampler::recordFailures(std::span<const size_t> failures, size_t population) {
+    for (size_t k = 0; k < failures.size() && k < cases_.size(); k++) {
+        difficulty_[cases_[k]] = population > 0 ? (double)failures[k] / (double)population : 1.0;
+    }
+}
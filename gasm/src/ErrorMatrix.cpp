@@ -0,0 +1,47 @@
+//
+// Errors of the whole population case by case, sorted once a generation for lexicase selection
+//
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <numeric>
+#include "ErrorMatrix.h"
+
+void ErrorMatrix::prepare(const Population& population) {
+    individuals_ = population.size();
+    cases_ = population.caseCount();
+    errors_.resize(individuals_ * cases_);
+    order_.resize(individuals_ * cases_);
+    deviation_.resize(cases_);
+
+    // transposed a block of individuals at a time, their rows stay in cache while the columns are written
+    constexpr size_t block = 64;
+    for (size_t first = 0; first < individuals_; first += block) {
+        const size_t last = std::min(first + block, individuals_);
+        for (size_t c = 0; c < cases_; c++) {
+            float* column = errors_.data() + c * individuals_;
+            for (size_t i = first; i < last; i++) {
+                const float error = population.errors(i)[c];
+                column[i] = std::isnan(error) ? std::numeric_limits<float>::infinity() : error;
+            }
+        }
+    }
+
+    scratch_.resize(individuals_);
+    for (size_t c = 0; c < cases_ && individuals_ > 0; c++) {
+        const float* column = errors_.data() + c * individuals_;
+        uint32_t* order = order_.data() + c * individuals_;
+        std::iota(order, order + individuals_, 0);
+        std::sort(order, order + individuals_, [column](uint32_t a, uint32_t b) {
+            return column[a] < column[b] || (column[a] == column[b] && a < b);
+        });
+        const float median = column[order[individuals_ / 2]];
+        for (size_t i = 0; i < individuals_; i++) {
+            scratch_[i] = column[i] == median ? 0.0f : std::fabs(column[i] - median);  // no inf - inf
+        }
+        std::nth_element(scratch_.begin(), scratch_.begin() + (std::ptrdiff_t)(individuals_ / 2), scratch_.end());
+        // finite, so best - deviation is never inf - inf
+        deviation_[c] = std::min(scratch_[individuals_ / 2], std::numeric_limits<float>::max());
+    }
+}
@@ -10,29 +10,20 @@
 #include <random>
 #include <iostream>
 #include <thread>
+#include <atomic>
 #include <cfloat>
+#include <numeric>
+#include <tuple>
 #include <boost/multiprecision/cpp_bin_float.hpp>
 
-GAsm::GAsm() : runner_(1), population_(0), fitness_(1), rank_(1) {
-    // unsigned int numThreads = std::thread::hardware_concurrency();
-    unsigned int numThreads = 2;
-    if (numThreads == 0) numThreads = 4; // fallback
-    runners_.reserve(numThreads);
-
-    for (unsigned int i = 0; i < numThreads; i++) {
-        runners_.emplace_back(std::move(Runner()));
-    }
+GAsm::GAsm() : runner_(1) {
+    runner_.setJitCache(jitCache_);
+    setThreads(0);
 }
 
 GAsm::GAsm(const std::string &filename) : runner_(1) {
-    // unsigned int numThreads = std::thread::hardware_concurrency();
-    unsigned int numThreads = 2;
-    if (numThreads == 0) numThreads = 4; // fallback
-    runners_.reserve(numThreads);
-
-    for (unsigned int i = 0; i < numThreads; i++) {
-        runners_.emplace_back(std::move(Runner()));
-    }
+    runner_.setJitCache(jitCache_);
+    setThreads(0);
     using nlohmann::json;
     // Read file
     std::ifstream file(filename, std::ios::binary);
@@ -63,9 +54,6 @@ GAsm::GAsm(const std::string &filename) : runner_(1) {
     inputs  = j["inputs"].get<std::vector<std::vector<double>>>();
     targets = j["targets"].get<std::vector<std::vector<double>>>();
 
-    // Load fitness & rank
-    fitness_ = j["fitness"].get<std::vector<double>>();
-    rank_    = j["rank"].get<std::vector<double>>();
 
     // Load best individual
     std::string ascii = j["bestIndividual"].get<std::string>();
@@ -76,7 +64,8 @@ GAsm::GAsm(const std::string &filename) : runner_(1) {
     bestIndividual = std::move(individual);
 
     // Deserialize population
-    population_.clear();
+    std::vector<std::vector<uint8_t>> individuals;
+    size_t longest = individualMaxSize;
     for (auto &ascii_value : j["population"])
     {
         ascii = ascii_value.get<std::string>();
@@ -87,10 +76,20 @@ GAsm::GAsm(const std::string &filename) : runner_(1) {
         individual = std::vector<uint8_t>(bytecode, bytecode + len);
         delete[] bytecode;
 
-        population_.push_back(std::move(individual));
-        population_.back().reserve(individualMaxSize);
+        longest = std::max(longest, individual.size());
+        individuals.push_back(std::move(individual));
+    }
+    population_.resize(individuals.size(), longest);
+    for (size_t i = 0; i < individuals.size(); i++) {
+        population_.assign(i, individuals[i]);
     }
 
+    // Load fitness & rank
+    std::vector<double> fitness = j["fitness"].get<std::vector<double>>();
+    std::vector<double> rank = j["rank"].get<std::vector<double>>();
+    std::copy_n(fitness.begin(), std::min(fitness.size(), population_.size()), population_.fitness().begin());
+    std::copy_n(rank.begin(), std::min(rank.size(), population_.size()), population_.rank().begin());
+
     // Load history
     if (j.contains("history"))
         hist = Hist(j["history"]);
@@ -98,7 +97,263 @@ GAsm::GAsm(const std::string &filename) : runner_(1) {
         hist = Hist();   // empty history
 }
 
-GAsm::~GAsm() = default;
+thread_local const GAsm* GAsm::localOwner_ = nullptr;
+thread_local const GAsm::CaseData* GAsm::localData_ = nullptr;
+
+GAsm::~GAsm() {
+    // another GAsm at the same address must not find the copies on this thread
+    if (localOwner_ == this) {
+        localOwner_ = nullptr;
+        localData_ = nullptr;
+    }
+}
+
+void GAsm::setThreads(size_t threads) {
+    if (threads == 0) {
+        threads = std::thread::hardware_concurrency();
+        if (threads == 0) threads = 4; // fallback
+    }
+    pool_.reset();  // the next parallel run starts a pool of the new size
+    runners_.resize(std::min(runners_.size(), threads));
+    runners_.reserve(threads);
+    while (runners_.size() < threads) {
+        runners_.emplace_back();
+        configureRunner(runners_.back());
+    }
+}
+
+// a new runner gets the operators and the interpreter settings the others have
+void GAsm::configureRunner(Runner& runner) {
+    runner.setFitnessFunction(fitnessFunction_->clone());
+    runner.setSelectionFunction(selectionFunction_->clone());
+    runner.setCrossoverFunction(crossoverFunction_->clone());
+    runner.setMutationFunction(mutationFunction_->clone());
+    runner.setGrowFunction(growFunction_->clone());
+    GAsmInterpreter& jit = runner.jit_;
+    jit.setJitCache(jitCache_);
+    jit.setRegisterLength(runner_.getRegisterLength());
+    jit.setCng(std::make_unique<gen_fn_t>(runner_.getCng()));
+    jit.setRng(std::make_unique<gen_fn_t>(runner_.getRng()));
+    jit.setPasses(runner_.getPasses());
+    jit.setMathMode(runner_.getMathMode());
+    jit.setCaseParallel(runner_.getCaseParallel());
+    jit.setSuperinstructions(runner_.getSuperinstructions());
+    jit.useCompile = runner_.useCompile;
+    jit.tiered = runner_.tiered;
+}
+
+WorkerPool& GAsm::pool() {
+    if (pool_ == nullptr) {
+        pool_ = std::make_unique<WorkerPool>(runners_.size());
+    }
+    return *pool_;
+}
+
+// Runs once on every thread before parallelEvolve: pins it, gives its runner memory first touched by the
+// thread itself, so the system puts it on the thread's node, and points it to the copy of the cases on
+// its node. Notes where everything ended up.
+void GAsm::place() {
+    const std::vector<int> cpus = Placement::availableCpus();
+    replicas_.clear();
+    replicas_.resize(Placement::nodes().size());
+    std::vector<PlacementEntry> threads(runners_.size());
+    std::vector<PlacementEntry> scratch(runners_.size());
+    std::mutex mutex;
+    pool().runOnEach([&](size_t worker, size_t, size_t) {
+        if (pinThreads) {
+            Placement::pinThread(worker < threadCpus.size() && !threadCpus[worker].empty()
+                                 ? threadCpus[worker] : std::vector<int>{cpus[worker % cpus.size()]});
+            Runner fresh;
+            configureRunner(fresh);
+            runners_[worker] = std::move(fresh);
+        }
+        const int cpu = Placement::currentCpu();
+        const int node = Placement::nodeOfCpu(cpu);
+        localOwner_ = this;
+        localData_ = nullptr;
+        if (replicateData && node >= 0) {
+            std::lock_guard<std::mutex> guard(mutex);
+            if (replicas_[node] == nullptr) {
+                // copied by a thread of the node
+                replicas_[node] = std::make_unique<CaseData>(CaseData{inputs, targets});
+            }
+            localData_ = replicas_[node].get();
+        }
+        const std::string runner = "runner " + std::to_string(worker);
+        threads[worker] = {runner, cpu, node};
+        scratch[worker] = {runner + " registers", -1, Placement::nodeOfAddress(runners_[worker].jit_.getRegisters().data())};
+    });
+
+    placement_.clear();
+    for (size_t w = 0; w < runners_.size(); w++) {
+        placement_.push_back(threads[w]);
+        placement_.push_back(scratch[w]);
+    }
+    for (size_t node = 0; node < replicas_.size(); node++) {
+        if (replicas_[node] != nullptr && !replicas_[node]->inputs.empty()) {
+            placement_.push_back({"inputs copy of node " + std::to_string(node), -1,
+                                  Placement::nodeOfAddress(replicas_[node]->inputs[0].data())});
+        }
+    }
+    if (!inputs.empty()) {
+        placement_.push_back({"inputs", -1, Placement::nodeOfAddress(inputs[0].data())});
+    }
+    if (!population_.empty()) {
+        placement_.push_back({"population", -1, Placement::nodeOfAddress(population_[0].data())});
+    }
+}
+
+void GAsm::printPlacement() const {
+    std::cout << "NUMA nodes: " << Placement::nodes().size() << std::endl;
+    for (const PlacementEntry& entry : placement_) {
+        std::cout << entry.name << ":";
+        if (entry.cpu >= 0) std::cout << " cpu " << entry.cpu << ",";
+        std::cout << " node " << entry.node << std::endl;
+    }
+    std::cout << "----------------------------------" << std::endl;
+}
+
+// indices of the count best individuals, the best first
+void GAsm::bestFirst(std::vector<size_t>& indices, size_t count) const {
+    std::span<const double> fitness = population_.fitness();
+    indices.resize(population_.size());
+    std::iota(indices.begin(), indices.end(), 0);
+    count = std::min(count, indices.size());
+    std::partial_sort(indices.begin(), indices.begin() + (std::ptrdiff_t)count, indices.end(), [&](size_t a, size_t b) {
+        if (std::isnan(fitness[a]) || std::isnan(fitness[b])) {
+            return !std::isnan(fitness[a]) && std::isnan(fitness[b]);  // NaN is the worst
+        }
+        return minimize ? fitness[a] < fitness[b] : fitness[a] > fitness[b];
+    });
+    indices.resize(count);
+}
+
+// the best elitism individuals, they go to the next generation unchanged
+void GAsm::chooseElites() {
+    offspring_.resize(population_.size(), population_.maxSize());
+    bestFirst(elites_, elitism);
+}
+
+void GAsm::startSampling() {
+    sampled_ = false;
+    if (sampleSize > 0) {
+        sampler_.reset(inputs.size());
+    }
+}
+
+// Picks the cases of the generation and copies their rows, returns whether they aren't the ones the
+// population was scored on. The sampler keeps its difficulties for as long as the run.
+bool GAsm::drawSample(int generation) {
+    const bool all = sampleSize == 0 || sampleSize >= inputs.size()
+                     || (sampling == Sampling::Interleaved && fullInterval > 0 && generation % fullInterval == 0);
+    if (all) {
+        const bool changed = sampled_;
+        sampled_ = false;
+        return changed;
+    }
+    Random random = stream(2 * population_.size());
+    sampler_.choose(sampling, inputs.size(), sampleSize, random);
+    const std::vector<size_t>& cases = sampler_.cases();
+    sample_.inputs.resize(cases.size());
+    sample_.targets.resize(cases.size());
+    for (size_t k = 0; k < cases.size(); k++) {
+        sample_.inputs[k] = inputs[cases[k]];
+        sample_.targets[k] = targets[cases[k]];
+    }
+    sampled_ = true;
+    return true;
+}
+
+// scores the population on the cases of the generation, the counts of dynamic sampling come from it
+void GAsm::rescore(bool parallel) {
+    for (Runner& runner : runners_) {
+        runner.caseFailures_.assign(sampled_ ? sample_.inputs.size() : 0, 0);
+    }
+    if (parallel) {
+        dispatch([this](Runner& runner, size_t begin, size_t end) {
+            runner.dispatchRescore(this, begin, end);
+        });
+    } else {
+        runners_[0].dispatchRescore(this, 0, population_.size());
+    }
+    if (sampled_ && sampling == Sampling::Dynamic) {
+        std::vector<size_t> failures(sample_.inputs.size(), 0);
+        for (const Runner& runner : runners_) {
+            for (size_t k = 0; k < failures.size(); k++) {
+                failures[k] += runner.caseFailures_[k];
+            }
+        }
+        sampler_.recordFailures(failures, population_.size());
+    }
+}
+
+// lexicase and the like read the error of every individual on every case, only a CaseFitness gives them
+void GAsm::startCaseErrors() {
+    collectErrors_ = selectionFunction_->usesCaseErrors();
+    if (collectErrors_ && dynamic_cast<const CaseFitness*>(fitnessFunction_.get()) == nullptr) {
+        throw std::invalid_argument("The selection function needs the errors on every case, the fitness function "
+                                    "should be a CaseFitness");
+    }
+}
+
+// sizes the errors the populations keep to the cases of the generation, true when they have to be scored again
+bool GAsm::keepCaseErrors() {
+    const size_t caseCount = collectErrors_ ? caseInputs().size() : 0;
+    if (population_.caseCount() == caseCount) {
+        return false;
+    }
+    population_.setCaseCount(caseCount);
+    offspring_.setCaseCount(caseCount);
+    return caseCount > 0;
+}
+
+std::span<const double> GAsm::lastCaseErrors() const {
+    if (!collectErrors_) {
+        return {};
+    }
+    return static_cast<const CaseFitness&>(*fitnessFunction_).caseErrors();
+}
+
+// the best elitism individuals by the sample scored on all the cases, the best of them and its index
+std::pair<double, size_t> GAsm::bestOnAllCases() {
+    std::vector<size_t> best;
+    bestFirst(best, std::max<size_t>(elitism, 1));
+    sampled_ = false;
+    double bestFitness = 0.0;
+    size_t bestIndex = 0;
+    for (size_t k = 0; k < best.size(); k++) {
+        population_.copy(best[k], child_);
+        Random::local() = Random(stream(2 * population_.size() + 1 + k)());
+        const double fitness = (*fitnessFunction_)(this, runner_, child_).first;
+        if (k == 0 || std::isnan(bestFitness) || worse(bestFitness, fitness)) {
+            bestFitness = fitness;
+            bestIndex = best[k];
+        }
+    }
+    sampled_ = true;
+    return {bestFitness, bestIndex};
+}
+
+void GAsm::swapGenerations() {
+    std::swap(population_, offspring_);
+}
+
+// Every runner works on its own thread, the population is handed out in batches of workBatchSize
+// that idle threads steal from the busy ones. The calling thread is runner 0 and draws the progress bar.
+void GAsm::dispatch(const std::function<void(Runner& runner, size_t begin, size_t end)>& work) {
+    using namespace std::chrono;
+    std::atomic<size_t> done = 0;
+    auto start = high_resolution_clock::now();
+    pool().run(populationSize, workBatchSize, [&](size_t worker, size_t begin, size_t end) {
+        work(runners_[worker], begin, end);
+        size_t finished = done += end - begin;
+        if (worker == 0) {
+            printProgressBar((int)(finished * 100 / populationSize),
+                             duration<double>(high_resolution_clock::now() - start).count());
+        }
+    });
+    printProgressBar(100, duration<double>(high_resolution_clock::now() - start).count());
+}
 
 nlohmann::json GAsm::toJson() {
     using nlohmann::json;
@@ -128,8 +383,9 @@ nlohmann::json GAsm::toJson() {
 
     // Save population (as ASCII)
     j["population"] = json::array();
-    for (const auto &individual : population_)
+    for (size_t i = 0; i < population_.size(); i++)
     {
+        std::span<const uint8_t> individual = population_[i];
         ascii = GAsmParser::bytecode2Ascii(
                 individual.data(),
                 individual.size()
@@ -139,8 +395,8 @@ nlohmann::json GAsm::toJson() {
     }
 
     // Save fitness & rank
-    j["fitness"] = fitness_;
-    j["rank"]    = rank_;
+    j["fitness"] = std::vector<double>(population_.fitness().begin(), population_.fitness().end());
+    j["rank"]    = std::vector<double>(population_.rank().begin(), population_.rank().end());
 
     // Save history
     j["history"] = hist.toJson();
@@ -179,33 +435,129 @@ void GAsm::printHeader(const GAsm* const self) {
     std::cout << "Goal fitness: " << self->goalFitness << std::endl;
     std::cout << "NaN penalty: " << self->nanPenalty << std::endl;
     std::cout << "Number of cores: " << self->runners_.size() << std::endl;
+    std::cout << "Generational: " << (self->generational ? "True" : "False");
+    if (self->generational) std::cout << ", elitism: " << self->elitism;
+    if (!self->generational) std::cout << ", racing: " << (self->racing ? "True" : "False");
+    std::cout << std::endl;
+    std::cout << "Seed: " << self->seed << std::endl;
+    if (self->sampleSize > 0) {
+        static const char* const samplings[] = {"random", "dynamic", "interleaved"};
+        std::cout << "Sample size: " << self->sampleSize << ", " << samplings[(size_t)self->sampling];
+        if (self->sampling == Sampling::Interleaved) std::cout << ", all cases every " << self->fullInterval;
+        std::cout << std::endl;
+    }
     std::cout << "----------------------------------" << std::endl;
 }
 
+void GAsm::printJitCacheStats() const {
+    if (!getCompile()) return;
+    JitCacheStats stats = jitCache_->getStats();
+    std::cout << "JIT cache: " << stats.hits << " hits, "
+              << stats.misses << " misses, "
+              << stats.evictions << " evictions, "
+              << stats.entries << " programs, "
+              << stats.bytes / 1024 << "/" << stats.maxBytes / 1024 << " KiB" << std::endl;
+    JitArenaStats arena = JitArena::global().getStats();
+    std::cout << "JIT arena: " << arena.usedBytes / 1024 << " KiB used of "
+              << arena.mappedBytes / 1024 << " KiB mapped in "
+              << arena.regions << " regions, "
+              << arena.freedRegions << " regions freed" << std::endl;
+    TierStats tiers = getTierStats();
+    std::cout << "Tiers: " << tiers.interpretedRuns << " interpreted runs in "
+              << (double)tiers.interpretedNs / 1e9 << "s, "
+              << tiers.compiledRuns << " compiled runs in "
+              << (double)tiers.compiledNs / 1e9 << "s, "
+              << tiers.compilations << " compilations in "
+              << (double)tiers.compileNs / 1e9 << "s" << std::endl;
+}
+
+void GAsm::chooseSuperinstructions(int generation) {
+    if (superinstructionInterval == 0 || (size_t)generation % superinstructionInterval != 0) {
+        return;
+    }
+    std::vector<Superinstruction> mined = Superinstructions::mine(population_.genomes(), getPasses());
+    std::vector<size_t> chosen = Superinstructions::select(mined, superinstructionCount);
+    runner_.setSuperinstructions(chosen);
+    std::for_each(runners_.begin(), runners_.end(), [&chosen](Runner& r){ r.jit_.setSuperinstructions(chosen); });
+
+    SuperinstructionGeneration next;
+    next.generation = generation + 1;  // numbered like the generation stats
+    for (size_t s : chosen) {
+        SuperinstructionUse use;
+        use.catalogIndex = s;
+        use.mined = std::find_if(mined.begin(), mined.end(),
+                                 [s](const Superinstruction& m){ return m.catalogIndex == s; })->count;
+        next.uses.push_back(use);
+    }
+    superinstructionReport_.push_back(std::move(next));
+}
+
+void GAsm::reportSuperinstructions(int generation) {
+    if (superinstructionReport_.empty()) {
+        return;
+    }
+    // not mined this generation, the ones of the previous generation were fused
+    if (superinstructionReport_.back().generation != generation) {
+        SuperinstructionGeneration next = superinstructionReport_.back();
+        next.generation = generation;
+        superinstructionReport_.push_back(std::move(next));
+    }
+    SuperinstructionGeneration& report = superinstructionReport_.back();
+    const std::vector<Superinstruction>& catalog = Superinstructions::catalog();
+    uint64_t fired = 0;
+    uint64_t removed = 0;
+    for (SuperinstructionUse& use : report.uses) {
+        uint64_t hits = runner_.getSuperinstructionHits()[use.catalogIndex];
+        std::for_each(runners_.begin(), runners_.end(),
+                      [&hits, &use](const Runner& r){ hits += r.jit_.getSuperinstructionHits()[use.catalogIndex]; });
+        use.fired = hits;
+        // one dispatch instead of one per instruction
+        use.dispatchesRemoved = hits * (catalog[use.catalogIndex].length - 1);
+        fired += use.fired;
+        removed += use.dispatchesRemoved;
+    }
+    runner_.resetSuperinstructionHits();
+    std::for_each(runners_.begin(), runners_.end(), [](Runner& r){ r.jit_.resetSuperinstructionHits(); });
+
+    std::cout << "Superinstructions: " << fired << " fired, " << removed << " dispatches removed";
+    for (const SuperinstructionUse& use : report.uses) {
+        if (use.fired > 0) {
+            std::cout << ", " << Superinstructions::toString(catalog[use.catalogIndex]) << ": " << use.fired;
+        }
+    }
+    std::cout << std::endl;
+}
+
 double GAsm::printGenerationStats(int generation, bool save) {
     boost::multiprecision::cpp_bin_float_quad avgFitness = 0.0;
     double bestFitness = minimize ? DBL_MAX: -DBL_MAX; // NOLINT
     double avgSize = 0.0;
     size_t bestIndividualIndex = 0;
+    std::span<const double> fitness = population_.fitness();
     for (int i = 0; i < population_.size(); i++) {
-        avgFitness += std::isfinite(fitness_[i]) ? fitness_[i] : 0;
+        avgFitness += std::isfinite(fitness[i]) ? fitness[i] : 0;
         avgSize += (double)population_[i].size();
-        if (minimize ? fitness_[i] < bestFitness : fitness_[i] > bestFitness) {
-            bestFitness = fitness_[i];
+        if (minimize ? fitness[i] < bestFitness : fitness[i] > bestFitness) {
+            bestFitness = fitness[i];
             bestIndividualIndex = i;
         }
     }
     avgFitness /= (double)population_.size();
     avgSize /= (double)population_.size();
-    bestIndividual = population_[bestIndividualIndex];
+    const double sampleBestFitness = bestFitness;
+    if (sampled_) {
+        std::tie(bestFitness, bestIndividualIndex) = bestOnAllCases();
+    }
+    population_.copy(bestIndividualIndex, bestIndividual);
     auto convertedAvgFitness = (double)avgFitness;
 
     if (save) {hist.add(generation, bestFitness, convertedAvgFitness, avgSize, bestIndividual);}
 
     std::cout << "Generation: " << generation
               << ", Avg Fitness: " << std::scientific << convertedAvgFitness
-              << ", Best Fitness: " << std::fixed << std::setprecision(2) << bestFitness
-              << ", Avg Size: " << avgSize << std::endl;
+              << ", Best Fitness: " << std::fixed << std::setprecision(2) << bestFitness;
+    if (sampled_) std::cout << " (sample " << sampleBestFitness << ")";
+    std::cout << ", Avg Size: " << avgSize << std::endl;
     return bestFitness;
 }
 
@@ -215,40 +567,30 @@ void GAsm::parallelEvolve(const std::vector<std::vector<double>>& inputs_,
     this->inputs = inputs_;
     this->targets = targets_;
 
-    individualMutexes_.resize(populationSize);
-    for (auto &m: individualMutexes_)
-        m = std::make_unique<std::mutex>();
-
-    size_t numThreads = runners_.size();
-    std::vector<std::thread> threads;
-    threads.reserve(numThreads);
-    size_t chunk = (populationSize + numThreads - 1) / numThreads;
-
     printHeader(this);
+    startSampling();
+    startCaseErrors();
+    // the calling thread is runner 0, it gets its CPUs back at the end
+    const std::vector<int> callerCpus = Placement::threadCpus();
+    place();
+    if (pinThreads || replicateData) {
+        printPlacement();
+    }
 
     if (hist.getEntries().size() == 0) {
 
         // Resize population and fitness
-        population_.resize(populationSize);
-        fitness_.resize(populationSize);
-        rank_.resize(populationSize);
-        for (auto &ind: population_) {
-            ind.reserve(individualMaxSize);
-        }
+        population_.resize(populationSize, individualMaxSize);
 
         std::cout << "Initializing population" << std::endl;
-        for (size_t t = 0; t < numThreads; ++t) {
-            size_t start = t * chunk;
-            size_t end = std::min<size_t>(start + chunk, populationSize);
-
-            threads.emplace_back([&, t, start, end]() {
-                // each runner gets its chunk and works
-                runners_[t].dispatchGrow(this, start, end, t == 0);  // set first to verbose
-            });
-        }
-
-        for (auto &th: threads) th.join(); // wait for all the threads
-        threads.clear();
+        stream_ = 0;
+        drawSample(0);
+        keepCaseErrors();
+        dispatch([this](Runner& runner, size_t begin, size_t end) {
+            runner.dispatchGrow(this, begin, end, false);
+        });
+    } else if (individualMaxSize > population_.maxSize()) {
+        population_.resize(population_.size(), individualMaxSize);  // room for the longer individuals of this run
     }
     std::cout << std::endl;
     int gen = (hist.getEntries().size() == 0 ? 0 : (hist.getLast().getGeneration()));
@@ -261,21 +603,33 @@ void GAsm::parallelEvolve(const std::vector<std::vector<double>>& inputs_,
         if (generation % checkPointInterval == 0) {
             makeCheckpoint();
         }
-
-        for (size_t t = 0; t < numThreads; ++t) {
-            size_t start = t * chunk;
-            size_t end = std::min<size_t>(start + chunk, populationSize);
-
-            threads.emplace_back([&, t, start, end]() {
-                // each runner gets its chunk and works
-                runners_[t].dispatchEvolve(this, start, end, t == 0);  // set first to verbose
+        stream_ = (uint64_t)generation + 1;
+        const bool casesChanged = drawSample(generation);
+        if (keepCaseErrors() || casesChanged) {
+            rescore(true);
+        }
+        if (collectErrors_) {
+            caseErrors_.prepare(population_);
+        }
+        // code compiled in this generation shares regions and is freed together
+        JitArena::global().newGeneration();
+        chooseSuperinstructions(generation);
+
+        if (generational) {
+            chooseElites();
+            dispatch([this](Runner& runner, size_t begin, size_t end) {
+                runner.dispatchGenerational(this, begin, end, false);
+            });
+            swapGenerations();
+        } else {
+            dispatch([this](Runner& runner, size_t begin, size_t end) {
+                runner.dispatchEvolve(this, begin, end, false);
             });
         }
-        for (auto &th : threads) th.join(); // wait for all the threads
-        threads.clear();
         std::cout << std::endl;
 
         double fitness = printGenerationStats(generation + 1);
+        reportSuperinstructions(generation + 1);
 
         // Early stopping
         if (minimize) {
@@ -289,6 +643,12 @@ void GAsm::parallelEvolve(const std::vector<std::vector<double>>& inputs_,
     std::cout << "Evolution finished, took: ";
     printTime(elapsed);
     std::cout << std::endl;
+    printJitCacheStats();
+    if (pinThreads) {
+        Placement::pinThread(callerCpus);
+    }
+    localData_ = nullptr;
+    sampled_ = false;  // the fitness stays the one on the last sample
 }
 
 void GAsm::evolve(const std::vector<std::vector<double>>& inputs_,
@@ -297,46 +657,48 @@ void GAsm::evolve(const std::vector<std::vector<double>>& inputs_,
     using namespace std::chrono;
     this->inputs = inputs_;
     this->targets = targets_;
-
-    for (auto& m : individualMutexes_)
-        m = std::make_unique<std::mutex>();
+    localData_ = nullptr;  // copies left by parallelEvolve are out of date
 
     printHeader(this);
+    startSampling();
+    startCaseErrors();
+    child_.reserve(individualMaxSize);
+    runner_.reserve(individualMaxSize);
 
     if (hist.getEntries().size() == 0) {
 
         // Resize population and fitness
-        population_.resize(populationSize);
-        fitness_.resize(populationSize);
-        rank_.resize(populationSize);
-        individualMutexes_.resize(populationSize);
-        for (auto &ind: population_) {
-            ind.reserve(individualMaxSize);
-        }
+        population_.resize(populationSize, individualMaxSize);
 
         std::cout << "Initializing population" << std::endl;
         auto initStart = high_resolution_clock::now();
+        stream_ = 0;
+        drawSample(0);
+        keepCaseErrors();
         for (size_t i = 0; i < populationSize; i++) {
             int progress = ((int) i + 1) * 100 / (int) populationSize;
             double elapsed = duration<double>(high_resolution_clock::now() - initStart).count();
             printProgressBar(progress, elapsed);
-            (*growFunction_)(this, population_[i]);
-//        std::cout << std::endl << GAsmParser::bytecode2Text(population_[i].data(), population_[i].size()) << std::endl;
-            std::pair<double, double> fitRank = (*fitnessFunction_)(this, this->runner_, population_[i]);
+            random_ = stream(i);
+            (*growFunction_)(this, random_, child_);
+            Random::local() = Random(random_());  // draws of the RNG instruction
+//        std::cout << std::endl << GAsmParser::bytecode2Text(child_.data(), child_.size()) << std::endl;
+            std::pair<double, double> fitRank = (*fitnessFunction_)(this, this->runner_, child_);
 //        std::cout << "Fitness: " << fitRank.first << std::endl;
 //        std::cout << "Rank: " << fitRank.second << std::endl;
-//        std::cout << "Individual: " << GAsmParser::bytecode2Text(population_[i].data(), population_[i].size()) << std::endl;
-            fitness_[i] = fitRank.first;
-            rank_[i] = fitRank.second;
+//        std::cout << "Individual: " << GAsmParser::bytecode2Text(child_.data(), child_.size()) << std::endl;
+            population_.assign(i, child_);
+            population_.fitness()[i] = fitRank.first;
+            population_.rank()[i] = fitRank.second;
+            population_.assignErrors(i, lastCaseErrors());
         }
+    } else if (individualMaxSize > population_.maxSize()) {
+        population_.resize(population_.size(), individualMaxSize);  // room for the longer individuals of this run
     }
     std::cout << std::endl;
     int gen = (hist.getEntries().size() == 0 ? 0 : (hist.getLast().getGeneration()));
     printGenerationStats(gen, false);
 
-    static thread_local std::mt19937 engine(std::random_device{}());
-    std::uniform_real_distribution<double> dist(0, 1);
-
     auto evolutionStart = high_resolution_clock::now();
 
     for (int generation = (hist.getEntries().size() == 0 ? 0 : (hist.getLast().getGeneration() - 1)); generation < maxGenerations; generation++) {
@@ -345,32 +707,60 @@ void GAsm::evolve(const std::vector<std::vector<double>>& inputs_,
         if (generation % checkPointInterval == 0) {
             makeCheckpoint();
         }
+        stream_ = (uint64_t)generation + 1;
+        const bool casesChanged = drawSample(generation);
+        if (keepCaseErrors() || casesChanged) {
+            rescore(false);
+        }
+        if (collectErrors_) {
+            caseErrors_.prepare(population_);
+        }
+        // code compiled in this generation shares regions and is freed together
+        JitArena::global().newGeneration();
+        chooseSuperinstructions(generation);
 
         auto genStart = high_resolution_clock::now();
-        for (int i = 0; i < populationSize; i++) {
-            selectionFunction_->selectMinimal = !minimize; // worst is not minimized
-            size_t worstIndex = (*selectionFunction_)(this);
-            selectionFunction_->selectMinimal = minimize;  // best is minimized
-            if (dist(engine) < crossoverProbability) {
-                size_t bestIndex1 = (*selectionFunction_)(this);
-                size_t bestIndex2 = (*selectionFunction_)(this);
-
-                (*crossoverFunction_)(this, population_[worstIndex], population_[bestIndex1], population_[bestIndex2]);
-            } else {
-                size_t bestIndex = (*selectionFunction_)(this);
-                (*mutationFunction_)(this, population_[worstIndex], population_[bestIndex]);
+        if (generational) {
+            // the first runner breeds on this thread, it has the same operators and settings
+            chooseElites();
+            runners_[0].dispatchGenerational(this, 0, population_.size(), true);
+            swapGenerations();
+        } else {
+            for (size_t i = 0; i < populationSize; i++) {
+                random_ = stream(i);
+                selectionFunction_->selectMinimal = !minimize; // worst is not minimized
+                size_t worstIndex = (*selectionFunction_)(this, random_);
+                const double cutoff = population_.fitness()[worstIndex];
+                population_.copy(worstIndex, child_);
+                selectionFunction_->selectMinimal = minimize;  // best is minimized
+                if (random_.chance(crossoverProbability)) {
+                    size_t bestIndex1 = (*selectionFunction_)(this, random_);
+                    size_t bestIndex2 = (*selectionFunction_)(this, random_);
+
+                    (*crossoverFunction_)(this, random_, child_, population_[bestIndex1], population_[bestIndex2]);
+                } else {
+                    size_t bestIndex = (*selectionFunction_)(this, random_);
+                    (*mutationFunction_)(this, random_, child_, population_[bestIndex]);
+                }
+
+                Random::local() = Random(random_());
+                std::pair<double, double> fitRank = racing ? fitnessFunction_->bounded(this, this->runner_, child_, cutoff)
+                                                           : (*fitnessFunction_)(this, this->runner_, child_);
+                if (!racing || !worse(fitRank.first, cutoff)) {
+                    population_.assign(worstIndex, child_);
+                    population_.fitness()[worstIndex] = fitRank.first;
+                    population_.rank()[worstIndex] = fitRank.second;
+                    population_.assignErrors(worstIndex, lastCaseErrors());
+                }
+                int progress = ((int)i + 1) * 100 / (int) populationSize;
+                double elapsed = duration<double>(high_resolution_clock::now() - genStart).count();
+                printProgressBar(progress, elapsed);
             }
-
-            std::pair<double, double> fitRank = (*fitnessFunction_)(this, this->runner_, population_[worstIndex]);
-            fitness_[worstIndex] = fitRank.first;
-            rank_[worstIndex] = fitRank.second;
-            int progress = (i + 1) * 100 / (int) populationSize;
-            double elapsed = duration<double>(high_resolution_clock::now() - genStart).count();
-            printProgressBar(progress, elapsed);
         }
         std::cout << std::endl;
 
         double fitness = printGenerationStats(generation + 1);
+        reportSuperinstructions(generation + 1);
 
         // Early stopping
         if (minimize) {
@@ -383,6 +773,8 @@ void GAsm::evolve(const std::vector<std::vector<double>>& inputs_,
     std::cout << "Evolution finished, took: ";
     printTime(elapsed);
     std::cout << std::endl;
+    printJitCacheStats();
+    sampled_ = false;
 }
 
 void GAsm::setProgram(const std::vector<uint8_t>& program) {
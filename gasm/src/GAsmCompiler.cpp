@@ -3,19 +3,87 @@
 #include <cmath>
 #include <xbyak.h>
 #include <memory>
+#include <algorithm>
+#include <bit>
+#include <climits>
+#include <cstring>
 #include "GAsmInterpreter.h"
 #include "GAsmParser.h"
+#include "GAsmIR.h"
+#include "FastMath.h"
 
-run_fn_t GAsmInterpreter::compile() {
+// the same bytecode compiled for the same shape with the same options always gives the same code
+// fills key, reuses its memory
+static void cacheKey(const std::vector<uint8_t>& program, const JitShape& shape, const IrPasses& passes,
+                     MathMode mathMode, bool caseParallel, std::vector<uint8_t>& key) {
+    key.resize(program.size() + 2 * sizeof(size_t) + 1);
+    std::copy(program.begin(), program.end(), key.begin());
+    std::memcpy(key.data() + program.size(), &shape.inputLength, sizeof(size_t));
+    std::memcpy(key.data() + program.size() + sizeof(size_t), &shape.registerLength, sizeof(size_t));
+    key.back() = (uint8_t)(passes.deadAccumulator | passes.pointerFolding << 1 |
+                           passes.redundantLoads << 2 | passes.emptyBlocks << 3 |
+                           passes.effectiveCode << 4 | (mathMode == MathMode::Fast) << 5 |
+                           caseParallel << 6);
+}
+
+// Granlund-Montgomery division by an invariant integer:
+// n / d == (t + ((n - t) >> 1)) >> (shift - 1), t = (n * magic) >> 64,
+// exact for every 64-bit n and every d >= 2
+static void reciprocal(uint64_t d, uint64_t& magic, int& shift) {
+    shift = std::bit_width(d - 1);  // 2^(shift - 1) < d <= 2^shift
+    // magic = 2^64 * (2^shift - d) / d + 1, long division of a 128-bit number
+    uint64_t remainder = (shift == 64 ? 0 : (uint64_t)1 << shift) - d;
+    uint64_t quotient = 0;
+    for (int i = 0; i < 64; i++) {
+        bool carry = remainder >> 63;
+        remainder <<= 1;
+        quotient <<= 1;
+        if (carry || remainder >= d) {
+            remainder -= d;
+            quotient |= 1;
+        }
+    }
+    magic = quotient + 1;
+}
+
+const std::vector<uint8_t>& GAsmInterpreter::compiledKey(const JitShape& shape) {
+    cacheKey(*program_, shape, passes_, mathMode_, caseParallel_, key_);
+    return key_;
+}
+
+run_fn_t GAsmInterpreter::compile(const JitShape& shape) {
+    if (program_ == nullptr) {
+        throw std::invalid_argument("Program is not set.");
+    }
+    const std::vector<uint8_t>& key = compiledKey(shape);
+    std::shared_ptr<const CompiledProgram> code = cache_ ? cache_->find(key) : nullptr;
+    if (code == nullptr) {
+        auto start = std::chrono::steady_clock::now();
+        code = generate(lowered(), shape, mathMode_, caseParallel_);
+        tierStats_.compilations++;
+        tierStats_.compiledInstructions += lowered().size();
+        tierStats_.compileNs += (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now() - start).count();
+        if (cache_) {
+            code = cache_->insert(key, code);
+        }
+    }
+    code_ = code;
+    compiled_ = code_->run;
+    compiledBatch_ = code_->runBatch;
+    return compiled_;
+}
+
+std::shared_ptr<CompiledProgram> GAsmInterpreter::generate(const std::vector<IrInstruction>& program, const JitShape& shape,
+                                                          MathMode mathMode, bool caseParallel) {
     using namespace Xbyak::util;
 
-    // used for nested loops and ifs
-    auto endLabelStack = std::vector<Xbyak::Label>();
-    auto startLabelStack = std::vector<Xbyak::Label>();
-    auto instructionStack = std::vector<uint8_t>();
-    size_t stackSize = 0;
-    constexpr size_t spaceBetweenProcessTime = 10;
-    size_t processTimeCounter = 0;
+    auto compiled = std::make_shared<CompiledProgram>();
+    compiled->shape = shape;
+    // code is emitted into a buffer the thread reuses and then copied into the arena,
+    // the buffer is never executable
+    static thread_local Xbyak::CodeGenerator code(64 * 1024, Xbyak::AutoGrow);
+    code.reset();
 
     // functions that will be called
     double (*exp_fn)(double) = exp;
@@ -25,6 +93,23 @@ run_fn_t GAsmInterpreter::compile() {
     auto sin_asm = (uint64_t)(void*) sin_fn;
     auto cos_asm = (uint64_t)(void*) cos_fn;
 
+    // --- ANALYSIS ---
+    const size_t length = program.size();
+    // every block knows its END and the counter slot of its FOR loop
+    const IrBlocks blocks = GAsmIR::matchBlocks(program);
+    const size_t forSlots = blocks.forSlots;  // deepest FOR nesting, every open FOR keeps its counter in the frame
+    bool usesDec = false;
+    for (const IrInstruction& instruction : program) {
+        usesDec = usesDec || instruction.opcode == DEC;
+    }
+    // lengths known at compile time, 0 when the code reads them at run time,
+    // they have to fit into 32-bit immediates
+    const size_t knownInputs = shape.inputLength <= INT_MAX ? shape.inputLength : 0;
+    const size_t knownRegisters = shape.registerLength <= INT_MAX ? shape.registerLength : 0;
+    // remainders of P go wrong after P wraps around 2^64, unless the length is a power of two
+    auto wrapsAround = [](size_t known) { return !std::has_single_bit(known); };
+    const std::vector<uint64_t> remainingCost = GAsmIR::remainingCost(program);
+
     // Important! don't use for constants:
     // rax - used in division and general operations
     // rdx - used in division
@@ -40,7 +125,7 @@ run_fn_t GAsmInterpreter::compile() {
     #define rng qword[rbp - 56]
     // rbx -> P (size_t)
     #define P rbx
-    // r14 -> saved inputs pointer (double*)
+    // r14 -> saved inputs pointer (double*), points at the current case
     #define inputs r14
     // QWORD PTR [rbp - 64] -> saved input length (size_t)
     #define inputLength qword[rbp - 64]
@@ -48,42 +133,301 @@ run_fn_t GAsmInterpreter::compile() {
     #define registers r15
     // QWORD PTR [rbp - 72] -> saved registers length (size_t)
     #define registerLength qword[rbp - 72]
-    // QWORD PTR [rbp - 80] -> process time (size_t)
-    #define processTime qword[rbp - 80]
+    // r10 -> process time (size_t), r10 is not preserved by calls
+    #define processTime r10
+    // QWORD PTR [rbp - 80] -> process time while a function is called
+    #define savedProcessTime qword[rbp - 80]
     // QWORD PTR [rbp - 88] -> max process time
     #define maxProcessTime qword[rbp - 88]
-    // dynamicStackSize -> the program could end in a for loop
-    // so we have to keep track of the stack size
-    // to later pop the correct amount
-    #define dynamicStackSize qword[rbp - 96]
+    // QWORD PTR [rbp - 96] -> (size_t)-1 % inputLength, PI after DEC wraps P around
+    #define wrapPI qword[rbp - 96]
+    // QWORD PTR [rbp - 104] -> (size_t)-1 % registerLength, PR after DEC wraps P around
+    #define wrapPR qword[rbp - 104]
+    // QWORD PTR [rbp - 112] -> cases left to run (size_t)
+    #define caseCount qword[rbp - 112]
+    // QWORD PTR [rbp - 120] -> distance between cases in bytes (size_t)
+    #define caseStride qword[rbp - 120]
+    // QWORD PTR [rbp - 128] -> where to save the process time of the current case (size_t*)
+    #define processTimes qword[rbp - 128]
+    // QWORD PTR [rbp - 136] -> sum of the process times of all cases (size_t)
+    #define totalTime qword[rbp - 136]
+    // QWORD PTR [rbp - 144] -> process time output of the single case entry (size_t)
+    #define singleTime qword[rbp - 144]
+    // QWORD PTR [rbp - 152] -> inputLength % registerLength, PR after a FOR loop ends
+    #define loopEndPR qword[rbp - 152]
+    // QWORD PTR [rbp - 168 - 16 * slot] -> counter of a FOR loop (size_t)
+    #define forCounter(slot) qword[rbp - (168 + 16 * (slot))]
+    // QWORD PTR [rbp - 160 - 16 * slot] -> counter % registerLength of a FOR loop (size_t)
+    #define forCounterPR(slot) qword[rbp - (160 + 16 * (slot))]
     // xmm0 -> A (accumulator) (double)
     #define A xmm0
-    // we push 5 registers, so the stack starts at 40
-    // then we have variables till 88,
-    // but we add 8 to keep the stack aligned to 16 bytes
-    #define LOCALS 96
+    // we push 5 registers, so the stack starts at 40,
+    // then we have variables till 152 and 16 bytes for every FOR slot,
+    // 8 bytes of padding keep the stack aligned to 16 bytes at every call
+#ifdef _WIN64
+    constexpr size_t shadowSpace = 32;  // windows shadow space, reserved once for all calls
+#else
+    constexpr size_t shadowSpace = 0;
+#endif
+    const size_t locals = 120 + 16 * forSlots + shadowSpace;
     //
     // Registers free to use in the program
     // xmm1-5 - for floating numbers
     // rax, rdx, rcx
 
-    // --- SETUP ---
-    // push new frame pointer
-    code_.push(rbp);
-    // create new stack pointer
-    code_.mov(rbp, rsp);
+    // both entry points share the same frame
+    auto prologue = [locals]() {
+        // push new frame pointer
+        code.push(rbp);
+        // create new stack pointer
+        code.mov(rbp, rsp);
 
-    // save caller's rbx, r12-r15, which we'll use
-    // this changes the stack we have to be careful
-    code_.push(rbx);
-    code_.push(r12);
-    code_.push(r13);
-    code_.push(r14);
-    code_.push(r15);
+        // save caller's rbx, r12-r15, which we'll use
+        // this changes the stack we have to be careful
+        code.push(rbx);
+        code.push(r12);
+        code.push(r13);
+        code.push(r14);
+        code.push(r15);
+
+        // reserve beginning of the stack for our variables
+        code.sub(rsp, locals); // reserve stack of locals
+    };
+    // the stack is aligned in the whole program, so calls don't have to move it
+    auto callRax = []() {
+        code.mov(savedProcessTime, processTime);
+        code.call(rax);
+        code.mov(processTime, savedProcessTime);
+    };
+    // xmm = (double) P, P is unsigned
+    auto convertP = [](const Xbyak::Xmm& xmm) {
+        code.test(P, P);    // check if the value will fit in 64-bit number
+        Xbyak::Label doesNotFit;
+        code.js(doesNotFit); // special case if the value won't fit
+        // simple conversion the value will fit
+        code.pxor(xmm, xmm);     // clear xmm
+        code.cvtsi2sd(xmm, P);   // convert xmm = (double) P
+        Xbyak::Label endConversion;
+        code.jmp(endConversion);
+        // complex conversion if the value won't fit
+        // this is just some compiler magic and IEEE 754 standard
+        code.L(doesNotFit);
+        code.mov(rax, P);
+        code.mov(rdx, rax);
+        code.shr(rdx, 1);
+        code.and_(eax, 1);
+        code.or_(rdx, rax);
+        code.pxor(xmm, xmm);
+        code.cvtsi2sd(xmm, rdx);
+        code.addsd(xmm, xmm);
+        // end conversion
+        code.L(endConversion);
+    };
+    // index = P % length, known lengths don't need a division
+    auto emitModulo = [](const Xbyak::Reg64& index, size_t known, const Xbyak::Address& lengthAddress) {
+        if (known == 0) {
+            code.mov(rax, P);         // move P to rax
+            code.xor_(edx, edx);      // fill lower rdx with 0
+            code.div(lengthAddress);  // division by length
+            code.mov(index, rdx);     // remainder is in rdx
+        } else if (known == 1) {
+            code.xor_(index, index);  // everything is index 0
+        } else if (std::has_single_bit(known)) {
+            code.mov(index, P);
+            code.and_(index, known - 1); // mask of the power of two
+        } else {
+            uint64_t magic;
+            int shift;
+            reciprocal(known, magic, shift);
+            code.mov(rax, magic);
+            code.mul(P);              // rdx = (P * magic) >> 64
+            code.mov(rax, P);
+            code.sub(rax, rdx);
+            code.shr(rax, 1);
+            code.add(rax, rdx);
+            code.shr(rax, shift - 1); // rax = P / length
+            code.imul(rax, rax, (int)known);
+            code.mov(index, P);
+            code.sub(index, rax);     // index = P - P / length * length
+        }
+    };
+    // index = (index + 1) % length, rax has to be 0
+    auto emitIncrement = [](const Xbyak::Reg64& index, size_t known, const Xbyak::Address& lengthAddress) {
+        if (known == 1) {
+            return;                         // always 0
+        }
+        code.add(index, 1);                 // add 1
+        if (known == 0) {
+            code.cmp(index, lengthAddress); // compare to length
+            code.cmove(index, rax);         // set to 0 if equal length
+        } else if (std::has_single_bit(known)) {
+            code.and_(index, known - 1);    // mask of the power of two
+        } else {
+            code.cmp(index, known);         // compare to length
+            code.cmove(index, rax);         // set to 0 if equal length
+        }
+    };
+    // index = (index - 1) % length
+    auto emitDecrement = [](const Xbyak::Reg64& index, size_t known, const Xbyak::Address& lengthAddress) {
+        if (known == 1) {
+            return;                            // always 0
+        }
+        if (known == 0) {
+            code.cmp(index, 0);                // compare to 0
+            code.cmove(index, lengthAddress);  // set to length if equal 0
+            code.sub(index, 1);                // sub 1
+        } else if (std::has_single_bit(known)) {
+            code.sub(index, 1);                // sub 1
+            code.and_(index, known - 1);       // mask of the power of two
+        } else {
+            code.mov(ecx, known);
+            code.test(index, index);           // compare to 0
+            code.cmovz(index, rcx);            // set to length if equal 0
+            code.sub(index, 1);                // sub 1
+        }
+    };
+    // compares reg with a length
+    auto emitCompareLength = [](const Xbyak::Reg64& reg, size_t known, const Xbyak::Address& lengthAddress) {
+        if (known == 0) {
+            code.cmp(reg, lengthAddress);
+        } else {
+            code.cmp(reg, known);
+        }
+    };
+    // constants of the fast math kernels, placed after the code
+    Xbyak::Label mathConstants;
+    std::vector<uint64_t> constantPool;
+    auto constant = [&](double value) {
+        auto bits = std::bit_cast<uint64_t>(value);
+        auto it = std::find(constantPool.begin(), constantPool.end(), bits);
+        auto index = (int)(it - constantPool.begin());
+        if (it == constantPool.end()) {
+            constantPool.push_back(bits);
+        }
+        return qword[rip + mathConstants + 8 * index];
+    };
+    // A = sin(A + quadrant * pi / 2), the same operations as FastMath::sin and FastMath::cos
+    auto emitSinCos = [&](int quadrant) {
+        if (mathMode == MathMode::Exact) {
+            code.mov(rax, quadrant == 0 ? sin_asm : cos_asm);
+            callRax();  // call sin(xmm0) or cos(xmm0)
+            return;
+        }
+        Xbyak::Label useLibm, useCos, sign, done;
+        // |A| > reductionLimit or NaN, the bits of positive doubles are ordered like the values
+        code.movq(rax, A);
+        code.add(rax, rax);  // drop the sign
+        code.mov(rcx, std::bit_cast<uint64_t>(FastMath::reductionLimit) << 1);
+        code.cmp(rax, rcx);
+        code.ja(useLibm, Xbyak::CodeGenerator::LabelType::T_NEAR);
+        // A = k * pi / 2 + r, the quadrant is in the low bits of rax
+        code.movsd(xmm1, A);
+        code.mulsd(xmm1, constant(FastMath::twoOverPi));
+        code.addsd(xmm1, constant(FastMath::shifter));
+        code.movq(rax, xmm1);
+        code.subsd(xmm1, constant(FastMath::shifter)); // xmm1 = k
+        if (quadrant != 0) {
+            code.add(rax, quadrant);
+        }
+        for (double part : {FastMath::pio2_1, FastMath::pio2_2}) {
+            code.movsd(xmm2, xmm1);
+            code.mulsd(xmm2, constant(part));
+            code.subsd(A, xmm2);
+        }
+        code.mulsd(xmm1, constant(FastMath::pio2_3));
+        code.subsd(A, xmm1);   // A = r
+        code.movsd(xmm1, A);
+        code.mulsd(xmm1, A);   // xmm1 = z = r * r
+        code.test(al, 1);
+        code.jnz(useCos, Xbyak::CodeGenerator::LabelType::T_NEAR);
+        // sin(r) = r + r^3 * s(z)
+        code.movsd(xmm2, constant(FastMath::sinCoefficients[0]));
+        for (int i = 1; i < FastMath::sinDegree; i++) {
+            code.mulsd(xmm2, xmm1);
+            code.addsd(xmm2, constant(FastMath::sinCoefficients[i]));
+        }
+        code.mulsd(xmm2, xmm1);
+        code.mulsd(xmm2, A);
+        code.addsd(A, xmm2);
+        code.jmp(sign, Xbyak::CodeGenerator::LabelType::T_NEAR);
+        // cos(r) = 1 - z / 2 + z^2 * c(z)
+        code.L(useCos);
+        code.movsd(xmm2, constant(FastMath::cosCoefficients[0]));
+        for (int i = 1; i < FastMath::cosDegree; i++) {
+            code.mulsd(xmm2, xmm1);
+            code.addsd(xmm2, constant(FastMath::cosCoefficients[i]));
+        }
+        code.mulsd(xmm2, xmm1);
+        code.mulsd(xmm2, xmm1);                   // xmm2 = c
+        code.mulsd(xmm1, constant(0.5));          // xmm1 = z / 2
+        code.movsd(A, constant(1.0));
+        code.subsd(A, xmm1);                      // A = w = 1 - z / 2
+        code.movsd(xmm3, constant(1.0));
+        code.subsd(xmm3, A);
+        code.subsd(xmm3, xmm1);
+        code.addsd(xmm3, xmm2);                   // xmm3 = (1 - w) - z / 2 + c
+        code.addsd(A, xmm3);
+        // quadrants 2 and 3 are negative
+        code.L(sign);
+        code.and_(eax, 2);
+        code.shl(rax, 62);
+        code.movq(xmm1, rax);
+        code.xorpd(A, xmm1);
+        code.jmp(done, Xbyak::CodeGenerator::LabelType::T_NEAR);
+        // big arguments, inf and NaN
+        code.L(useLibm);
+        code.mov(rax, quadrant == 0 ? sin_asm : cos_asm);
+        callRax();
+        code.L(done);
+    };
+    // A = exp(A), the same operations as FastMath::exp
+    auto emitExp = [&]() {
+        if (mathMode == MathMode::Exact) {
+            code.mov(rax, exp_asm);
+            callRax();  // call exp(xmm0)
+            return;
+        }
+        Xbyak::Label overflow, underflow, done;
+        code.comisd(A, constant(FastMath::expMax));
+        code.ja(overflow, Xbyak::CodeGenerator::LabelType::T_NEAR);   // A > expMax, NaN goes on
+        code.movsd(xmm1, constant(FastMath::expMin));
+        code.comisd(xmm1, A);
+        code.ja(underflow, Xbyak::CodeGenerator::LabelType::T_NEAR);  // expMin > A, NaN goes on
+        // A = k * ln 2 + r, k is in the low bits of rax
+        code.movsd(xmm1, A);
+        code.mulsd(xmm1, constant(FastMath::log2e));
+        code.addsd(xmm1, constant(FastMath::shifter));
+        code.movq(rax, xmm1);
+        code.subsd(xmm1, constant(FastMath::shifter)); // xmm1 = k
+        code.movsd(xmm2, xmm1);
+        code.mulsd(xmm2, constant(FastMath::ln2Hi));
+        code.subsd(A, xmm2);
+        code.mulsd(xmm1, constant(FastMath::ln2Lo));
+        code.subsd(A, xmm1);   // A = r
+        code.movsd(xmm1, constant(FastMath::expCoefficients[0]));
+        for (int i = 1; i <= FastMath::expDegree; i++) {
+            code.mulsd(xmm1, A);
+            code.addsd(xmm1, constant(FastMath::expCoefficients[i]));
+        }
+        // e^A = e^r * 2 * 2^(k - 1)
+        code.add(rax, 1022);
+        code.shl(rax, 52);
+        code.movq(xmm2, rax);
+        code.addsd(xmm1, xmm1);
+        code.mulsd(xmm1, xmm2);
+        code.movsd(A, xmm1);
+        code.jmp(done, Xbyak::CodeGenerator::LabelType::T_NEAR);
+        code.L(overflow);
+        code.movsd(A, constant(std::numeric_limits<double>::infinity()));
+        code.jmp(done, Xbyak::CodeGenerator::LabelType::T_NEAR);
+        code.L(underflow);
+        code.pxor(A, A);
+        code.L(done);
+    };
+    Xbyak::Label startCases;
 
-    // reserve beginning of the stack for our variables
-    // WARNING!!! change if adding more locals
-    code_.sub(rsp, LOCALS); // reserve stack of locals
+    // --- SINGLE CASE ENTRY (run_fn_t) ---
+    prologue();
 
     // move function arguments to appropriate registers
 #if defined(__unix__)
@@ -95,14 +439,14 @@ run_fn_t GAsmInterpreter::compile() {
 // 5: constants       -> r8
 // 6: rng             -> r9
 // 7: maxProcessTime  -> [rsp+8] at entry -> [rbp+16] after push rbp/mov rbp,rsp
-    code_.mov(inputs, rdi);
-    code_.mov(inputLength, rsi);
-    code_.mov(registers, rdx);
-    code_.mov(registerLength, rcx);
-    code_.mov(constants, r8);  // constants
-    code_.mov(rng, r9);        // rng;
-    code_.mov(rax, qword[rbp + 16]);
-    code_.mov(maxProcessTime, rax); // max process time;
+    code.mov(inputs, rdi);
+    code.mov(inputLength, rsi);
+    code.mov(registers, rdx);
+    code.mov(registerLength, rcx);
+    code.mov(constants, r8);  // constants
+    code.mov(rng, r9);        // rng;
+    code.mov(rax, qword[rbp + 16]);
+    code.mov(maxProcessTime, rax); // max process time;
 #elif defined(_WIN64)
 // Microsoft x64 ABI:
 // 1: inputs          -> rcx
@@ -113,677 +457,567 @@ run_fn_t GAsmInterpreter::compile() {
 // 6: rng             -> [rsp+48]
 // 7: maxProcessTime  -> [rsp+56]
 // After push rbp/mov rbp,rsp those become +48, +56, +64 respectively.
-    code_.mov(inputs, rcx);
-    code_.mov(inputLength, rdx);
-    code_.mov(registers, r8);
-    code_.mov(registerLength, r9);
-    code_.mov(rax, qword[rbp + 48]);
-    code_.mov(constants, rax);      // constants
-    code_.mov(rax, qword[rbp + 56]);
-    code_.mov(rng, rax);            // rng;
-    code_.mov(rax, qword[rbp + 64]);
-    code_.mov(maxProcessTime, rax); // max process time;
+    code.mov(inputs, rcx);
+    code.mov(inputLength, rdx);
+    code.mov(registers, r8);
+    code.mov(registerLength, r9);
+    code.mov(rax, qword[rbp + 48]);
+    code.mov(constants, rax);      // constants
+    code.mov(rax, qword[rbp + 56]);
+    code.mov(rng, rax);            // rng;
+    code.mov(rax, qword[rbp + 64]);
+    code.mov(maxProcessTime, rax); // max process time;
 #else
 #   error "Unsupported platform / calling convention"
 #endif
+    // a single case is a batch of one
+    code.mov(caseCount, 1);
+    code.mov(rax, inputLength);
+    code.shl(rax, 3);          // stride in bytes
+    code.mov(caseStride, rax);
+    code.lea(rax, ptr[rbp - 144]); // process time goes to singleTime
+    code.mov(processTimes, rax);
+    code.jmp(startCases, Xbyak::CodeGenerator::LabelType::T_NEAR);
+
+    // --- BATCH ENTRY (batch_fn_t) ---
+    size_t batchOffset = code.getSize();
+    prologue();
+
+#if defined(__unix__)
+// System V AMD64 ABI:
+// 1: cases           -> rdi
+// 2: caseCount       -> rsi
+// 3: caseStride      -> rdx
+// 4: inputLength     -> rcx
+// 5: registers       -> r8
+// 6: registerLength  -> r9
+// 7: constants       -> [rbp+16]
+// 8: rng             -> [rbp+24]
+// 9: maxProcessTime  -> [rbp+32]
+// 10: processTimes   -> [rbp+40]
+    code.mov(inputs, rdi);
+    code.mov(caseCount, rsi);
+    code.shl(rdx, 3);              // stride in bytes
+    code.mov(caseStride, rdx);
+    code.mov(inputLength, rcx);
+    code.mov(registers, r8);
+    code.mov(registerLength, r9);
+    code.mov(rax, qword[rbp + 16]);
+    code.mov(constants, rax);      // constants
+    code.mov(rax, qword[rbp + 24]);
+    code.mov(rng, rax);            // rng
+    code.mov(rax, qword[rbp + 32]);
+    code.mov(maxProcessTime, rax); // max process time
+    code.mov(rax, qword[rbp + 40]);
+    code.mov(processTimes, rax);   // process time outputs
+#elif defined(_WIN64)
+// Microsoft x64 ABI:
+// 1: cases           -> rcx
+// 2: caseCount       -> rdx
+// 3: caseStride      -> r8
+// 4: inputLength     -> r9
+// 5-10: registers, registerLength, constants, rng, maxProcessTime, processTimes
+//       -> [rbp+48] ... [rbp+88] after push rbp/mov rbp,rsp
+    code.mov(inputs, rcx);
+    code.mov(caseCount, rdx);
+    code.shl(r8, 3);               // stride in bytes
+    code.mov(caseStride, r8);
+    code.mov(inputLength, r9);
+    code.mov(registers, qword[rbp + 48]);
+    code.mov(rax, qword[rbp + 56]);
+    code.mov(registerLength, rax);
+    code.mov(rax, qword[rbp + 64]);
+    code.mov(constants, rax);      // constants
+    code.mov(rax, qword[rbp + 72]);
+    code.mov(rng, rax);            // rng
+    code.mov(rax, qword[rbp + 80]);
+    code.mov(maxProcessTime, rax); // max process time
+    code.mov(rax, qword[rbp + 88]);
+    code.mov(processTimes, rax);   // process time outputs
+#else
+#   error "Unsupported platform / calling convention"
+#endif
+
+    // --- CASE LOOP ---
+    Xbyak::Label nextCase;
+    Xbyak::Label endCases;
+    code.L(startCases);
+    // remainders of unknown lengths used when P wraps around, the same for every case
+    if (usesDec && knownInputs == 0) {
+        code.mov(rax, -1);
+        code.xor_(edx, edx);
+        code.div(inputLength);
+        code.mov(wrapPI, rdx);
+    }
+    if (usesDec && knownRegisters == 0) {
+        code.mov(rax, -1);
+        code.xor_(edx, edx);
+        code.div(registerLength);
+        code.mov(wrapPR, rdx);
+    }
+    if (forSlots > 0 && (knownInputs == 0 || knownRegisters == 0)) {
+        code.mov(rax, inputLength);
+        code.xor_(edx, edx);
+        code.div(registerLength);
+        code.mov(loopEndPR, rdx);
+    }
+    code.mov(totalTime, 0);     // totalTime = 0
+    code.cmp(caseCount, 0);
+    code.je(endCases, Xbyak::CodeGenerator::LabelType::T_NEAR); // nothing to run
+    code.L(nextCase);
+
+    // registers are cleared before every case
+    // registerLength is always >= 1
+    code.xor_(eax, eax);
+    if (knownRegisters == 0) {
+        code.mov(rcx, registerLength);
+    } else {
+        code.mov(ecx, knownRegisters);
+    }
+    Xbyak::Label clearRegisters;
+    code.L(clearRegisters);
+    code.mov(ptr[registers + rcx * 8 - 8], rax);
+    code.sub(rcx, 1);
+    code.jnz(clearRegisters);
 
     // reset P, PI, PR, A and processTime
-    code_.xor_(P, P);            // P = 0
-    code_.pxor(A, A);            // A = 0.0
-    code_.xor_(PI, PI);          // PI = 0
-    code_.xor_(PR, PR);          // PR = 0
-    code_.mov(processTime, 0); // processTime = 0;
-    code_.mov(dynamicStackSize, 0); // dynamicStackSize = 0;
+    code.xor_(P, P);            // P = 0
+    code.pxor(A, A);            // A = 0.0
+    code.xor_(PI, PI);          // PI = 0
+    code.xor_(PR, PR);          // PR = 0
+    code.xor_(processTime, processTime); // processTime = 0
 
     // prepare end program label
     Xbyak::Label endProgram;
-    // TODO validate jump conditions
-    // TODO simple optimization
-    // TODO reuse registers and lea
-    // TODO check process time every 10 instructions and on loops
 
-    // --- COMPILATION ---
-    for (int i = 0; i < program_->size(); i++) {
-        const uint8_t& opcode = program_->operator[](i);
+    // --- PROCESS TIME ---
+    // The program is emitted twice. The fast copy charges every block when it's entered
+    // and checks the budget only when a loop jumps back. Without a jump back, the run visits
+    // every instruction at most once, so a loop starting at index o takes at most remainingCost[o + 1]
+    // before its next check. If that might not fit into the budget, the run moves to the same place
+    // in the checked copy, which counts every instruction like the interpreter and stops right after
+    // the one that goes over the budget.
+    std::vector<Xbyak::Label> fastBody(length);    // first instruction inside a block
+    std::vector<Xbyak::Label> fastAfter(length);   // first instruction after a block
+    std::vector<Xbyak::Label> checkedBody(length);
+    std::vector<Xbyak::Label> checkedAfter(length);
+    Xbyak::Label checkedStart;
+    code.mov(rax, remainingCost[0]);
+    code.cmp(rax, maxProcessTime);
+    code.ja(checkedStart, Xbyak::CodeGenerator::LabelType::T_NEAR); // the program alone might not fit
 
-        switch (opcode) {
+    // emits the instructions that don't jump
+    auto emitInstruction = [&](const IrInstruction& instruction) {
+        switch (instruction.opcode) {
             case MOV_P_A: {
-                // p = (size_t) A;
-                // honestly I don't know why is it like this
-                // it's copied from a C++ compiler
-                code_.movsd(xmm1, A); // save A to xmm1
-                code_.pxor(xmm2, xmm2);  // set xmm2 to 0
-                code_.comisd(xmm1, xmm2); // compare xmm1 < xmm2, A < 0
-                Xbyak::Label lessThan0;
-                code_.jnb(lessThan0); // if A < 0: goto handle negative
-                // case: A is positive, A >= 0
-                code_.cvttsd2si(P, A); // convert A to size_t and save to P
-                Xbyak::Label endConversion;
-                code_.jmp(endConversion); // goto end
-                // case: A is negative, A < 0
-                code_.L(lessThan0);
-                code_.subsd(A, xmm2);  // A = A - 0, it's to set the flags
-                code_.cvttsd2si(P, A); // convert A to size_t and save to P
-                code_.mov(rax, 0x8000000000000000); // bit magic
-                code_.xor_(P, rax);    // make it non negative
-                // end conversion
-                code_.L(endConversion);
-                // update P % registerLength
-                code_.mov(rax, P);         // move P to rax
-                code_.xor_(edx, edx);      // fill lower rdx with 0
-                code_.div(registerLength); // division by length
-                code_.mov(PR, rdx);        // remainder is in rdx
-                // update P % inputLength
-                code_.mov(rax, P);      // move P to rax
-                code_.xor_(edx, edx);   // fill lower rdx with 0
-                code_.div(inputLength); // division by length
-                code_.mov(PI, rdx);     // remainder is in rdx
+                // P = (int) A, sign extended like in the interpreter
+                code.cvttsd2si(eax, A);
+                code.movsxd(P, eax);
+                // update P % registerLength and P % inputLength
+                emitModulo(PR, knownRegisters, registerLength);
+                emitModulo(PI, knownInputs, inputLength);
                 break;
             }
             case MOV_A_P: {
                 // A = (double) P
-                code_.test(P, P);    // check if the value will fit in 64-bit number
-                Xbyak::Label doesNotFit;
-                code_.js(doesNotFit); // special case if the value won't fit
-                // simple conversion the value will fit
-                code_.pxor(A, A);     // clear A
-                code_.cvtsi2sd(A, P); // convert A = (double) P
-                Xbyak::Label endConversion;
-                code_.jmp(endConversion);
-                // complex conversion if the value won't fit
-                // this is just some compiler magic and IEEE 754 standard
-                code_.L(doesNotFit);
-                code_.mov(rax, P);
-                code_.mov(rdx, rax);
-                code_.shr(rdx, 1);
-                code_.and_(eax, 1);
-                code_.or_(rdx, rax);
-                code_.pxor(A, A);
-                code_.cvtsi2sd(A, rdx);
-                code_.addsd(A, A);
-                // end conversion
-                code_.L(endConversion);
+                convertP(A);
                 break;
             }
             case MOV_A_R: {
                 // A = registers[P % registerLength]
-                code_.movsd(A, ptr[registers + PR * 8]); // assign it to A
+                code.movsd(A, ptr[registers + PR * 8]); // assign it to A
                 break;
             }
             case MOV_A_I: {
                 // A = inputs[P % inputLength]
-                code_.movsd(A, ptr[inputs + PI * 8]); // assign it to A
+                code.movsd(A, ptr[inputs + PI * 8]); // assign it to A
                 break;
             }
             case MOV_R_A: {
                 // registers[P % registerLength] = A
-                code_.movsd(ptr[registers + PR * 8], A); // assign A to it
+                code.movsd(ptr[registers + PR * 8], A); // assign A to it
                 break;
             }
             case MOV_I_A: {
                 // inputs[P % inputLength] = A
-                code_.movsd(ptr[inputs + PI * 8], A); // assign A to it
+                code.movsd(ptr[inputs + PI * 8], A); // assign A to it
                 break;
             }
             case ADD_R: {
                 // A += registers_[P % registerLength];
-                code_.addsd(A, ptr[registers + PR * 8]); // add to A
+                code.addsd(A, ptr[registers + PR * 8]); // add to A
                 break;
             }
             case SUB_R: {
                 // A -= registers_[P % registerLength];
-                code_.subsd(A, ptr[registers + PR * 8]); // sub from A
+                code.subsd(A, ptr[registers + PR * 8]); // sub from A
                 break;
             }
             case DIV_R: {
                 // A /= registers_[P % registerLength];
-                code_.divsd(A, ptr[registers + PR * 8]); // div A
+                code.divsd(A, ptr[registers + PR * 8]); // div A
                 break;
             }
             case MUL_R: {
                 // A *= registers_[P % registerLength];
-                code_.mulsd(A, ptr[registers + PR * 8]); // mul with A
+                code.mulsd(A, ptr[registers + PR * 8]); // mul with A
                 break;
             }
             case SIN_R: {
                 // A = sin(registers_[P % registerLength]);
-                code_.movsd(A, ptr[registers + PR * 8]); // assign from pointer to A
-                // WARNING!!! ONLY ODD NUMBER OF VARIABLES CAN BE ON THE STACK
-                code_.push(P);           // save the P register, we'll use it
-                if (stackSize % 2 == 0) {
-#ifdef _WIN64
-                    code_.sub(rsp, 32);  // windows shadow space
-#endif
-                    code_.mov(rax, sin_asm);
-                    code_.call(rax);     // call sin(xmm0), sin(A)
-#ifdef _WIN64
-                    code_.add(rsp, 32);
-#endif
-                } else {
-#ifdef _WIN64
-                    code_.sub(rsp, 40);  // windows shadow space and stack alignment
-#else
-                    code_.sub(rsp, 8);   // stack alignment
-#endif
-                    code_.mov(rax, sin_asm);
-                    code_.call(rax);  // call sin(xmm0), sin(A)
-#ifdef _WIN64
-                    code_.add(rsp, 40);
-#else
-                    code_.add(rsp, 8);
-#endif
-                }
-
-                code_.pop(P); // restore the P register
+                code.movsd(A, ptr[registers + PR * 8]); // assign from pointer to A
+                emitSinCos(0);
                 break;
             }
             case COS_R: {
                 // A = cos(registers_[P % registerLength]);
-                code_.movsd(A, ptr[registers + PR * 8]); // assign from pointer to A
-                // WARNING!!! ONLY ODD NUMBER OF VARIABLES CAN BE ON THE STACK
-                code_.push(P);           // save the P register, we'll use it
-                if (stackSize % 2 == 0) {
-#ifdef _WIN64
-                    code_.sub(rsp, 32);  // windows shadow space
-#endif
-                    code_.mov(rax, cos_asm);
-                    code_.call(rax);     // call cos(xmm0), cos(A)
-#ifdef _WIN64
-                    code_.add(rsp, 32);
-#endif
-                } else {
-#ifdef _WIN64
-                    code_.sub(rsp, 40);  // windows shadow space and stack alignment
-#else
-                    code_.sub(rsp, 8);   // stack alignment
-#endif
-                    code_.mov(rax, cos_asm);
-                    code_.call(rax);     // call cos(xmm0), cos(A)
-#ifdef _WIN64
-                    code_.add(rsp, 40);
-#else
-                    code_.add(rsp, 8);
-#endif
-                }
-
-                code_.pop(P); // restore the P register
+                code.movsd(A, ptr[registers + PR * 8]); // assign from pointer to A
+                emitSinCos(1);
                 break;
             }
             case EXP_R: {
                 // A = exp(registers_[P % registerLength]);
-                code_.movsd(A, ptr[registers + PR * 8]); // assign from pointer to A
-                // WARNING!!! ONLY ODD NUMBER OF VARIABLES CAN BE ON THE STACK
-                code_.push(P);           // save the P register, we'll use it
-                if (stackSize % 2 == 0) {
-#ifdef _WIN64
-                    code_.sub(rsp, 32);  // windows shadow space
-#endif
-                    code_.mov(rax, exp_asm);
-                    code_.call(rax);     // call exp(xmm0), exp(A
-#ifdef _WIN64
-                    code_.add(rsp, 32);
-#endif
-                } else {
-#ifdef _WIN64
-                    code_.sub(rsp, 40);  // windows shadow space and stack alignment
-#else
-                    code_.sub(rsp, 8);   // stack alignment
-#endif
-                    code_.mov(rax, exp_asm);
-                    code_.call(rax);     // call exp(xmm0), exp(A
-#ifdef _WIN64
-                    code_.add(rsp, 40);
-#else
-                    code_.add(rsp, 8);
-#endif
-                }
-
-                code_.pop(P); // restore the P register
+                code.movsd(A, ptr[registers + PR * 8]); // assign from pointer to A
+                emitExp();
                 break;
             }
             case ADD_I: {
                 // A += _inputs[P % inputLength];
-                code_.addsd(A, ptr[inputs + PI * 8]); // add to A
+                code.addsd(A, ptr[inputs + PI * 8]); // add to A
                 break;
             }
             case SUB_I: {
                 // A -= _inputs[P % inputLength];
-                code_.subsd(A, ptr[inputs + PI * 8]); // sub from A
+                code.subsd(A, ptr[inputs + PI * 8]); // sub from A
                 break;
             }
             case DIV_I: {
                 // A /= _inputs[P % inputLength];
-                code_.divsd(A, ptr[inputs + PI * 8]); // div A
+                code.divsd(A, ptr[inputs + PI * 8]); // div A
                 break;
             }
             case MUL_I: {
                 // A *= _inputs[P % inputLength];
-                code_.mulsd(A, ptr[inputs + PI * 8]); // mul with A
+                code.mulsd(A, ptr[inputs + PI * 8]); // mul with A
                 break;
             }
             case SIN_I: {
                 // A = sin(_inputs[P % inputLength]);
-                code_.movsd(A, ptr[inputs + PI * 8]); // assign from pointer to A
-                // WARNING!!! ONLY ODD NUMBER OF VARIABLES CAN BE ON THE STACK
-                code_.push(P);           // save the P register, we'll use it
-                if (stackSize % 2 == 0) {
-#ifdef _WIN64
-                    code_.sub(rsp, 32);  // windows shadow space
-#endif
-                    code_.mov(rax, sin_asm);
-                    code_.call(rax);     // call sin(xmm0), sin(A)
-#ifdef _WIN64
-                    code_.add(rsp, 32);
-#endif
-                } else {
-#ifdef _WIN64
-                    code_.sub(rsp, 40);  // windows shadow space and stack alignment
-#else
-                    code_.sub(rsp, 8);   // stack alignment
-#endif
-                    code_.mov(rax, sin_asm);
-                    code_.call(rax);  // call sin(xmm0), sin(A)
-#ifdef _WIN64
-                    code_.add(rsp, 40);
-#else
-                    code_.add(rsp, 8);
-#endif
-                }
-
-                code_.pop(P); // restore the P register
+                code.movsd(A, ptr[inputs + PI * 8]); // assign from pointer to A
+                emitSinCos(0);
                 break;
             }
             case COS_I: {
                 // A = cos(_inputs[P % inputLength]);
-                code_.movsd(A, ptr[inputs + PI * 8]); // assign from pointer to A
-                // WARNING!!! ONLY ODD NUMBER OF VARIABLES CAN BE ON THE STACK
-                code_.push(P);           // save the P register, we'll use it
-                if (stackSize % 2 == 0) {
-#ifdef _WIN64
-                    code_.sub(rsp, 32);  // windows shadow space
-#endif
-                    code_.mov(rax, cos_asm);
-                    code_.call(rax);     // call cos(xmm0), cos(A)
-#ifdef _WIN64
-                    code_.add(rsp, 32);
-#endif
-                } else {
-#ifdef _WIN64
-                    code_.sub(rsp, 40);  // windows shadow space and stack alignment
-#else
-                    code_.sub(rsp, 8);   // stack alignment
-#endif
-                    code_.mov(rax, cos_asm);
-                    code_.call(rax);     // call cos(xmm0), cos(A)
-#ifdef _WIN64
-                    code_.add(rsp, 40);
-#else
-                    code_.add(rsp, 8);
-#endif
-                }
-
-                code_.pop(P); // restore the P register
+                code.movsd(A, ptr[inputs + PI * 8]); // assign from pointer to A
+                emitSinCos(1);
                 break;
             }
             case EXP_I: {
                 // A = exp(_inputs[P % inputLength]);
-                code_.movsd(A, ptr[inputs + PI * 8]); // assign from pointer to A
-                // WARNING!!! ONLY ODD NUMBER OF VARIABLES CAN BE ON THE STACK
-                code_.push(P);           // save the P register, we'll use it
-                if (stackSize % 2 == 0) {
-#ifdef _WIN64
-                    code_.sub(rsp, 32);  // windows shadow space
-#endif
-                    code_.mov(rax, exp_asm);
-                    code_.call(rax);     // call exp(xmm0), exp(A)
-#ifdef _WIN64
-                    code_.add(rsp, 32);
-#endif
-                } else {
-#ifdef _WIN64
-                    code_.sub(rsp, 40);  // windows shadow space and stack alignment
-#else
-                    code_.sub(rsp, 8);   // stack alignment
-#endif
-                    code_.mov(rax, exp_asm);
-                    code_.call(rax);     // call exp(xmm0), exp(A)
-#ifdef _WIN64
-                    code_.add(rsp, 40);
-#else
-                    code_.add(rsp, 8);
-#endif
-                }
-
-                code_.pop(P); // restore the P register
+                code.movsd(A, ptr[inputs + PI * 8]); // assign from pointer to A
+                emitExp();
                 break;
             }
             case INC: {
                 // P++;
-                code_.add(P, 1); // add 1
+                code.add(P, 1); // add 1
                 // prepare rax, because cmove does not support immediate addressing
-                code_.xor_(rax, rax); // rax = 0
-                // update PI
-                code_.add(PI, 1); // add 1
-                code_.cmp(PI, inputLength); // compare to length
-                code_.cmove(PI, rax); // set to 0 if equal length
-                // update PR
-                code_.add(PR, 1); // add 1
-                code_.cmp(PR, registerLength); // compare to length
-                code_.cmove(PR, rax); // set to 0 if equal length
+                code.xor_(eax, eax); // rax = 0
+                emitIncrement(PI, knownInputs, inputLength);
+                emitIncrement(PR, knownRegisters, registerLength);
+                // P wrapped around to 0
+                if (wrapsAround(knownInputs) || wrapsAround(knownRegisters)) {
+                    code.test(P, P);
+                    if (wrapsAround(knownInputs)) {
+                        code.cmovz(PI, rax);
+                    }
+                    if (wrapsAround(knownRegisters)) {
+                        code.cmovz(PR, rax);
+                    }
+                }
                 break;
             }
             case DEC: {
                 // P--;
-                code_.sub(P, 1); // sub 1
-                // update PI
-                code_.cmp(PI, 0); // compare to 0
-                code_.cmove(PI, inputLength); // set to length if equal 0
-                code_.sub(PI, 1); // sub 1
-                // update PR
-                code_.cmp(PR, 0); // compare to 0
-                code_.cmove(PR, registerLength); // set to length if equal 0
-                code_.sub(PR, 1); // sub 1
-
+                code.sub(P, 1); // sub 1
+                emitDecrement(PI, knownInputs, inputLength);
+                emitDecrement(PR, knownRegisters, registerLength);
+                // P wrapped around to (size_t)-1
+                if (wrapsAround(knownInputs) || wrapsAround(knownRegisters)) {
+                    code.cmp(P, -1);
+                    if (knownInputs == 0) {
+                        code.cmove(PI, wrapPI);
+                    } else if (wrapsAround(knownInputs)) {
+                        code.mov(rcx, SIZE_MAX % knownInputs);
+                        code.cmove(PI, rcx);
+                    }
+                    if (knownRegisters == 0) {
+                        code.cmove(PR, wrapPR);
+                    } else if (wrapsAround(knownRegisters)) {
+                        code.mov(rcx, SIZE_MAX % knownRegisters);
+                        code.cmove(PR, rcx);
+                    }
+                }
                 break;
             }
             case RES: {
                 // P = 0;
-                code_.xor_(P, P); // set to 0
-                code_.xor_(PI, PI); // set to 0
-                code_.xor_(PR, PR); // set to 0
+                code.xor_(P, P); // set to 0
+                code.xor_(PI, PI); // set to 0
+                code.xor_(PR, PR); // set to 0
                 break;
             }
             case SET: {
                 // A = _constants[_counter++ % _constantsLength];
-                // WARNING!!! ONLY ODD NUMBER OF VARIABLES CAN BE ON THE STACK
-                code_.push(P);           // save the P register, we'll use it
-                if (stackSize % 2 == 0) {
-#ifdef _WIN64
-                    code_.sub(rsp, 32);  // windows shadow space
-#endif
-                    code_.mov(rax, constants);
-                    code_.call(rax);     // call constants
-#ifdef _WIN64
-                    code_.add(rsp, 32);
-#endif
-                } else {
-#ifdef _WIN64
-                    code_.sub(rsp, 40);  // windows shadow space and stack alignment
-#else
-                    code_.sub(rsp, 8);   // stack alignment
-#endif
-                    code_.mov(rax, constants);
-                    code_.call(rax);     // call constants
-#ifdef _WIN64
-                    code_.add(rsp, 40);
-#else
-                    code_.add(rsp, 8);
-#endif
-                }
-
-                code_.pop(P); // restore the P register
+                code.mov(rax, constants);
+                callRax();  // call constants
                 break;
             }
-            case FOR: {
-                instructionStack.push_back(FOR);  // notify END about the instruction
-                Xbyak::Label end;
-                endLabelStack.push_back(end);     // create end label
-                Xbyak::Label start;
-                startLabelStack.push_back(start); // create start label
-                // prepare the for loop
-                code_.push(P);           // save P to stack
-                stackSize++;             // increment stack size
-                code_.add(dynamicStackSize, 1);
-                code_.xor_(P, P);        // P = 0
-                // we assume the inputLength is >= 1
-                // that means the for loop will execute al least once
-                // we don't have to check the condition the first time
-                // loop start
-                code_.L(startLabelStack.back());
-                // move process time forward
-//                code_.mov(rax, processTime);        // make a copy in rax
-//                code_.add(rax, processTimeCounter); // add the amount of instructions
-//                code_.mov(processTime, rax);        // save to process time
-//                code_.cmp(rax, maxProcessTime);
-//                code_.ja(endProgram, Xbyak::CodeGenerator::LabelType::T_NEAR); // long jump to end
-//                processTimeCounter = 0;
-                break;
-            }
-            case LOP_A: {
-                instructionStack.push_back(LOP_A); // notify END about the instruction
-                Xbyak::Label end;
-                endLabelStack.push_back(end);      // create end label
-                Xbyak::Label start;
-                startLabelStack.push_back(start);  // create start label
-                // condition is at the end
-                code_.jmp(endLabelStack.back(), Xbyak::CodeGenerator::LabelType::T_NEAR); // long jump to the end
-                // loop start
-                code_.L(startLabelStack.back());
-                // move process time forward
-//                code_.mov(rax, processTime);        // make a copy in rax
-//                code_.add(rax, processTimeCounter); // add the amount of instructions
-//                code_.mov(processTime, rax);        // save to process time
-//                code_.cmp(rax, maxProcessTime);
-//                code_.ja(endProgram, Xbyak::CodeGenerator::LabelType::T_NEAR); // long jump to end
-//                processTimeCounter = 0;
-                break;
-            }
-            case LOP_P: {
-                instructionStack.push_back(LOP_P); // notify END about the instruction
-                Xbyak::Label end;
-                endLabelStack.push_back(end);      // create end label
-                Xbyak::Label start;
-                startLabelStack.push_back(start);  // create start label
-                // condition is at the end
-                code_.jmp(endLabelStack.back(), Xbyak::CodeGenerator::LabelType::T_NEAR); // long jump to the end
-                // loop start
-                code_.L(startLabelStack.back());
-                // move process time forward
-//                code_.mov(rax, processTime);        // make a copy in rax
-//                code_.add(rax, processTimeCounter); // add the amount of instructions
-//                code_.mov(processTime, rax);        // save to process time
-//                code_.cmp(rax, maxProcessTime);
-//                code_.ja(endProgram, Xbyak::CodeGenerator::LabelType::T_NEAR); // long jump to end
-//                processTimeCounter = 0;
+            case RNG: {
+                // A = rng();
+                code.mov(rax, rng);
+                callRax();  // call rng
+                break;
+            }
+            case EMPTY_JMP_I:
+            case EMPTY_JMP_R:
+            case EMPTY_JMP_P: {
+                // the block only takes time when it isn't skipped
+                Xbyak::Label skip;
+                if (instruction.opcode == EMPTY_JMP_P) {
+                    convertP(xmm1);       // xmm1 = (double) P
+                    code.comisd(xmm1, A); // compare xmm1 and A
+                } else {
+                    if (instruction.opcode == EMPTY_JMP_I) {
+                        code.movsd(xmm1, ptr[inputs + PI * 8]);    // xmm1 = I[P % length]
+                    } else {
+                        code.movsd(xmm1, ptr[registers + PR * 8]); // xmm1 = R[P % length]
+                    }
+                    code.comisd(A, xmm1); // compare A and xmm1
+                }
+                code.jae(skip);           // skip if A >= xmm1 or xmm1 >= A for JMP_P
+                code.add(processTime, instruction.bodyCost);
+                code.L(skip);
                 break;
             }
-            case JMP_I: {
-                instructionStack.push_back(JMP_I);  // notify END about the instruction
-                Xbyak::Label end;
-                endLabelStack.push_back(end);    // create end label
-                code_.movsd(xmm1, ptr[inputs + PI * 8]); // xmm1 = I[P % length]
-                code_.comisd(A, xmm1);           // compare A and xmm1
-                code_.jnb(endLabelStack.back(), Xbyak::CodeGenerator::LabelType::T_NEAR); // long jump if A >= xmm1
+            default: {
+                // unknown opcode, only takes time
                 break;
             }
-            case JMP_R: {
-                instructionStack.push_back(JMP_R);  // notify END about the instruction
-                Xbyak::Label end;
-                endLabelStack.push_back(end);    // create end label
-                code_.movsd(xmm1, ptr[registers + PR * 8]); // xmm1 = R[P % length]
-                code_.comisd(A, xmm1);           // compare A and xmm1
-                code_.jnb(endLabelStack.back(), Xbyak::CodeGenerator::LabelType::T_NEAR); // long jump if A >= xmm1
-                break;
+        }
+    };
+
+    // emits the whole program, either the fast or the checked copy
+    auto emitProgram = [&](bool checked) {
+        std::vector<Xbyak::Label>& body = checked ? checkedBody : fastBody;
+        std::vector<Xbyak::Label>& after = checked ? checkedAfter : fastAfter;
+        // increase process time and check if it's the end
+        auto countInstruction = [&](uint32_t cost) {
+            code.add(processTime, cost);
+            code.cmp(processTime, maxProcessTime);
+            code.ja(endProgram, Xbyak::CodeGenerator::LabelType::T_NEAR); // long jump to end
+        };
+        // jump back to the body of the loop at index o
+        auto loopBack = [&](size_t o) {
+            if (!checked) {
+                code.lea(rax, ptr[processTime + remainingCost[o + 1]]);
+                code.cmp(rax, maxProcessTime);
+                code.ja(checkedBody[o], Xbyak::CodeGenerator::LabelType::T_NEAR); // continue in the checked copy
+            }
+            code.jmp(body[o], Xbyak::CodeGenerator::LabelType::T_NEAR);
+        };
+
+        for (size_t i = 0; i < length; i++) {
+            const IrInstruction& instruction = program[i];
+            const uint8_t opcode = instruction.opcode;
+            if (!checked && GAsmIR::isBlockStart(program, i)) {
+                code.add(processTime, GAsmIR::blockCost(program, i)); // charge the whole block
             }
-            case JMP_P: {
-                instructionStack.push_back(JMP_P);  // notify END about the instruction
-                Xbyak::Label end;
-                endLabelStack.push_back(end);    // create end label
-                code_.cvtsi2sd(xmm1, P);         // xmm1 = (double) P
-                code_.comisd(xmm1, A);           // compare xmm1 and A
-                code_.jnb(endLabelStack.back(), Xbyak::CodeGenerator::LabelType::T_NEAR); // long jump if xmm1 >= A
-                break;
+            if (checked && GAsmIR::endsStraightLine(opcode)) {
+                countInstruction(instruction.cost); // conditions don't change anything, count before jumping
             }
-            case END: {
-                // assign label if there is one, else do nothing
-                if (!endLabelStack.empty()) {
-                    switch (instructionStack.back()) {
+
+            if (GAsmParser::isStructural(opcode)) {
+                switch (opcode) {
+                    case FOR: {
+                        // P = 0, the loop keeps its own counter
+                        code.xor_(P, P);
+                        code.xor_(PI, PI);
+                        code.xor_(PR, PR);
+                        code.mov(forCounter(blocks.forSlot[i]), P);
+                        code.mov(forCounterPR(blocks.forSlot[i]), P);
+                        // we assume the inputLength is >= 1
+                        // that means the for loop will execute al least once
+                        break;
+                    }
+                    case LOP_A: {
+                        code.movsd(xmm1, ptr[inputs + PI * 8]); // xmm1 = I[P % length]
+                        code.comisd(xmm1, A);                   // compare xmm1 and A
+                        code.jbe(after[i], Xbyak::CodeGenerator::LabelType::T_NEAR); // skip unless A < xmm1
+                        break;
+                    }
+                    case LOP_P: {
+                        emitCompareLength(P, knownInputs, inputLength); // compare P and input length
+                        code.jae(after[i], Xbyak::CodeGenerator::LabelType::T_NEAR); // skip unless P < inputLength
+                        break;
+                    }
+                    case JMP_I: {
+                        code.movsd(xmm1, ptr[inputs + PI * 8]); // xmm1 = I[P % length]
+                        code.comisd(A, xmm1);                   // compare A and xmm1
+                        code.jae(after[i], Xbyak::CodeGenerator::LabelType::T_NEAR); // skip if A >= xmm1
+                        break;
+                    }
+                    case JMP_R: {
+                        code.movsd(xmm1, ptr[registers + PR * 8]); // xmm1 = R[P % length]
+                        code.comisd(A, xmm1);                      // compare A and xmm1
+                        code.jae(after[i], Xbyak::CodeGenerator::LabelType::T_NEAR); // skip if A >= xmm1
+                        break;
+                    }
+                    case JMP_P: {
+                        convertP(xmm1);       // xmm1 = (double) P
+                        code.comisd(xmm1, A); // compare xmm1 and A
+                        code.jae(after[i], Xbyak::CodeGenerator::LabelType::T_NEAR); // skip if xmm1 >= A
+                        break;
+                    }
+                    default: {
+                        break;
+                    }
+                }
+                code.L(body[i]);
+            } else if (opcode == END) {
+                // END without a block does nothing
+                if (blocks.match[i] < length) {
+                    const size_t o = blocks.match[i];
+                    const size_t slot = blocks.forSlot[i];
+                    switch (program[o].opcode) {
                         case FOR: {
-                            code_.L(endLabelStack.back()); // bind the end label
-                            code_.add(P, 1);               // increment P
-                            code_.cmp(P, inputLength);     // compare with length
-                            code_.jnge(startLabelStack.back(), Xbyak::CodeGenerator::LabelType::T_NEAR); // long jump if P < length
-                            // end loop
-                            code_.pop(P);            // restore P
-                            stackSize--;             // decrement stack size
-                            code_.sub(dynamicStackSize, 1);
-                            // pop all the stacks
-                            instructionStack.pop_back();
-                            endLabelStack.pop_back();
-                            startLabelStack.pop_back();
+                            // P = ++counter
+                            code.mov(rax, forCounter(slot));
+                            code.add(rax, 1);
+                            code.mov(forCounter(slot), rax);
+                            code.mov(P, rax);
+                            emitCompareLength(rax, knownInputs, inputLength); // compare with length
+                            Xbyak::Label endLoop;
+                            code.jae(endLoop, Xbyak::CodeGenerator::LabelType::T_NEAR); // end if P >= length
+                            code.mov(PI, rax);          // P < inputLength
+                            code.mov(rcx, forCounterPR(slot));
+                            code.add(rcx, 1);
+                            code.xor_(edx, edx);
+                            emitCompareLength(rcx, knownRegisters, registerLength);
+                            code.cmove(rcx, rdx);       // set to 0 if equal length
+                            code.mov(forCounterPR(slot), rcx);
+                            code.mov(PR, rcx);
+                            loopBack(o);
+                            // end loop, P == inputLength
+                            code.L(endLoop);
+                            code.xor_(PI, PI);
+                            if (knownInputs != 0 && knownRegisters != 0) {
+                                code.mov(PR, knownInputs % knownRegisters);
+                            } else {
+                                code.mov(PR, loopEndPR);
+                            }
                             break;
                         }
                         case LOP_A: {
-                            code_.L(endLabelStack.back());     // bind the end label
-                            code_.movsd(xmm1, ptr[inputs + PI * 8]); // xmm1 = I[P % length]
-                            code_.comisd(A, xmm1);             // compare A and xmm1
-                            code_.jg(startLabelStack.back(), Xbyak::CodeGenerator::LabelType::T_NEAR); // long jump if A < xmm1
-                            // end loop, pop all the stacks
-                            instructionStack.pop_back();
-                            endLabelStack.pop_back();
-                            startLabelStack.pop_back();
+                            code.movsd(xmm1, ptr[inputs + PI * 8]); // xmm1 = I[P % length]
+                            code.comisd(xmm1, A);                   // compare xmm1 and A
+                            code.jbe(after[o], Xbyak::CodeGenerator::LabelType::T_NEAR); // end unless A < xmm1
+                            loopBack(o);
                             break;
                         }
                         case LOP_P: {
-                            code_.L(endLabelStack.back());     // bind the end label
-                            code_.mov(rax, P);                 // save P to rax
-                            code_.cmp(rax, inputLength);       // compare P and input length
-                            code_.jg(startLabelStack.back(), Xbyak::CodeGenerator::LabelType::T_NEAR); // long jump if P < inputLength
-                            // end loop, pop all the stacks
-                            instructionStack.pop_back();
-                            endLabelStack.pop_back();
-                            startLabelStack.pop_back();
+                            emitCompareLength(P, knownInputs, inputLength); // compare P and input length
+                            code.jae(after[o], Xbyak::CodeGenerator::LabelType::T_NEAR); // end unless P < inputLength
+                            loopBack(o);
                             break;
                         }
                         default: {
                             // this case is for JMP_I, JMP_R, JMP_P
-                            code_.L(endLabelStack.back()); // bind the end label
-                            // pop end and instruction stacks
-                            instructionStack.pop_back();
-                            endLabelStack.pop_back();
+                            break;
                         }
                     }
+                    code.L(after[o]); // bind the end label
                 }
-                break;
-            }
-            case RNG: {
-                // A = rng();
-                // WARNING!!! ONLY ODD NUMBER OF VARIABLES CAN BE ON THE STACK
-                code_.push(P);           // save the P register, we'll use it
-                if (stackSize % 2 == 0) {
-#ifdef _WIN64
-                    code_.sub(rsp, 32);  // windows shadow space
-#endif
-                    code_.mov(rax, rng);
-                    code_.call(rax);     // call rng
-#ifdef _WIN64
-                    code_.add(rsp, 32);
-#endif
-                } else {
-#ifdef _WIN64
-                    code_.sub(rsp, 40);  // windows shadow space and stack alignment
-#else
-                    code_.sub(rsp, 8);   // stack alignment
-#endif
-                    code_.mov(rax, rng);
-                    code_.call(rax);     // call rng
-#ifdef _WIN64
-                    code_.add(rsp, 40);
-#else
-                    code_.add(rsp, 8);
-#endif
+            } else if (checked) {
+                if (instruction.cost > 1) {
+                    countInstruction(instruction.cost - 1); // instructions folded into this one
                 }
-
-                code_.pop(P); // restore the P register
-            }
-            default: {
-                break;
+                emitInstruction(instruction);
+                countInstruction(1);
+            } else {
+                emitInstruction(instruction);
             }
         }
-        // increase process time and check if it's the end
-        code_.mov(rax, processTime); // make a copy in rax
-        code_.add(rax, 1);           // add 1
-        code_.mov(processTime, rax); // save to process time
-        code_.cmp(rax, maxProcessTime);
-        code_.ja(endProgram, Xbyak::CodeGenerator::LabelType::T_NEAR); // long jump to end
-        // TODO make it faster, do it every 10 times and on loop entry TESTING
-//        processTimeCounter++;
-//        if (processTimeCounter == spaceBetweenProcessTime) {
-//            code_.mov(rax, processTime);             // make a copy in rax
-//            code_.add(rax, spaceBetweenProcessTime); // add step amount
-//            code_.mov(processTime, rax);             // save to process time
-//            code_.cmp(rax, maxProcessTime);
-//            code_.ja(endProgram, Xbyak::CodeGenerator::LabelType::T_NEAR); // long jump to end
-//            processTimeCounter = 0;
-//        }
-    }
-    // put unused labels at the end
-    while (!endLabelStack.empty()) {
-        switch (instructionStack.back()) {
-            case FOR: {
-                code_.L(endLabelStack.back()); // bind the end label
-                code_.add(P, 1);               // increment P
-                code_.cmp(P, inputLength);     // compare with length
-                code_.jnge(startLabelStack.back(), Xbyak::CodeGenerator::LabelType::T_NEAR); // long jump if P < length
-                // end loop
-                code_.pop(P);            // restore P
-                stackSize--;             // decrement stack size
-                code_.sub(dynamicStackSize, 1);
-                // pop all the stacks
-                instructionStack.pop_back();
-                endLabelStack.pop_back();
-                startLabelStack.pop_back();
-                break;
-            }
-            case LOP_A: {
-                code_.L(endLabelStack.back());     // bind the end label
-                code_.movsd(xmm1, ptr[inputs + PI * 8]); // xmm1 = I[P % length]
-                code_.comisd(A, xmm1);             // compare A and xmm1
-                code_.jnle(startLabelStack.back(), Xbyak::CodeGenerator::LabelType::T_NEAR); // long jump if A <= xmm1
-                // end loop, pop all the stacks
-                instructionStack.pop_back();
-                endLabelStack.pop_back();
-                startLabelStack.pop_back();
-                break;
-            }
-            case LOP_P: {
-                code_.L(endLabelStack.back());     // bind the end label
-                code_.mov(rax, P);                 // save P to rax
-                code_.cmp(rax, inputLength);       // compare P and input length
-                code_.jng(startLabelStack.back(), Xbyak::CodeGenerator::LabelType::T_NEAR); // long jump if P <= inputLength
-                // end loop, pop all the stacks
-                instructionStack.pop_back();
-                endLabelStack.pop_back();
-                startLabelStack.pop_back();
-                break;
-            }
-            default: {
-                // this case is for JMP_I, JMP_R, JMP_P
-                code_.L(endLabelStack.back()); // bind the end label
-                // pop end and instruction stacks
-                instructionStack.pop_back();
-                endLabelStack.pop_back();
+        // blocks without END skip to the end of the program
+        for (size_t i = 0; i < length; i++) {
+            if (GAsmParser::isStructural(program[i].opcode) && blocks.match[i] == length) {
+                code.L(after[i]);
             }
         }
-    }
+    };
+
+    // --- COMPILATION ---
+    emitProgram(false);
+
     // end of the program
-    code_.L(endProgram);
-    code_.mov(rax, dynamicStackSize); // prepare for stack restoration
-    code_.shl(rax, 3);                // * 8, move stack by 8 for every push
-    code_.add(rsp, rax);              // pop from stack
-    code_.mov(rax, processTime); // return process time
-//    code_.add(rax, spaceBetweenProcessTime - processTimeCounter - 1); // add remaining process time
-    code_.add(rsp, LOCALS); // restore stack of locals
+    code.L(endProgram);
+    // folded instructions can go past the budget at once
+    Xbyak::Label inBudget;
+    code.cmp(processTime, maxProcessTime);
+    code.jbe(inBudget);
+    code.mov(processTime, maxProcessTime);
+    code.add(processTime, 1);
+    code.L(inBudget);
+    code.mov(rcx, processTimes);
+    code.mov(qword[rcx], processTime); // *processTimes = processTime
+    code.add(rcx, 8);                  // processTimes++
+    code.mov(processTimes, rcx);
+    code.add(totalTime, processTime);  // totalTime += processTime
+    // move to the next case
+    code.add(inputs, caseStride);
+    code.sub(caseCount, 1);
+    code.jnz(nextCase, Xbyak::CodeGenerator::LabelType::T_NEAR); // long jump if there are cases left
+
+    // end of all the cases
+    code.L(endCases);
+    code.mov(rax, totalTime); // return the sum of process times
+    code.add(rsp, locals); // restore stack of locals
     // restore the caller's stack
-    code_.pop(r15);
-    code_.pop(r14);
-    code_.pop(r13);
-    code_.pop(r12);
-    code_.pop(rbx);
-    code_.pop(rbp);
-    code_.ret();    // return from function
-
-    // finalize and get function pointer
-    code_.ready();
-    return code_.getCode<run_fn_t>();
+    code.pop(r15);
+    code.pop(r14);
+    code.pop(r13);
+    code.pop(r12);
+    code.pop(rbx);
+    code.pop(rbp);
+    code.ret();    // return from function
+
+    // the checked copy is only entered close to the budget, keep it out of the way
+    code.L(checkedStart);
+    emitProgram(true);
+    code.jmp(endProgram, Xbyak::CodeGenerator::LabelType::T_NEAR);
+
+    if (!constantPool.empty()) {
+        code.align(8);
+        code.L(mathConstants);
+        for (uint64_t bits : constantPool) {
+            code.dq(bits);
+        }
+    }
+
+    // the case-parallel entry is a separate function in the same buffer
+    const bool lanes = caseParallel && lanesSupported(program);
+    size_t lanesOffset = lanes ? generateLanes(code, program, shape, mathMode) : 0;
+
+    // resolve the labels, every jump and constant is relative so the code can be moved
+    code.ready(Xbyak::CodeGenerator::PROTECT_RW);
+    compiled->code = JitArena::global().allocate(code.getCode(), code.getSize());
+    const uint8_t* entry = compiled->code.getCode();
+    compiled->run = (run_fn_t)entry;
+    compiled->runBatch = (batch_fn_t)(entry + batchOffset);
+    if (lanes) {
+        compiled->runLanes = (lanes_fn_t)(entry + lanesOffset);
+    }
+    compiled->size = compiled->code.getSize();
+    return compiled;
 }
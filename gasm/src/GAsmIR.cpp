@@ -0,0 +1,425 @@
+//
+// Lowering of the bytecode and the optimization passes over it
+//
+
+#include <algorithm>
+#include "GAsmIR.h"
+
+static bool isEmptyJump(uint8_t opcode) {
+    return EMPTY_JMP_I <= opcode && opcode <= EMPTY_JMP_P;
+}
+
+static bool readsA(uint8_t opcode) {
+    switch (opcode) {
+        case MOV_P_A: case MOV_R_A: case MOV_I_A:
+        case ADD_R: case SUB_R: case DIV_R: case MUL_R:
+        case ADD_I: case SUB_I: case DIV_I: case MUL_I:
+            return true;
+        default:
+            return isEmptyJump(opcode) || GAsmIR::endsStraightLine(opcode);
+    }
+}
+
+static bool writesA(uint8_t opcode) {
+    switch (opcode) {
+        case MOV_A_P: case MOV_A_R: case MOV_A_I:
+        case ADD_R: case SUB_R: case DIV_R: case MUL_R: case SIN_R: case COS_R: case EXP_R:
+        case ADD_I: case SUB_I: case DIV_I: case MUL_I: case SIN_I: case COS_I: case EXP_I:
+        case SET: case RNG:
+            return true;
+        default:
+            return false;
+    }
+}
+
+static bool writesP(uint8_t opcode) {
+    return opcode == INC || opcode == DEC || opcode == RES || opcode == MOV_P_A;
+}
+
+static bool readsP(uint8_t opcode) {
+    switch (opcode) {
+        case MOV_A_P: case MOV_A_R: case MOV_A_I: case MOV_R_A: case MOV_I_A:
+        case ADD_R: case SUB_R: case DIV_R: case MUL_R: case SIN_R: case COS_R: case EXP_R:
+        case ADD_I: case SUB_I: case DIV_I: case MUL_I: case SIN_I: case COS_I: case EXP_I:
+        case INC: case DEC:
+            return true;
+        default:
+            return isEmptyJump(opcode) || GAsmIR::endsStraightLine(opcode);
+    }
+}
+
+// removed instructions are marked with cost 0 until the pass compacts the program
+static size_t nextLive(const std::vector<IrInstruction>& ir, size_t k) {
+    do {
+        k++;
+    } while (k < ir.size() && ir[k].cost == 0);
+    return k;
+}
+
+// folds instruction k into the next one, which always runs right after it,
+// the last instruction has nothing to fold into and stays
+static bool drop(std::vector<IrInstruction>& ir, size_t k) {
+    size_t next = nextLive(ir, k);
+    if (next >= ir.size()) {
+        return false;
+    }
+    ir[next].cost += ir[k].cost;
+    ir[k].cost = 0;
+    return true;
+}
+
+static void compact(std::vector<IrInstruction>& ir) {
+    ir.erase(std::remove_if(ir.begin(), ir.end(), [](const IrInstruction& instruction) {
+        return instruction.cost == 0; }), ir.end());
+}
+
+bool GAsmIR::eliminateDeadAccumulator(std::vector<IrInstruction>& ir) {
+    bool changed = false;
+    bool aLive = false;  // A is not an output, nothing reads it after the program
+    for (size_t k = ir.size(); k-- > 0;) {
+        uint8_t opcode = ir[k].opcode;
+        if (writesA(opcode)) {
+            // SET and RNG move their generators, they have to stay
+            if (!aLive && opcode != SET && opcode != RNG && drop(ir, k)) {
+                changed = true;
+                continue;
+            }
+            aLive = readsA(opcode);
+        } else if (readsA(opcode)) {
+            aLive = true;  // jumps count as reads of everything
+        }
+    }
+    compact(ir);
+    return changed;
+}
+
+bool GAsmIR::foldPointer(std::vector<IrInstruction>& ir, IrScratch& scratch) {
+    bool changed = false;
+    // INC DEC and DEC INC cancel out, P wraps around the same way in both directions
+    std::vector<size_t>& pending = scratch.pending;  // INC and DEC right before the current instruction
+    pending.clear();
+    for (size_t k = 0; k < ir.size(); k++) {
+        uint8_t opcode = ir[k].opcode;
+        if (opcode != INC && opcode != DEC) {
+            pending.clear();
+        } else if (!pending.empty() && ir[pending.back()].opcode != opcode && nextLive(ir, k) < ir.size()) {
+            drop(ir, pending.back());
+            drop(ir, k);
+            pending.pop_back();
+            changed = true;
+        } else {
+            pending.push_back(k);
+        }
+    }
+    compact(ir);
+    // writes to P overwritten before any read
+    bool pLive = false;  // P is not an output
+    for (size_t k = ir.size(); k-- > 0;) {
+        uint8_t opcode = ir[k].opcode;
+        if (writesP(opcode)) {
+            if (!pLive && drop(ir, k)) {
+                changed = true;
+                continue;
+            }
+            pLive = readsP(opcode);
+        } else if (readsP(opcode)) {
+            pLive = true;
+        }
+    }
+    compact(ir);
+    return changed;
+}
+
+bool GAsmIR::eliminateRedundantLoads(std::vector<IrInstruction>& ir) {
+    bool changed = false;
+    // A holds the same bits as I[P] or R[P]
+    bool aIsI = false;
+    bool aIsR = false;
+    for (size_t k = 0; k < ir.size(); k++) {
+        uint8_t opcode = ir[k].opcode;
+        if (endsStraightLine(opcode)) {
+            aIsI = false;
+            aIsR = false;
+        } else if (opcode == MOV_A_I || opcode == MOV_I_A) {
+            if (aIsI && drop(ir, k)) {
+                changed = true;
+                continue;
+            }
+            aIsR = aIsR && opcode == MOV_I_A;  // loading into A changes A
+            aIsI = true;
+        } else if (opcode == MOV_A_R || opcode == MOV_R_A) {
+            if (aIsR && drop(ir, k)) {
+                changed = true;
+                continue;
+            }
+            aIsI = aIsI && opcode == MOV_R_A;
+            aIsR = true;
+        } else if (writesA(opcode) || writesP(opcode)) {
+            aIsI = false;
+            aIsR = false;
+        }
+    }
+    compact(ir);
+    return changed;
+}
+
+bool GAsmIR::removeEmptyBlocks(std::vector<IrInstruction>& ir) {
+    bool changed = false;
+    for (size_t k = 0; k + 1 < ir.size(); k++) {
+        uint8_t opcode = ir[k].opcode;
+        // an END right after the JMP always closes it
+        if (JMP_I <= opcode && opcode <= JMP_P && ir[k + 1].opcode == END) {
+            ir[k].opcode = EMPTY_JMP_I + (opcode - JMP_I);
+            ir[k].bodyCost = ir[k + 1].cost;
+            ir[k + 1].cost = 0;
+            k++;
+            changed = true;
+        }
+    }
+    compact(ir);
+    return changed;
+}
+
+// what the liveness analysis tracks, P can point anywhere in the inputs and registers
+// so they are tracked as whole arrays and a store never overwrites all of them
+enum : uint8_t { LIVE_A = 1, LIVE_P = 2, LIVE_I = 4, LIVE_R = 8 };
+
+struct Effect {
+    uint8_t uses = 0;
+    uint8_t defines = 0;
+    uint8_t kills = 0;    // defines that overwrite the whole value
+    bool always = false;  // changes the control flow or the generators, always effective
+};
+
+static bool isLoop(uint8_t opcode) {
+    return FOR <= opcode && opcode <= LOP_P;
+}
+
+static bool isJump(uint8_t opcode) {
+    return JMP_I <= opcode && opcode <= JMP_P;
+}
+
+// opener is the opcode of the block closed by an END, END for a stray one
+static Effect effectOf(uint8_t opcode, uint8_t opener) {
+    switch (opcode) {
+        case MOV_P_A: return {LIVE_A, LIVE_P, LIVE_P};
+        case MOV_A_P: return {LIVE_P, LIVE_A, LIVE_A};
+        case MOV_A_R: return {LIVE_P | LIVE_R, LIVE_A, LIVE_A};
+        case MOV_A_I: return {LIVE_P | LIVE_I, LIVE_A, LIVE_A};
+        case MOV_R_A: return {LIVE_A | LIVE_P, LIVE_R};
+        case MOV_I_A: return {LIVE_A | LIVE_P, LIVE_I};
+        case ADD_R: case SUB_R: case DIV_R: case MUL_R:
+            return {LIVE_A | LIVE_P | LIVE_R, LIVE_A, LIVE_A};
+        case SIN_R: case COS_R: case EXP_R:
+            return {LIVE_P | LIVE_R, LIVE_A, LIVE_A};
+        case ADD_I: case SUB_I: case DIV_I: case MUL_I:
+            return {LIVE_A | LIVE_P | LIVE_I, LIVE_A, LIVE_A};
+        case SIN_I: case COS_I: case EXP_I:
+            return {LIVE_P | LIVE_I, LIVE_A, LIVE_A};
+        case INC: case DEC: return {LIVE_P, LIVE_P, LIVE_P};
+        case RES: return {0, LIVE_P, LIVE_P};
+        case SET: case RNG: return {0, LIVE_A, LIVE_A, true};
+        case FOR: return {0, LIVE_P, LIVE_P, true};
+        case LOP_A: case JMP_I: case EMPTY_JMP_I: return {LIVE_A | LIVE_P | LIVE_I, 0, 0, true};
+        case JMP_R: case EMPTY_JMP_R: return {LIVE_A | LIVE_P | LIVE_R, 0, 0, true};
+        case JMP_P: case EMPTY_JMP_P: return {LIVE_A | LIVE_P, 0, 0, true};
+        case LOP_P: return {LIVE_P, 0, 0, true};
+        case END:
+            // END of a loop checks its condition again, END of FOR sets P to the counter
+            return opener == FOR || opener == LOP_A || opener == LOP_P
+                   ? effectOf(opener, END) : Effect{0, 0, 0, true};
+        default:
+            return {};  // unknown opcodes do nothing
+    }
+}
+
+template<typename OpcodeOf>
+static const IrBlocks& matchOpcodes(size_t n, OpcodeOf opcodeOf, IrScratch& scratch) {
+    IrBlocks& blocks = scratch.blocks;
+    blocks.match.assign(n, n);
+    blocks.depth.assign(n, 0);
+    blocks.forSlot.assign(n, 0);
+    blocks.maxDepth = 0;
+    blocks.forSlots = 0;
+    std::vector<size_t>& open = scratch.open;
+    open.clear();
+    size_t openFors = 0;
+    for (size_t i = 0; i < n; i++) {
+        const uint8_t opcode = opcodeOf(i);
+        if (GAsmParser::isStructural(opcode)) {
+            blocks.depth[i] = open.size();
+            open.push_back(i);
+            blocks.maxDepth = std::max(blocks.maxDepth, open.size());
+            if (opcode == FOR) {
+                blocks.forSlot[i] = openFors++;
+                blocks.forSlots = std::max(blocks.forSlots, openFors);
+            }
+        } else if (opcode == END && !open.empty()) {
+            const size_t o = open.back();
+            open.pop_back();
+            if (opcodeOf(o) == FOR) {
+                openFors--;
+            }
+            blocks.match[o] = i;
+            blocks.match[i] = o;
+            blocks.depth[i] = blocks.depth[o];
+            blocks.forSlot[i] = blocks.forSlot[o];
+        }
+    }
+    return blocks;
+}
+
+const IrBlocks& GAsmIR::matchBlocks(const std::vector<uint8_t>& program, IrScratch& scratch) {
+    return matchOpcodes(program.size(), [&](size_t i) { return program[i]; }, scratch);
+}
+
+const IrBlocks& GAsmIR::matchBlocks(const std::vector<IrInstruction>& ir, IrScratch& scratch) {
+    return matchOpcodes(ir.size(), [&](size_t i) { return ir[i].opcode; }, scratch);
+}
+
+IrBlocks GAsmIR::matchBlocks(const std::vector<uint8_t>& program) {
+    IrScratch scratch;
+    matchBlocks(program, scratch);
+    return std::move(scratch.blocks);
+}
+
+IrBlocks GAsmIR::matchBlocks(const std::vector<IrInstruction>& ir) {
+    IrScratch scratch;
+    matchBlocks(ir, scratch);
+    return std::move(scratch.blocks);
+}
+
+void IrScratch::reserve(size_t length) {
+    blocks.match.reserve(length);
+    blocks.depth.reserve(length);
+    blocks.forSlot.reserve(length);
+    open.reserve(length);
+    pending.reserve(length);
+    opcodes.reserve(length);
+    liveIn.reserve(length + 1);
+    effective.reserve(length);
+    remaining.reserve(length + 1);
+}
+
+const std::vector<uint8_t>& GAsmIR::effective(const std::vector<uint8_t>& program, IrScratch& scratch) {
+    size_t n = program.size();
+    const std::vector<size_t>& match = matchBlocks(program, scratch).match;
+    // the inputs are the output, A, P and the registers start from zero on every run
+    std::vector<uint8_t>& liveIn = scratch.liveIn;
+    liveIn.assign(n + 1, 0);
+    liveIn[n] = LIVE_I;
+    std::vector<uint8_t>& result = scratch.effective;
+    result.assign(n, 0);
+    // loops feed liveness back to earlier instructions, repeat until it settles
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (size_t i = n; i-- > 0;) {
+            uint8_t opcode = program[i];
+            uint8_t liveOut = liveIn[i + 1];
+            if (opcode == LOP_A || opcode == LOP_P || isJump(opcode)) {
+                // a skipped block continues after its END, an unclosed one ends the program
+                liveOut |= liveIn[match[i] < n ? match[i] + 1 : n];
+            } else if (opcode == END && match[i] < n && isLoop(program[match[i]])) {
+                liveOut |= liveIn[match[i] + 1];
+            }
+            const Effect effect = effectOf(opcode, opcode == END && match[i] < n ? program[match[i]] : END);
+            result[i] = effect.always || (effect.defines & liveOut) != 0;
+            // introns read nothing, what they read is not needed because of them
+            uint8_t in = result[i] ? (uint8_t)((liveOut & ~effect.kills) | effect.uses) : liveOut;
+            if (in != liveIn[i]) {
+                liveIn[i] = in;
+                changed = true;
+            }
+        }
+    }
+    return result;
+}
+
+std::vector<bool> GAsmIR::effective(const std::vector<uint8_t>& program) {
+    IrScratch scratch;
+    const std::vector<uint8_t>& result = effective(program, scratch);
+    return {result.begin(), result.end()};
+}
+
+bool GAsmIR::eliminateIntrons(std::vector<IrInstruction>& ir, IrScratch& scratch) {
+    std::vector<uint8_t>& program = scratch.opcodes;
+    program.resize(ir.size());
+    std::transform(ir.begin(), ir.end(), program.begin(), [](const IrInstruction& instruction) {
+        return instruction.opcode; });
+    const std::vector<uint8_t>& keep = effective(program, scratch);
+    bool changed = false;
+    for (size_t k = 0; k < ir.size(); k++) {
+        // nothing jumps between an intron and the next instruction, blocks start after a kept one
+        if (!keep[k] && drop(ir, k)) {
+            changed = true;
+        }
+    }
+    compact(ir);
+    return changed;
+}
+
+void GAsmIR::lower(const std::vector<uint8_t>& program, const IrPasses& passes, std::vector<IrInstruction>& ir,
+                   IrScratch& scratch) {
+    ir.clear();
+    for (uint8_t opcode : program) {
+        ir.push_back({opcode});
+    }
+    // every pass can enable the others, run them until nothing changes
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        if (passes.effectiveCode) {
+            changed = eliminateIntrons(ir, scratch) || changed;
+        }
+        if (passes.pointerFolding) {
+            changed = foldPointer(ir, scratch) || changed;
+        }
+        if (passes.deadAccumulator) {
+            changed = eliminateDeadAccumulator(ir) || changed;
+        }
+        if (passes.redundantLoads) {
+            changed = eliminateRedundantLoads(ir) || changed;
+        }
+        if (passes.emptyBlocks) {
+            changed = removeEmptyBlocks(ir) || changed;
+        }
+    }
+}
+
+void GAsmIR::lower(const std::vector<uint8_t>& program, const IrPasses& passes, std::vector<IrInstruction>& ir) {
+    IrScratch scratch;
+    lower(program, passes, ir, scratch);
+}
+
+std::vector<IrInstruction> GAsmIR::lower(const std::vector<uint8_t>& program, const IrPasses& passes) {
+    std::vector<IrInstruction> ir;
+    lower(program, passes, ir);
+    return ir;
+}
+
+uint64_t GAsmIR::blockCost(const std::vector<IrInstruction>& ir, size_t i) {
+    uint64_t cost = 0;
+    for (size_t j = i; j < ir.size(); j++) {
+        cost += ir[j].cost;
+        if (endsStraightLine(ir[j].opcode)) {
+            break;
+        }
+    }
+    return cost;
+}
+
+const std::vector<uint64_t>& GAsmIR::remainingCost(const std::vector<IrInstruction>& ir, IrScratch& scratch) {
+    std::vector<uint64_t>& remaining = scratch.remaining;
+    remaining.assign(ir.size() + 1, 0);
+    for (size_t i = ir.size(); i-- > 0;) {
+        remaining[i] = remaining[i + 1] + maxCost(ir[i]);
+    }
+    return remaining;
+}
+
+std::vector<uint64_t> GAsmIR::remainingCost(const std::vector<IrInstruction>& ir) {
+    IrScratch scratch;
+    remainingCost(ir, scratch);
+    return std::move(scratch.remaining);
+}
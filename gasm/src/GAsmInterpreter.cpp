@@ -8,12 +8,13 @@
 #include <iostream>
 #include "GAsmParser.h"
 #include "GAsmInterpreter.h"
+#include "Superinstructions.h"
 
 GAsmInterpreter::GAsmInterpreter(const std::vector<uint8_t>& program, size_t registerLength)
   : program_(&program),
     registers_(registerLength),
     compiled_(nullptr),
-    code_(1, Xbyak::AutoGrow) {
+    compiledBatch_(nullptr) {
     if (registerLength == 0) {
         throw std::invalid_argument("Register length should be greater than 0");
     }
@@ -23,266 +24,1032 @@ GAsmInterpreter::GAsmInterpreter(size_t registerLength)
   : program_(nullptr),
     registers_(registerLength),
     compiled_(nullptr),
-    code_(1, Xbyak::AutoGrow) {
+    compiledBatch_(nullptr) {
     if (registerLength == 0) {
         throw std::invalid_argument("Register length should be greater than 0");
     }
 }
 
+// compiled code is immutable, so copies share it instead of compiling again
 GAsmInterpreter::GAsmInterpreter(const GAsmInterpreter& other)
     : program_(other.program_),
+      passes_(other.passes_),
+      mathMode_(other.mathMode_),
+      caseParallel_(other.caseParallel_),
+      superinstructions_(other.superinstructions_),
+      superinstructionHits_(other.superinstructionHits_.size()),
       registers_(other.registers_.size()),
-      compiled_(nullptr),
-      code_(1, Xbyak::AutoGrow) {
-    if (other.compiled_ != nullptr) {
-        compiled_ = compile();
-    }
+      code_(other.code_),
+      cache_(other.cache_),
+      compiled_(other.compiled_),
+      compiledBatch_(other.compiledBatch_),
+      seenInputLength_(other.seenInputLength_),
+      shapeVaries_(other.shapeVaries_),
+      lanesDiverge_(other.lanesDiverge_),
+      useCompile(other.useCompile),
+      tiered(other.tiered) {
 }
 
 GAsmInterpreter &GAsmInterpreter::operator=(const GAsmInterpreter &other) {
     if (this != &other) {
         program_ = other.program_;
+        irReady_ = false;
+        passes_ = other.passes_;
+        mathMode_ = other.mathMode_;
+        caseParallel_ = other.caseParallel_;
+        superinstructions_ = other.superinstructions_;
+        superinstructionHits_.assign(other.superinstructionHits_.size(), 0);
         registers_ = other.registers_;
-        compiled_ = nullptr;
-        if (other.compiled_ != nullptr) {
-            compiled_ = compile();
-        }
+        code_ = other.code_;
+        cache_ = other.cache_;
+        compiled_ = other.compiled_;
+        compiledBatch_ = other.compiledBatch_;
+        seenInputLength_ = other.seenInputLength_;
+        shapeVaries_ = other.shapeVaries_;
+        lanesDiverge_ = other.lanesDiverge_;
+        useCompile = other.useCompile;
+        tiered = other.tiered;
     }
     return *this;
 }
 
 GAsmInterpreter::GAsmInterpreter(GAsmInterpreter &&other) noexcept {
     program_ = other.program_;
+    ir_ = std::move(other.ir_);
+    irReady_ = other.irReady_;
+    other.irReady_ = false;
+    decoded_ = std::move(other.decoded_);
+    decodedReady_ = other.decodedReady_;
+    threaded_ = other.threaded_;
+    forSlots_ = other.forSlots_;
+    forCounters_ = std::move(other.forCounters_);
+    caseMasks_ = std::move(other.caseMasks_);
+    casesInLanes_ = other.casesInLanes_;
+    entryLimit_ = other.entryLimit_;
+    other.decodedReady_ = false;
+    passes_ = other.passes_;
+    mathMode_ = other.mathMode_;
+    caseParallel_ = other.caseParallel_;
+    superinstructions_ = std::move(other.superinstructions_);
+    superinstructionHits_ = std::move(other.superinstructionHits_);
     registers_ = std::move(other.registers_);
-    compiled_ = nullptr;
-    if (other.compiled_ != nullptr) {
-        compiled_ = compile();
-    }
+    code_ = std::move(other.code_);
+    cache_ = std::move(other.cache_);
+    compiled_ = other.compiled_;
+    compiledBatch_ = other.compiledBatch_;
+    seenInputLength_ = other.seenInputLength_;
+    shapeVaries_ = other.shapeVaries_;
+    lanesDiverge_ = other.lanesDiverge_;
+    useCompile = other.useCompile;
+    tiered = other.tiered;
 }
 
 GAsmInterpreter &GAsmInterpreter::operator=(GAsmInterpreter &&other) noexcept {
     if (this != &other) {
         program_ = other.program_;
+        ir_ = std::move(other.ir_);
+        irReady_ = other.irReady_;
+        other.irReady_ = false;
+        decoded_ = std::move(other.decoded_);
+        decodedReady_ = other.decodedReady_;
+        threaded_ = other.threaded_;
+        forSlots_ = other.forSlots_;
+        forCounters_ = std::move(other.forCounters_);
+        caseMasks_ = std::move(other.caseMasks_);
+        casesInLanes_ = other.casesInLanes_;
+        entryLimit_ = other.entryLimit_;
+        other.decodedReady_ = false;
+        passes_ = other.passes_;
+        mathMode_ = other.mathMode_;
+        caseParallel_ = other.caseParallel_;
+        superinstructions_ = std::move(other.superinstructions_);
+        superinstructionHits_ = std::move(other.superinstructionHits_);
         registers_ = std::move(other.registers_);
-        compiled_ = nullptr;
-        if (other.compiled_ != nullptr) {
-            compiled_ = compile();
-        }
+        code_ = std::move(other.code_);
+        cache_ = std::move(other.cache_);
+        compiled_ = other.compiled_;
+        compiledBatch_ = other.compiledBatch_;
+        seenInputLength_ = other.seenInputLength_;
+        shapeVaries_ = other.shapeVaries_;
+        lanesDiverge_ = other.lanesDiverge_;
+        useCompile = other.useCompile;
+        tiered = other.tiered;
     }
     return *this;
 }
 
 void GAsmInterpreter::setProgram(const std::vector<uint8_t>& program) {
     program_ = &program;
+    irReady_ = false;
+    lanesDiverge_ = false;
+    programRuns_ = 0;
+    programCases_ = 0;
+    programTime_ = 0;
+    // the code is compiled (or found in the cache) on the next compiled run
     code_.reset();
     compiled_ = nullptr;
+    compiledBatch_ = nullptr;
+}
+
+void GAsmInterpreter::reserve(size_t programLength) {
+    ir_.reserve(programLength);
+    irScratch_.reserve(programLength);
+    // a CHARGE and a superinstruction in front of every instruction at most, and the HALT
+    decoded_.reserve(3 * programLength + 1);
+    fused_.reserve(programLength);
+    entry_.reserve(programLength + 1);
+    forCounters_.reserve(2 * programLength);
+    caseMasks_.reserve(programLength * caseLanes);
+}
+
+void GAsmInterpreter::setPasses(const IrPasses& passes) {
+    passes_ = passes;
+    irReady_ = false;
+    code_.reset();
+    compiled_ = nullptr;
+    compiledBatch_ = nullptr;
+}
+
+void GAsmInterpreter::setMathMode(MathMode mathMode) {
+    mathMode_ = mathMode;
+    code_.reset();
+    compiled_ = nullptr;
+    compiledBatch_ = nullptr;
+}
+
+void GAsmInterpreter::setCaseParallel(bool caseParallel) {
+    caseParallel_ = caseParallel;
+    code_.reset();
+    compiled_ = nullptr;
+    compiledBatch_ = nullptr;
+}
+
+const std::vector<IrInstruction>& GAsmInterpreter::lowered() {
+    if (!irReady_) {
+        GAsmIR::lower(*program_, passes_, ir_, irScratch_);
+        irReady_ = true;
+        decodedReady_ = false;
+    }
+    return ir_;
 }
 
 void GAsmInterpreter::setRegisterLength(size_t registerLength) {
     registers_.resize(registerLength);
 }
 
-size_t GAsmInterpreter::run(std::vector<double> &inputs, size_t maxProcessTime) {
-    if (useCompile) {
-        return runCompiled(inputs, maxProcessTime);
+TierStats& TierStats::operator+=(const TierStats& other) {
+    interpretedRuns += other.interpretedRuns;
+    compiledRuns += other.compiledRuns;
+    interpretedCases += other.interpretedCases;
+    compiledCases += other.compiledCases;
+    interpretedTime += other.interpretedTime;
+    compiledTime += other.compiledTime;
+    compilations += other.compilations;
+    compiledInstructions += other.compiledInstructions;
+    interpretedNs += other.interpretedNs;
+    compiledNs += other.compiledNs;
+    compileNs += other.compileNs;
+    return *this;
+}
+
+bool GAsmInterpreter::chooseCompiled(size_t caseCount, size_t inputLength) {
+    if (!useCompile || program_ == nullptr) {
+        return useCompile;
+    }
+    if (!tiered || code_ != nullptr) {
+        return true;
+    }
+    // another interpreter already paid for the code
+    if (cache_ && cache_->contains(compiledKey(shapeFor(inputLength)))) {
+        return true;
+    }
+    if (programRuns_ >= promoteAfterRuns) {
+        return true;
+    }
+    // rates measured so far, the defaults until there are enough samples
+    const TierStats& t = tierStats_;
+    double interpretedNs = t.interpretedTime >= minTierSamples
+            ? (double)t.interpretedNs / (double)t.interpretedTime : defaultInterpretedNs;
+    double compiledNs = t.compiledTime >= minTierSamples
+            ? (double)t.compiledNs / (double)t.compiledTime : defaultCompiledNs;
+    double compileNs = t.compilations > 0
+            ? (double)t.compileNs / (double)t.compiledInstructions : defaultCompileNs;
+    // a case takes about as long as before, before the first run at least every instruction once
+    const size_t length = lowered().size();
+    double timePerCase = programCases_ > 0 ? (double)programTime_ / (double)programCases_ : (double)length;
+    double saved = (double)caseCount * timePerCase * (interpretedNs - compiledNs);
+    // a program run n times is expected to run n more times
+    return saved * (double)(programRuns_ + 1) > compileNs * (double)std::max<size_t>(length, 1);
+}
+
+void GAsmInterpreter::recordRun(bool compiled, size_t caseCount, size_t processTime,
+                                std::chrono::steady_clock::time_point start) {
+    auto ns = (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - start).count();
+    if (compiled) {
+        tierStats_.compiledRuns++;
+        tierStats_.compiledCases += caseCount;
+        tierStats_.compiledTime += processTime;
+        tierStats_.compiledNs += ns;
     } else {
-        return runInterpreter(inputs, maxProcessTime);
+        tierStats_.interpretedRuns++;
+        tierStats_.interpretedCases += caseCount;
+        tierStats_.interpretedTime += processTime;
+        tierStats_.interpretedNs += ns;
+    }
+    programRuns_++;
+    programCases_ += caseCount;
+    programTime_ += processTime;
+}
+
+size_t GAsmInterpreter::run(std::vector<double> &inputs, size_t maxProcessTime) {
+    const bool compiled = chooseCompiled(1, inputs.size());
+    if (compiled && !inputs.empty() && program_ != nullptr) {
+        prepareCompiled(inputs.size());  // compilation time is counted apart
     }
+    auto start = std::chrono::steady_clock::now();
+    size_t processTime = compiled ? runCompiled(inputs, maxProcessTime) : runInterpreter(inputs, maxProcessTime);
+    recordRun(compiled, 1, processTime, start);
+    return processTime;
 }
 
 size_t GAsmInterpreter::runInterpreter(std::vector<double> &inputs, size_t maxProcessTime) {
-    if (inputs.empty()) {
+    return runInterpreter(inputs.data(), inputs.size(), maxProcessTime);
+}
+
+// handlers of the decoded program, dense so they index the label table
+enum Handler : uint8_t {
+    H_MOV_P_A, H_MOV_A_P, H_MOV_A_R, H_MOV_A_I, H_MOV_R_A, H_MOV_I_A,
+    H_ADD_R, H_SUB_R, H_DIV_R, H_MUL_R, H_SIN_R, H_COS_R, H_EXP_R,
+    H_ADD_I, H_SUB_I, H_DIV_I, H_MUL_I, H_SIN_I, H_COS_I, H_EXP_I,
+    H_INC, H_DEC, H_RES, H_SET, H_RNG,
+    H_FOR, H_LOP_A, H_LOP_P, H_JMP_I, H_JMP_R, H_JMP_P,
+    H_EMPTY_JMP_I, H_EMPTY_JMP_R, H_EMPTY_JMP_P,
+    H_END_FOR, H_END_LOP_A, H_END_LOP_P, H_END_JMP,
+    H_NOP,     // END without a block, unknown opcodes
+    H_CHARGE,  // start of a block, charges its time in the fast mode
+    H_HALT,    // end of the program
+    // fused handlers in the order of the catalog, in front of the instructions they stand for
+    #define SUPERINSTRUCTION_HANDLER2(a, b) H_##a##_##b,
+    #define SUPERINSTRUCTION_HANDLER3(a, b, c) H_##a##_##b##_##c,
+    GASM_SUPERINSTRUCTIONS(SUPERINSTRUCTION_HANDLER2, SUPERINSTRUCTION_HANDLER3)
+    #undef SUPERINSTRUCTION_HANDLER2
+    #undef SUPERINSTRUCTION_HANDLER3
+};
+static constexpr uint8_t H_FIRST_SUPERINSTRUCTION = H_HALT + 1;
+
+static uint8_t handlerOf(uint8_t opcode) {
+    switch (opcode) {
+        case MOV_P_A: return H_MOV_P_A;
+        case MOV_A_P: return H_MOV_A_P;
+        case MOV_A_R: return H_MOV_A_R;
+        case MOV_A_I: return H_MOV_A_I;
+        case MOV_R_A: return H_MOV_R_A;
+        case MOV_I_A: return H_MOV_I_A;
+        case ADD_R: return H_ADD_R;
+        case SUB_R: return H_SUB_R;
+        case DIV_R: return H_DIV_R;
+        case MUL_R: return H_MUL_R;
+        case SIN_R: return H_SIN_R;
+        case COS_R: return H_COS_R;
+        case EXP_R: return H_EXP_R;
+        case ADD_I: return H_ADD_I;
+        case SUB_I: return H_SUB_I;
+        case DIV_I: return H_DIV_I;
+        case MUL_I: return H_MUL_I;
+        case SIN_I: return H_SIN_I;
+        case COS_I: return H_COS_I;
+        case EXP_I: return H_EXP_I;
+        case INC: return H_INC;
+        case DEC: return H_DEC;
+        case RES: return H_RES;
+        case SET: return H_SET;
+        case RNG: return H_RNG;
+        case FOR: return H_FOR;
+        case LOP_A: return H_LOP_A;
+        case LOP_P: return H_LOP_P;
+        case JMP_I: return H_JMP_I;
+        case JMP_R: return H_JMP_R;
+        case JMP_P: return H_JMP_P;
+        case EMPTY_JMP_I: return H_EMPTY_JMP_I;
+        case EMPTY_JMP_R: return H_EMPTY_JMP_R;
+        case EMPTY_JMP_P: return H_EMPTY_JMP_P;
+        default: return H_NOP;  // END is resolved by decode
+    }
+}
+
+void GAsmInterpreter::setSuperinstructions(const std::vector<size_t>& superinstructions) {
+    const size_t catalogSize = Superinstructions::catalog().size();
+    for (size_t s : superinstructions) {
+        if (s >= catalogSize) {
+            throw std::invalid_argument("Superinstruction " + std::to_string(s) + " is not in the catalog");
+        }
+    }
+    superinstructions_ = superinstructions;
+    superinstructionHits_.resize(catalogSize);
+    decodedReady_ = false;
+}
+
+void GAsmInterpreter::resetSuperinstructionHits() {
+    std::fill(superinstructionHits_.begin(), superinstructionHits_.end(), 0);
+}
+
+void GAsmInterpreter::decode(const std::vector<IrInstruction>& ir) {
+    const size_t n = ir.size();
+    const std::vector<uint64_t>& remaining = GAsmIR::remainingCost(ir, irScratch_);
+    decoded_.clear();
+    threaded_ = false;
+    bool usesGenerators = false;
+    // superinstruction starting at every instruction, the first one that matches wins and the instructions
+    // it covers can't start another, none crosses a block start since only straight-line code matches
+    const std::vector<Superinstruction>& catalog = Superinstructions::catalog();
+    std::vector<size_t>& fused = fused_;
+    fused.assign(n, SIZE_MAX);
+    for (size_t i = 0; i < n && !superinstructions_.empty(); i++) {
+        for (size_t s : superinstructions_) {
+            const Superinstruction& candidate = catalog[s];
+            size_t j = 0;
+            while (j < candidate.length && i + j < n && ir[i + j].opcode == candidate.opcodes[j]) {
+                j++;
+            }
+            if (j == candidate.length) {
+                fused[i] = s;
+                i += candidate.length - 1;
+                break;
+            }
+        }
+    }
+    // where every instruction starts, the CHARGE in front of it for block starts, jumps land there
+    std::vector<uint32_t>& entry = entry_;
+    entry.resize(n + 1);
+    for (size_t i = 0; i < n; i++) {
+        entry[i] = (uint32_t)decoded_.size();
+        if (GAsmIR::isBlockStart(ir, i)) {
+            DecodedInstruction charge;
+            charge.op = H_CHARGE;
+            charge.amount = GAsmIR::blockCost(ir, i);
+            decoded_.push_back(charge);
+        }
+        if (fused[i] != SIZE_MAX) {
+            DecodedInstruction superinstruction;
+            superinstruction.op = H_FIRST_SUPERINSTRUCTION + fused[i];
+            decoded_.push_back(superinstruction);
+        }
+        DecodedInstruction instruction;
+        instruction.op = handlerOf(ir[i].opcode);
+        instruction.cost = ir[i].cost;
+        instruction.bodyCost = ir[i].bodyCost;
+        decoded_.push_back(instruction);
+        usesGenerators = usesGenerators || ir[i].opcode == SET || ir[i].opcode == RNG;
+    }
+    entry[n] = (uint32_t)decoded_.size();
+    DecodedInstruction halt;
+    halt.op = H_HALT;
+    decoded_.push_back(halt);
+    entryLimit_ = remaining[0];
+
+    // jumps are resolved from the matched blocks, nothing searches for an END at run time
+    const IrBlocks& blocks = GAsmIR::matchBlocks(ir, irScratch_);
+    forSlots_ = blocks.forSlots;
+    forCounters_.resize(2 * forSlots_);
+    caseMasks_.resize(blocks.maxDepth * caseLanes);
+    // generators are called in the order of the cases, lanes would call them out of order
+    casesInLanes_ = !usesGenerators;
+    auto at = [&](size_t i) -> DecodedInstruction& { return decoded_[entry[i + 1] - 1]; };
+    for (size_t i = 0; i < n; i++) {
+        const uint8_t opcode = ir[i].opcode;
+        const size_t match = blocks.match[i];
+        if (GAsmParser::isStructural(opcode)) {
+            at(i).target = match < n ? entry[match + 1] : entry[n];  // skipping steps over the END
+            at(i).slot = (uint32_t)blocks.forSlot[i];
+        } else if (opcode == END && match < n) {
+            DecodedInstruction& end = at(i);
+            end.target = entry[match + 1];  // looping goes back to the body
+            end.amount = remaining[match + 1];
+            end.slot = (uint32_t)blocks.forSlot[i];
+            switch (ir[match].opcode) {
+                case FOR: end.op = H_END_FOR; break;
+                case LOP_A: end.op = H_END_LOP_A; break;
+                case LOP_P: end.op = H_END_LOP_P; break;
+                default: end.op = H_END_JMP; break;  // JMP_I, JMP_R, JMP_P
+            }
+        }
+    }
+}
+
+const std::vector<GAsmInterpreter::DecodedInstruction>& GAsmInterpreter::decoded() {
+    const std::vector<IrInstruction>& ir = lowered();
+    if (!decodedReady_) {
+        decode(ir);
+        decodedReady_ = true;
+    }
+    return decoded_;
+}
+
+size_t GAsmInterpreter::runInterpreter(double* inputs, size_t inputLength, size_t maxProcessTime) {
+    if (inputLength == 0) {
         throw std::invalid_argument("Input length should be greater than 0");
     }
     if (program_ == nullptr) {
         throw std::invalid_argument("Program is not set.");
     }
     std::fill(registers_.begin(), registers_.end(), 0);
-    size_t inputLength = inputs.size();
-    size_t registerLength = registers_.size();
-    size_t P = 0;          // Program pointer
-    double A = 0;          // Accumulator
-    std::vector<size_t> pointerStack(0);
-    std::vector<uint8_t> instructionStack(0);
-    std::vector<size_t> pStack(0);
-    size_t processTime = 0;
-    bool skipToEnd = false;
-
-    for (size_t i = 0; i < program_->size(); i++) {
-        const uint8_t& opcode = program_->operator[](i);
-        switch (opcode) {
+    decoded();
+    InterpreterState state;
+    // the program alone might not fit into the budget, only the checked mode stops exactly
+    if (entryLimit_ > maxProcessTime) {
+        return interpret<true>(inputs, inputLength, maxProcessTime, forCounters_.data(), state);
+    }
+    return interpret<false>(inputs, inputLength, maxProcessTime, forCounters_.data(), state);
+}
 
-            // ===== MOV =====
-            case MOV_P_A:  // P = A
-                P = static_cast<int>(A);
-                break;
+// GCC and Clang jump straight from handler to handler, other compilers go through a switch
+#if defined(__GNUC__) || defined(__clang__)
+#define GASM_COMPUTED_GOTO
+#endif
 
-            case MOV_A_P:  // A = P
-                A = static_cast<double>(P);
-                break;
+// Fast mode (Checked = false): the time of a block is charged by the CHARGE in front of it and the budget
+// is only checked at loop back-edges, where the rest of the program alone still has to fit, like the fast
+// copy of the compiled code. Checked mode: every instruction is charged right before it runs, the run stops
+// before an instruction that can't finish within the budget and the time is clamped like in the JIT.
+template<bool Checked>
+size_t GAsmInterpreter::interpret(double* inputs, size_t inputLength, size_t maxProcessTime, size_t* counters,
+                                  InterpreterState state) {
+    DecodedInstruction* code = decoded_.data();
+    double* registers = registers_.data();
+    const size_t registerLength = registers_.size();
+    const bool fastMath = mathMode_ == MathMode::Fast;
+    double A = state.A;
+    size_t P = state.P;
+    size_t PI = state.PI;  // P % inputLength
+    size_t PR = state.PR;  // P % registerLength
+    size_t processTime = state.processTime;
+    size_t ip = state.ip;
+    uint64_t* hits = superinstructionHits_.data();
+    const size_t stopAbove = maxProcessTime == SIZE_MAX ? SIZE_MAX : maxProcessTime + 1;
 
-            case MOV_A_R:  // A = R[P]
-                A = registers_[P % registerLength];
-                break;
+#ifdef GASM_COMPUTED_GOTO
+    static const void* const labels[] = {
+            &&L_H_MOV_P_A, &&L_H_MOV_A_P, &&L_H_MOV_A_R, &&L_H_MOV_A_I, &&L_H_MOV_R_A, &&L_H_MOV_I_A,
+            &&L_H_ADD_R, &&L_H_SUB_R, &&L_H_DIV_R, &&L_H_MUL_R, &&L_H_SIN_R, &&L_H_COS_R, &&L_H_EXP_R,
+            &&L_H_ADD_I, &&L_H_SUB_I, &&L_H_DIV_I, &&L_H_MUL_I, &&L_H_SIN_I, &&L_H_COS_I, &&L_H_EXP_I,
+            &&L_H_INC, &&L_H_DEC, &&L_H_RES, &&L_H_SET, &&L_H_RNG,
+            &&L_H_FOR, &&L_H_LOP_A, &&L_H_LOP_P, &&L_H_JMP_I, &&L_H_JMP_R, &&L_H_JMP_P,
+            &&L_H_EMPTY_JMP_I, &&L_H_EMPTY_JMP_R, &&L_H_EMPTY_JMP_P,
+            &&L_H_END_FOR, &&L_H_END_LOP_A, &&L_H_END_LOP_P, &&L_H_END_JMP,
+            &&L_H_NOP, &&L_H_CHARGE, &&L_H_HALT,
+            #define SUPERINSTRUCTION_LABEL2(a, b) &&L_H_##a##_##b,
+            #define SUPERINSTRUCTION_LABEL3(a, b, c) &&L_H_##a##_##b##_##c,
+            GASM_SUPERINSTRUCTIONS(SUPERINSTRUCTION_LABEL2, SUPERINSTRUCTION_LABEL3)
+            #undef SUPERINSTRUCTION_LABEL2
+            #undef SUPERINSTRUCTION_LABEL3
+    };
+    if constexpr (!Checked) {
+        // the decoded program holds the handler addresses of the fast mode
+        if (!threaded_) {
+            for (DecodedInstruction& instruction : decoded_) {
+                instruction.handler = labels[instruction.op];
+            }
+            threaded_ = true;
+        }
+    }
+    #define HANDLER(op) L_##op:
+    #define DISPATCH() do { \
+        if constexpr (Checked) { \
+            processTime += code[ip].cost; \
+            if (processTime > stopAbove) goto stop; \
+            goto *labels[code[ip].op]; \
+        } else { \
+            goto *code[ip].handler; \
+        } } while (0)
+    DISPATCH();
+#else
+    #define HANDLER(op) case op:
+    #define DISPATCH() continue
+    for (;;) {
+        if constexpr (Checked) {
+            processTime += code[ip].cost;
+            if (processTime > stopAbove) goto stop;
+        }
+        switch (code[ip].op) {
+#endif
+    #define NEXT() do { ip++; DISPATCH(); } while (0)
+    #define JUMP(to) do { ip = (to); DISPATCH(); } while (0)
+    // fast mode goes on in the checked mode when a lane of time might not be enough for another iteration
+    #define LOOP_BACK() do { \
+        if constexpr (!Checked) { \
+            if (code[ip].amount > maxProcessTime || processTime > maxProcessTime - code[ip].amount) { \
+                state = {A, P, PI, PR, processTime, code[ip].target}; \
+                return interpret<true>(inputs, inputLength, maxProcessTime, counters, state); \
+            } \
+        } \
+        JUMP(code[ip].target); } while (0)
 
-            case MOV_A_I:  // A = I[P]
-                A = inputs[P % inputLength];
-                break;
+    // what the straight-line instructions do, shared by their handlers and the fused handlers
+    #define STEP_MOV_P_A P = static_cast<int>(A); PI = P % inputLength; PR = P % registerLength;
+    #define STEP_MOV_A_P A = static_cast<double>(P);
+    #define STEP_MOV_A_R A = registers[PR];
+    #define STEP_MOV_A_I A = inputs[PI];
+    #define STEP_MOV_R_A registers[PR] = A;
+    #define STEP_MOV_I_A inputs[PI] = A;
+    #define STEP_ADD_R A += registers[PR];
+    #define STEP_SUB_R A -= registers[PR];
+    #define STEP_DIV_R A /= registers[PR];
+    #define STEP_MUL_R A *= registers[PR];
+    #define STEP_ADD_I A += inputs[PI];
+    #define STEP_SUB_I A -= inputs[PI];
+    #define STEP_DIV_I A /= inputs[PI];
+    #define STEP_MUL_I A *= inputs[PI];
+    // the remainders wrap to 0 at the length and when P wraps around
+    #define STEP_INC \
+        if (++P == 0) { \
+            PI = 0; \
+            PR = 0; \
+        } else { \
+            PI = PI + 1 == inputLength ? 0 : PI + 1; \
+            PR = PR + 1 == registerLength ? 0 : PR + 1; \
+        }
+    #define STEP_DEC \
+        if (P-- == 0) { \
+            PI = P % inputLength; \
+            PR = P % registerLength; \
+        } else { \
+            PI = (PI == 0 ? inputLength : PI) - 1; \
+            PR = (PR == 0 ? registerLength : PR) - 1; \
+        }
 
-            case MOV_R_A:  // R = A
-                registers_[P % registerLength] = A;
-                break;
+    // ===== MOV =====
+    HANDLER(H_MOV_P_A) STEP_MOV_P_A NEXT();  // P = A
+    HANDLER(H_MOV_A_P) STEP_MOV_A_P NEXT();
+    HANDLER(H_MOV_A_R) STEP_MOV_A_R NEXT();
+    HANDLER(H_MOV_A_I) STEP_MOV_A_I NEXT();
+    HANDLER(H_MOV_R_A) STEP_MOV_R_A NEXT();
+    HANDLER(H_MOV_I_A) STEP_MOV_I_A NEXT();
 
-            case MOV_I_A:  // I[P] = A
-                inputs[P % inputLength] = A;
-                break;
+    // ===== ARITHMETIC (R) =====
+    HANDLER(H_ADD_R) STEP_ADD_R NEXT();
+    HANDLER(H_SUB_R) STEP_SUB_R NEXT();
+    HANDLER(H_DIV_R) STEP_DIV_R NEXT();
+    HANDLER(H_MUL_R) STEP_MUL_R NEXT();
+    HANDLER(H_SIN_R) A = fastMath ? FastMath::sin(registers[PR]) : sin(registers[PR]); NEXT();
+    HANDLER(H_COS_R) A = fastMath ? FastMath::cos(registers[PR]) : cos(registers[PR]); NEXT();
+    HANDLER(H_EXP_R) A = fastMath ? FastMath::exp(registers[PR]) : exp(registers[PR]); NEXT();
 
-            // ===== ARITHMETIC (R) =====
-            case ADD_R: A += registers_[P % registerLength]; break;
-            case SUB_R: A -= registers_[P % registerLength]; break;
-            case DIV_R: A /= registers_[P % registerLength]; break;
-            case MUL_R: A *= registers_[P % registerLength]; break;
-            case SIN_R: A = sin(registers_[P % registerLength]); break;
-            case COS_R: A = cos(registers_[P % registerLength]); break;
-            case EXP_R: A = exp(registers_[P % registerLength]); break;
+    // ===== ARITHMETIC (I) =====
+    HANDLER(H_ADD_I) STEP_ADD_I NEXT();
+    HANDLER(H_SUB_I) STEP_SUB_I NEXT();
+    HANDLER(H_DIV_I) STEP_DIV_I NEXT();
+    HANDLER(H_MUL_I) STEP_MUL_I NEXT();
+    HANDLER(H_SIN_I) A = fastMath ? FastMath::sin(inputs[PI]) : sin(inputs[PI]); NEXT();
+    HANDLER(H_COS_I) A = fastMath ? FastMath::cos(inputs[PI]) : cos(inputs[PI]); NEXT();
+    HANDLER(H_EXP_I) A = fastMath ? FastMath::exp(inputs[PI]) : exp(inputs[PI]); NEXT();
 
+    // ===== UNARY =====
+    HANDLER(H_INC) STEP_INC NEXT();
+    HANDLER(H_DEC) STEP_DEC NEXT();
+    HANDLER(H_RES) P = 0; PI = 0; PR = 0; NEXT();
+    HANDLER(H_SET) A = (*cng_)(); NEXT();
+    HANDLER(H_RNG) A = (*rng_)(); NEXT();
 
-            // ===== ARITHMETIC (I) =====
-            case ADD_I: A += inputs[P % inputLength]; break;
-            case SUB_I: A -= inputs[P % inputLength]; break;
-            case DIV_I: A /= inputs[P % inputLength]; break;
-            case MUL_I: A *= inputs[P % inputLength]; break;
-            case SIN_I: A = sin(inputs[P % inputLength]); break;
-            case COS_I: A = cos(inputs[P % inputLength]); break;
-            case EXP_I: A = exp(inputs[P % inputLength]); break;
+    // ===== SUPERINSTRUCTIONS =====
+    // the fast mode runs the instructions behind a fused handler at once and steps over them,
+    // the checked mode charges them one by one, so there it only takes the next instruction
+    #define SUPERINSTRUCTION2(a, b) HANDLER(H_##a##_##b) \
+        if constexpr (!Checked) { \
+            STEP_##a STEP_##b \
+            hits[H_##a##_##b - H_FIRST_SUPERINSTRUCTION]++; \
+            JUMP(ip + 3); \
+        } \
+        NEXT();
+    #define SUPERINSTRUCTION3(a, b, c) HANDLER(H_##a##_##b##_##c) \
+        if constexpr (!Checked) { \
+            STEP_##a STEP_##b STEP_##c \
+            hits[H_##a##_##b##_##c - H_FIRST_SUPERINSTRUCTION]++; \
+            JUMP(ip + 4); \
+        } \
+        NEXT();
+    GASM_SUPERINSTRUCTIONS(SUPERINSTRUCTION2, SUPERINSTRUCTION3)
+    #undef SUPERINSTRUCTION2
+    #undef SUPERINSTRUCTION3
 
+    // ===== LOOPS =====
+    HANDLER(H_FOR)
+        P = 0;  // start loop at index 0
+        PI = 0;
+        PR = 0;
+        counters[2 * code[ip].slot] = 0;
+        counters[2 * code[ip].slot + 1] = 0;
+        NEXT();
+    HANDLER(H_LOP_A)
+        if (A < inputs[PI]) NEXT();
+        JUMP(code[ip].target);  // skip past the END
+    HANDLER(H_LOP_P)
+        if (P < inputLength) NEXT();
+        JUMP(code[ip].target);
 
-            // ===== UNARY =====
-            case INC: P++; break;
-            case DEC: P--; break;
-            case RES: P = 0; break;
-            case SET: A = (*cng_)(); break;
+    // ===== CONDITIONAL JUMPS =====
+    HANDLER(H_JMP_I)
+        if (A >= inputs[PI]) JUMP(code[ip].target);
+        NEXT();
+    HANDLER(H_JMP_R)
+        if (A >= registers[PR]) JUMP(code[ip].target);
+        NEXT();
+    HANDLER(H_JMP_P)
+        if ((double)P >= A) JUMP(code[ip].target);
+        NEXT();
 
+    // ===== EMPTY BLOCKS =====
+    HANDLER(H_EMPTY_JMP_I)
+        if (!(A >= inputs[PI])) processTime += code[ip].bodyCost;
+        NEXT();
+    HANDLER(H_EMPTY_JMP_R)
+        if (!(A >= registers[PR])) processTime += code[ip].bodyCost;
+        NEXT();
+    HANDLER(H_EMPTY_JMP_P)
+        if (!((double)P >= A)) processTime += code[ip].bodyCost;
+        NEXT();
 
-            // ===== LOOPS =====
-            case FOR:
-                P = 0;   // Start loop at index 0
-                pointerStack.push_back(i);  // push_back instruction
-                instructionStack.push_back(FOR); // push_back current loop version
-                pStack.push_back(P);        // save pointer
-                break;
+    // ===== END =====
+    HANDLER(H_END_FOR) {
+        size_t* counter = counters + 2 * code[ip].slot;
+        P = ++counter[0];
+        if (P < inputLength) {
+            PI = P;
+            counter[1] = counter[1] + 1 == registerLength ? 0 : counter[1] + 1;
+            PR = counter[1];
+            LOOP_BACK();
+        }
+        // P == inputLength
+        PI = 0;
+        PR = inputLength % registerLength;
+        NEXT();
+    }
+    HANDLER(H_END_LOP_A)
+        if (A < inputs[PI]) LOOP_BACK();
+        NEXT();
+    HANDLER(H_END_LOP_P)
+        if (P < inputLength) LOOP_BACK();
+        NEXT();
+
+    HANDLER(H_END_JMP) NEXT();  // only takes time
+    HANDLER(H_NOP) NEXT();
+    HANDLER(H_CHARGE)
+        if constexpr (!Checked) {
+            processTime += code[ip].amount;
+        }
+        NEXT();
+    HANDLER(H_HALT) goto stop;
+
+#ifndef GASM_COMPUTED_GOTO
+            default: goto stop;
+        }
+    }
+#endif
+    #undef HANDLER
+    #undef DISPATCH
+    #undef NEXT
+    #undef JUMP
+    #undef LOOP_BACK
+    #undef STEP_MOV_P_A
+    #undef STEP_MOV_A_P
+    #undef STEP_MOV_A_R
+    #undef STEP_MOV_A_I
+    #undef STEP_MOV_R_A
+    #undef STEP_MOV_I_A
+    #undef STEP_ADD_R
+    #undef STEP_SUB_R
+    #undef STEP_DIV_R
+    #undef STEP_MUL_R
+    #undef STEP_ADD_I
+    #undef STEP_SUB_I
+    #undef STEP_DIV_I
+    #undef STEP_MUL_I
+    #undef STEP_INC
+    #undef STEP_DEC
+
+stop:
+    // folded instructions can go past the budget at once
+    if (processTime > maxProcessTime) {
+        processTime = maxProcessTime + 1;
+    }
+    return processTime;
+}
 
-            case LOP_A:
-                if (A < inputs[P % inputLength]) {  // this has to be changed in 2 places
-                    instructionStack.push_back(LOP_A);
-                    pointerStack.push_back(i);
+// Every instruction runs for a group of cases at once, one lane per case, so the dispatch is paid once
+// per group and the arithmetic becomes loops over the lanes the compiler can vectorize. A block leaves the
+// lanes that skip it out of the mask and brings them back at its END, a loop runs until none of its lanes
+// wants another iteration. Time is charged per lane like in the fast mode, when a lane might go over the
+// budget before the next loop check the group gives up and its cases run one by one.
+bool GAsmInterpreter::interpretGroup(double* cases, size_t caseCount, size_t caseStride, size_t inputLength,
+                                     size_t* processTimes, size_t maxProcessTime) {
+    constexpr size_t L = caseLanes;
+    const DecodedInstruction* code = decoded_.data();
+    const size_t registerLength = registers_.size();
+    const bool fastMath = mathMode_ == MathMode::Fast;
+    double* inputs = caseInputs_.data();
+    double* registers = caseRegisters_.data();
+    uint8_t* savedMasks = caseMasks_.data();
+    size_t* counters = forCounters_.data();
+    // lanes without a case run on zeros and are never active
+    for (size_t j = 0; j < inputLength; j++) {
+        for (size_t l = 0; l < L; l++) {
+            inputs[j * L + l] = l < caseCount ? cases[l * caseStride + j] : 0;
+        }
+    }
+    std::fill(caseRegisters_.begin(), caseRegisters_.end(), 0);
+
+    alignas(64) double A[L] = {};
+    size_t P[L] = {};
+    size_t PI[L] = {};
+    size_t PR[L] = {};
+    size_t processTime[L] = {};
+    uint8_t mask[L];   // lanes running the current instruction
+    uint8_t enter[L];  // lanes of the mask that enter a block
+    for (size_t l = 0; l < L; l++) {
+        mask[l] = l < caseCount;
+    }
+    size_t depth = 0;  // entered blocks, the mask outside of each is saved
+    size_t ip = 0;
+
+    #define LANES for (size_t l = 0; l < L; l++)
+    // A = value in the active lanes
+    #define UPDATE_A(value) LANES { const double v = (value); A[l] = mask[l] ? v : A[l]; }
+    #define MATH(fn, x) (fastMath ? FastMath::fn(x) : fn(x))
+    #define R(l) registers[PR[l] * L + (l)]
+    #define I(l) inputs[PI[l] * L + (l)]
+    // x[l] = R[P] or I[P] of lane l, a row of the memory when all the lanes share P
+    #define LOAD_R const double* x = uniformP ? registers + PR[0] * L : gatherR();
+    #define LOAD_I const double* x = uniformP ? inputs + PI[0] * L : gatherI();
+    bool uniformP = true;  // all the lanes have the same P, so they read one row
+    alignas(64) double column[L];
+    auto gatherR = [&]() { LANES { column[l] = R(l); } return (const double*)column; };
+    auto gatherI = [&]() { LANES { column[l] = I(l); } return (const double*)column; };
+    auto checkUniform = [&]() {
+        uint8_t same = 1;
+        LANES { same &= (uint8_t)(P[l] == P[0]); }
+        uniformP = same != 0;
+    };
+    // enter = lanes of the mask for which the condition holds, false if there are none
+    auto narrow = [&](auto condition) {
+        uint8_t any = 0;
+        LANES {
+            enter[l] = mask[l] & (uint8_t)condition(l);
+            any |= enter[l];
+        }
+        return any != 0;
+    };
+    // the lanes that enter run the block, the others wait at its END, nobody enters: skip past the END
+    auto enterBlock = [&](bool any) {
+        if (!any) {
+            ip = code[ip].target;
+            return;
+        }
+        std::copy(mask, mask + L, savedMasks + depth++ * L);
+        std::copy(enter, enter + L, mask);
+        ip++;
+    };
+    // back to the body of a loop, false if an active lane might go over the budget in the next iteration
+    auto loopBack = [&]() {
+        const uint64_t amount = code[ip].amount;
+        uint8_t over = 0;
+        LANES {
+            over |= mask[l] & (uint8_t)(amount > maxProcessTime || processTime[l] > maxProcessTime - amount);
+        }
+        ip = code[ip].target;
+        return over == 0;
+    };
+    auto leaveBlock = [&]() {
+        depth--;
+        std::copy(savedMasks + depth * L, savedMasks + depth * L + L, mask);
+        ip++;
+    };
+
+    for (;;) {
+        const DecodedInstruction& d = code[ip];
+        switch (d.op) {
+            // ===== MOV =====
+            case H_MOV_P_A:
+                LANES {
+                    if (mask[l]) {
+                        P[l] = static_cast<int>(A[l]);
+                        PI[l] = P[l] % inputLength;
+                        PR[l] = P[l] % registerLength;
+                    }
+                }
+                checkUniform();
+                break;
+            case H_MOV_A_P: UPDATE_A((double)P[l]); break;
+            case H_MOV_A_R: { LOAD_R UPDATE_A(x[l]); break; }
+            case H_MOV_A_I: { LOAD_I UPDATE_A(x[l]); break; }
+            case H_MOV_R_A: {
+                if (uniformP) {
+                    double* row = registers + PR[0] * L;
+                    LANES { row[l] = mask[l] ? A[l] : row[l]; }
                 } else {
-                    // skip till the END symbol
-                    skipToEnd = true;
+                    LANES { if (mask[l]) R(l) = A[l]; }
                 }
                 break;
-
-            case LOP_P:
-                if (P < inputLength) {  // this has to be changed in 2 places
-                    instructionStack.push_back(LOP_P);
-                    pointerStack.push_back(i);
+            }
+            case H_MOV_I_A: {
+                if (uniformP) {
+                    double* row = inputs + PI[0] * L;
+                    LANES { row[l] = mask[l] ? A[l] : row[l]; }
                 } else {
-                    // skip till the END symbol
-                    skipToEnd = true;
+                    LANES { if (mask[l]) I(l) = A[l]; }
                 }
                 break;
+            }
 
+            // ===== ARITHMETIC (R) =====
+            case H_ADD_R: { LOAD_R UPDATE_A(A[l] + x[l]); break; }
+            case H_SUB_R: { LOAD_R UPDATE_A(A[l] - x[l]); break; }
+            case H_DIV_R: { LOAD_R UPDATE_A(A[l] / x[l]); break; }
+            case H_MUL_R: { LOAD_R UPDATE_A(A[l] * x[l]); break; }
+            case H_SIN_R: { LOAD_R UPDATE_A(MATH(sin, x[l])); break; }
+            case H_COS_R: { LOAD_R UPDATE_A(MATH(cos, x[l])); break; }
+            case H_EXP_R: { LOAD_R UPDATE_A(MATH(exp, x[l])); break; }
 
-            // ===== CONDITIONAL JUMPS =====
-            case JMP_I:
-                if (A >= inputs[P % inputLength]) {
-                    // skip till the END symbol
-                    skipToEnd = true;
+            // ===== ARITHMETIC (I) =====
+            case H_ADD_I: { LOAD_I UPDATE_A(A[l] + x[l]); break; }
+            case H_SUB_I: { LOAD_I UPDATE_A(A[l] - x[l]); break; }
+            case H_DIV_I: { LOAD_I UPDATE_A(A[l] / x[l]); break; }
+            case H_MUL_I: { LOAD_I UPDATE_A(A[l] * x[l]); break; }
+            case H_SIN_I: { LOAD_I UPDATE_A(MATH(sin, x[l])); break; }
+            case H_COS_I: { LOAD_I UPDATE_A(MATH(cos, x[l])); break; }
+            case H_EXP_I: { LOAD_I UPDATE_A(MATH(exp, x[l])); break; }
+
+            // ===== UNARY =====
+            case H_INC:
+                LANES {
+                    if (mask[l]) {
+                        if (++P[l] == 0) {
+                            PI[l] = 0;
+                            PR[l] = 0;
+                        } else {
+                            PI[l] = PI[l] + 1 == inputLength ? 0 : PI[l] + 1;
+                            PR[l] = PR[l] + 1 == registerLength ? 0 : PR[l] + 1;
+                        }
+                    }
                 }
+                checkUniform();
                 break;
-
-            case JMP_R:
-                if (A >= registers_[P % registerLength]) {
-                    // skip till the END symbol
-                    skipToEnd = true;
+            case H_DEC:
+                LANES {
+                    if (mask[l]) {
+                        if (P[l]-- == 0) {
+                            PI[l] = P[l] % inputLength;
+                            PR[l] = P[l] % registerLength;
+                        } else {
+                            PI[l] = (PI[l] == 0 ? inputLength : PI[l]) - 1;
+                            PR[l] = (PR[l] == 0 ? registerLength : PR[l]) - 1;
+                        }
+                    }
                 }
+                checkUniform();
                 break;
-
-            case JMP_P:
-                if ((double)P >= A) {
-                    // skip till the END symbol
-                    skipToEnd = true;
+            case H_RES:
+                LANES {
+                    if (mask[l]) {
+                        P[l] = 0;
+                        PI[l] = 0;
+                        PR[l] = 0;
+                    }
                 }
+                checkUniform();
                 break;
 
-
-            // ===== TERMINATION / RANDOM =====
-            case END:
-                if (!instructionStack.empty()) { //
-                    uint8_t instruction = instructionStack.back();
-                    switch (instruction) {
-                        case FOR:
-                            P = ++pStack.back();
-                            if (P < inputLength) {
-                                i = pointerStack.back();
-                            } else {
-                                instructionStack.pop_back();
-                                pStack.pop_back();
-                                pointerStack.pop_back();
-                            }
-                            break;
-                        case LOP_A:
-                            if (A < inputs[P % inputLength]) {  // this has to be changed in 2 places
-                                i = pointerStack.back();
-                            } else {
-                                instructionStack.pop_back();
-                                pointerStack.pop_back();
-                            }
-                            break;
-                        case LOP_P:
-                            if (P < inputLength) {  // this has to be changed in 2 places
-                                i = pointerStack.back();
-                            } else {
-                                instructionStack.pop_back();
-                                pointerStack.pop_back();
-                            }
-                            break;
-                        default:
-                            break;
+            // ===== LOOPS =====
+            case H_FOR:
+                // every active lane enters, the counter is the same in all of them
+                LANES {
+                    if (mask[l]) {
+                        P[l] = 0;
+                        PI[l] = 0;
+                        PR[l] = 0;
                     }
                 }
-                break;
+                counters[2 * d.slot] = 0;
+                counters[2 * d.slot + 1] = 0;
+                checkUniform();
+                std::copy(mask, mask + L, enter);
+                enterBlock(true);
+                continue;
+            case H_LOP_A: enterBlock(narrow([&](size_t l) { return A[l] < I(l); })); continue;
+            case H_LOP_P: enterBlock(narrow([&](size_t l) { return P[l] < inputLength; })); continue;
 
-            case RNG:
-                A = (*rng_)();
-                break;
+            // ===== CONDITIONAL JUMPS =====
+            case H_JMP_I: enterBlock(narrow([&](size_t l) { return !(A[l] >= I(l)); })); continue;
+            case H_JMP_R: enterBlock(narrow([&](size_t l) { return !(A[l] >= R(l)); })); continue;
+            case H_JMP_P: enterBlock(narrow([&](size_t l) { return !((double)P[l] >= A[l]); })); continue;
 
+            // ===== EMPTY BLOCKS =====
+            case H_EMPTY_JMP_I: LANES { if (mask[l] && !(A[l] >= I(l))) processTime[l] += d.bodyCost; } break;
+            case H_EMPTY_JMP_R: LANES { if (mask[l] && !(A[l] >= R(l))) processTime[l] += d.bodyCost; } break;
+            case H_EMPTY_JMP_P: LANES { if (mask[l] && !((double)P[l] >= A[l])) processTime[l] += d.bodyCost; } break;
+
+            // ===== END =====
+            case H_END_FOR: {
+                size_t* counter = counters + 2 * d.slot;
+                const size_t p = ++counter[0];
+                if (p < inputLength) {
+                    counter[1] = counter[1] + 1 == registerLength ? 0 : counter[1] + 1;
+                    LANES {
+                        if (mask[l]) {
+                            P[l] = p;
+                            PI[l] = p;
+                            PR[l] = counter[1];
+                        }
+                    }
+                    checkUniform();
+                    if (!loopBack()) {
+                        return false;
+                    }
+                    continue;
+                }
+                // P == inputLength
+                LANES {
+                    if (mask[l]) {
+                        P[l] = inputLength;
+                        PI[l] = 0;
+                        PR[l] = inputLength % registerLength;
+                    }
+                }
+                checkUniform();
+                leaveBlock();
+                continue;
+            }
+            case H_END_LOP_A:
+            case H_END_LOP_P: {
+                // lanes whose condition still holds run another iteration, the others wait
+                const bool again = d.op == H_END_LOP_A
+                        ? narrow([&](size_t l) { return A[l] < I(l); })
+                        : narrow([&](size_t l) { return P[l] < inputLength; });
+                if (again) {
+                    std::copy(enter, enter + L, mask);
+                    if (!loopBack()) {
+                        return false;
+                    }
+                    continue;
+                }
+                leaveBlock();
+                continue;
+            }
+            case H_END_JMP: leaveBlock(); continue;
 
+            case H_CHARGE: LANES { processTime[l] += mask[l] ? d.amount : 0; } break;
+            case H_HALT: {
+                // every lane finished within the budget
+                for (size_t l = 0; l < caseCount; l++) {
+                    for (size_t j = 0; j < inputLength; j++) {
+                        cases[l * caseStride + j] = inputs[j * L + l];
+                    }
+                    processTimes[l] = processTime[l];
+                }
+                return true;
+            }
             default:
-                // Unknown opcode → do nothing
+                // END without a block, unknown opcodes, only take time, superinstructions run one by one
                 break;
         }
-        processTime++;
-        if (processTime > maxProcessTime) {
-            break;
-        }
-        if (skipToEnd) {
-            for (int endCounter = 0; i < program_->size(); i++) {
-                const uint8_t &instruction = program_->operator[](i);
-                if (FOR <= instruction && instruction <= JMP_P) { // instruction with END
-                    endCounter++;
-                } else if (instruction == END) {
-                    if (endCounter == 0) {
-                        break;
-                    } else {
-                        endCounter--;
-                    }
-                }
+        ip++;
+    }
+    #undef LANES
+    #undef UPDATE_A
+    #undef MATH
+    #undef R
+    #undef I
+    #undef LOAD_R
+    #undef LOAD_I
+}
+
+size_t GAsmInterpreter::interpretLanes(double* cases, size_t caseCount, size_t caseStride, size_t inputLength,
+                                       size_t* processTimes, size_t maxProcessTime) {
+    caseInputs_.resize(inputLength * caseLanes);
+    caseRegisters_.resize(registers_.size() * caseLanes);
+    size_t groups = 0;
+    size_t givenUp = 0;
+    size_t totalTime = 0;
+    for (size_t first = 0; first < caseCount; first += caseLanes) {
+        double* group = cases + first * caseStride;
+        size_t* groupTimes = processTimes + first;
+        const size_t count = std::min(caseLanes, caseCount - first);
+        groups++;
+        if (!interpretGroup(group, count, caseStride, inputLength, groupTimes, maxProcessTime)) {
+            // near the budget, the cases are still untouched
+            givenUp++;
+            for (size_t l = 0; l < count; l++) {
+                groupTimes[l] = runInterpreter(group + l * caseStride, inputLength, maxProcessTime);
             }
-            skipToEnd = false;
+        }
+        for (size_t l = 0; l < count; l++) {
+            totalTime += groupTimes[l];
         }
     }
-    return processTime;
+    // the program mostly runs into the budget, stop trying
+    if (givenUp * 2 > groups) {
+        lanesDiverge_ = true;
+    }
+    return totalTime;
 }
 
 size_t GAsmInterpreter::runCompiled(std::vector<double> &inputs, size_t maxProcessTime) {
@@ -292,12 +1059,166 @@ size_t GAsmInterpreter::runCompiled(std::vector<double> &inputs, size_t maxProce
     if (program_ == nullptr) {
         throw std::invalid_argument("Program is not set.");
     }
-    if (compiled_ == nullptr) {
-        compiled_ = compile();
-    }
-    std::fill(registers_.begin(), registers_.end(), 0);
+    prepareCompiled(inputs.size());
+    // the compiled code clears the registers itself
     return compiled_(inputs.data(), inputs.size(), registers_.data(), registers_.size(), (*cng_), (*rng_), maxProcessTime);
 }
 
+JitShape GAsmInterpreter::shapeFor(size_t inputLength) {
+    JitShape shape;
+    if (specializeShapes) {
+        if (seenInputLength_ == 0) {
+            seenInputLength_ = inputLength;
+        }
+        // inputs of different lengths use the generic code from now on
+        shapeVaries_ = shapeVaries_ || inputLength != seenInputLength_;
+        shape.inputLength = shapeVaries_ ? 0 : inputLength;
+        shape.registerLength = registers_.size();
+    }
+    return shape;
+}
+
+void GAsmInterpreter::prepareCompiled(size_t inputLength) {
+    JitShape shape = shapeFor(inputLength);
+    if (code_ == nullptr || code_->shape != shape) {
+        compiled_ = compile(shape);
+    }
+}
+
+size_t GAsmInterpreter::runBatch(double* cases, size_t caseCount, size_t caseStride, size_t inputLength,
+                                 size_t* processTimes, size_t maxProcessTime) {
+    if (inputLength == 0) {
+        throw std::invalid_argument("Input length should be greater than 0");
+    }
+    if (caseStride < inputLength) {
+        throw std::invalid_argument("Case stride should not be smaller than input length");
+    }
+    if (program_ == nullptr) {
+        throw std::invalid_argument("Program is not set.");
+    }
+    if (caseCount == 0) {
+        return 0;
+    }
+    size_t totalTime = 0;
+    if (chooseCompiled(caseCount, inputLength)) {
+        prepareCompiled(inputLength);
+        auto start = std::chrono::steady_clock::now();
+        if (code_->runLanes != nullptr && !lanesDiverge_ && caseCount >= CompiledProgram::lanes) {
+            totalTime = runLanes(cases, caseCount, caseStride, inputLength, processTimes, maxProcessTime);
+        } else {
+            // one native call evaluates all the cases
+            totalTime = compiledBatch_(cases, caseCount, caseStride, inputLength,
+                                       registers_.data(), registers_.size(),
+                                       (*cng_), (*rng_), maxProcessTime, processTimes);
+        }
+        recordRun(true, caseCount, totalTime, start);
+        return totalTime;
+    }
+    auto start = std::chrono::steady_clock::now();
+    decoded();
+    // the program alone has to fit into the budget, the lanes only check it at loop ends
+    if (caseParallel_ && casesInLanes_ && !lanesDiverge_ && caseCount > 1 && entryLimit_ <= maxProcessTime) {
+        totalTime = interpretLanes(cases, caseCount, caseStride, inputLength, processTimes, maxProcessTime);
+    } else {
+        for (size_t i = 0; i < caseCount; i++) {
+            processTimes[i] = runInterpreter(cases + i * caseStride, inputLength, maxProcessTime);
+            totalTime += processTimes[i];
+        }
+    }
+    recordRun(false, caseCount, totalTime, start);
+    return totalTime;
+}
+
+size_t GAsmInterpreter::runLanes(double* cases, size_t caseCount, size_t caseStride, size_t inputLength,
+                                 size_t* processTimes, size_t maxProcessTime) {
+    constexpr size_t lanes = CompiledProgram::lanes;
+    const size_t registerLength = registers_.size();
+    laneInputs_.resize(inputLength * lanes);
+    laneRegisters_.resize(registerLength * lanes);
+    const size_t groups = caseCount / lanes;
+    size_t givenUp = 0;
+    size_t totalTime = 0;
+    for (size_t g = 0; g < groups; g++) {
+        double* group = cases + g * lanes * caseStride;
+        size_t* groupTimes = processTimes + g * lanes;
+        for (size_t l = 0; l < lanes; l++) {
+            for (size_t j = 0; j < inputLength; j++) {
+                laneInputs_[j * lanes + l] = group[l * caseStride + j];
+            }
+        }
+        if (code_->runLanes(laneInputs_.data(), inputLength, laneRegisters_.data(), registerLength,
+                            maxProcessTime, groupTimes) == 0) {
+            for (size_t l = 0; l < lanes; l++) {
+                for (size_t j = 0; j < inputLength; j++) {
+                    group[l * caseStride + j] = laneInputs_[j * lanes + l];
+                }
+                totalTime += groupTimes[l];
+            }
+        } else {
+            // near the budget or too divergent, the cases are still untouched
+            givenUp++;
+            totalTime += compiledBatch_(group, lanes, caseStride, inputLength,
+                                        registers_.data(), registerLength,
+                                        (*cng_), (*rng_), maxProcessTime, groupTimes);
+        }
+    }
+    // cases that don't fill a group
+    size_t done = groups * lanes;
+    if (done < caseCount) {
+        totalTime += compiledBatch_(cases + done * caseStride, caseCount - done, caseStride, inputLength,
+                                    registers_.data(), registerLength,
+                                    (*cng_), (*rng_), maxProcessTime, processTimes + done);
+    }
+    // the program mostly runs into the budget or diverges, stop trying
+    if (givenUp * 2 > groups) {
+        lanesDiverge_ = true;
+    }
+    return totalTime;
+}
+
+template<typename CaseAt>
+size_t GAsmInterpreter::runCasesOf(size_t caseCount, CaseAt caseAt, size_t maxProcessTime) {
+    if (caseCount == 0) {
+        throw std::invalid_argument("There should be at least one fitness case");
+    }
+    // flatten the cases, the program overwrites them with its outputs
+    size_t inputLength = caseAt(0).size();
+    bool sameLength = true;
+    caseOffsets_.resize(caseCount + 1);
+    caseTimes_.resize(caseCount);
+    caseOffsets_[0] = 0;
+    for (size_t i = 0; i < caseCount; i++) {
+        caseOffsets_[i + 1] = caseOffsets_[i] + caseAt(i).size();
+        sameLength = sameLength && caseAt(i).size() == inputLength;
+    }
+    caseBuffer_.resize(caseOffsets_.back());
+    for (size_t i = 0; i < caseCount; i++) {
+        const std::vector<double>& input = caseAt(i);
+        std::copy(input.begin(), input.end(), caseBuffer_.begin() + (std::ptrdiff_t)caseOffsets_[i]);
+    }
+
+    if (sameLength) {
+        return runBatch(caseBuffer_.data(), caseCount, inputLength, inputLength, caseTimes_.data(), maxProcessTime);
+    }
+    // cases of different shapes, run them one by one
+    size_t totalTime = 0;
+    for (size_t i = 0; i < caseCount; i++) {
+        size_t length = caseOffsets_[i + 1] - caseOffsets_[i];
+        totalTime += runBatch(caseBuffer_.data() + caseOffsets_[i], 1, length, length, &caseTimes_[i], maxProcessTime);
+    }
+    return totalTime;
+}
+
+size_t GAsmInterpreter::runCases(const std::vector<std::vector<double>>& inputs, size_t maxProcessTime) {
+    return runCasesOf(inputs.size(), [&inputs](size_t i) -> const std::vector<double>& { return inputs[i]; },
+                      maxProcessTime);
+}
+
+size_t GAsmInterpreter::runCases(const std::vector<std::vector<double>>& inputs, std::span<const size_t> cases,
+                                 size_t maxProcessTime) {
+    return runCasesOf(cases.size(), [&inputs, cases](size_t k) -> const std::vector<double>& { return inputs[cases[k]]; },
+                      maxProcessTime);
+}
+
 
 
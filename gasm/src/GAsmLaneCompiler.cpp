@@ -0,0 +1,637 @@
+//
+// Case-parallel code, every AVX2 lane runs the program on its own case
+//
+
+#include <vector>
+#include <cmath>
+#include <xbyak.h>
+#include <algorithm>
+#include <bit>
+#include <climits>
+#include "GAsmInterpreter.h"
+#include "GAsmParser.h"
+#include "GAsmIR.h"
+#include "FastMath.h"
+
+// LOP iterations in which only some of the lanes keep looping, after that many
+// the lanes mostly wait for each other and the group is cheaper to run case by case
+static constexpr size_t maxDivergentIterations = 64;
+
+// SIN_*, COS_* and EXP_* go through memory, one lane at a time
+template<double (*F)(double)>
+static void applyToLanes(double* lanes) {
+    for (size_t l = 0; l < CompiledProgram::lanes; l++) {
+        lanes[l] = F(lanes[l]);
+    }
+}
+
+static double libmSin(double x) { return std::sin(x); }
+static double libmCos(double x) { return std::cos(x); }
+static double libmExp(double x) { return std::exp(x); }
+
+bool GAsmInterpreter::lanesSupported(const std::vector<IrInstruction>& program) {
+    // the generators are called case after case, lanes would interleave the calls
+    bool usesGenerators = std::any_of(program.begin(), program.end(), [](const IrInstruction& instruction) {
+        return instruction.opcode == SET || instruction.opcode == RNG; });
+    return !usesGenerators && Xbyak::util::Cpu().has(Xbyak::util::Cpu::tAVX2);
+}
+
+size_t GAsmInterpreter::generateLanes(Xbyak::CodeGenerator& code, const std::vector<IrInstruction>& program,
+                                      const JitShape& shape, MathMode mathMode) {
+    using namespace Xbyak::util;
+    constexpr int lanes = (int)CompiledProgram::lanes;
+
+    // --- ANALYSIS ---
+    const size_t length = program.size();
+    const IrBlocks blocks = GAsmIR::matchBlocks(program);
+    const size_t maxDepth = blocks.maxDepth;  // deepest block nesting, every open block saves the mask of the lanes outside
+    const size_t forSlots = blocks.forSlots;
+    const size_t knownInputs = shape.inputLength <= INT_MAX ? shape.inputLength : 0;
+    const size_t knownRegisters = shape.registerLength <= INT_MAX ? shape.registerLength : 0;
+    const std::vector<uint64_t> remainingCost = GAsmIR::remainingCost(program);
+
+    // Register mapping, every ymm register holds one value per lane:
+    // ymm0 -> A (double)
+    #define A ymm0
+    // ymm1 -> P (size_t)
+    #define P ymm1
+    // ymm2 -> P % inputLength (size_t)
+    #define PI ymm2
+    // ymm3 -> P % registerLength (size_t)
+    #define PR ymm3
+    // ymm4 -> process time (size_t)
+    #define laneTime ymm4
+    // ymm5 -> lanes running the current instruction, all ones or all zeros
+    #define mask ymm5
+    // ymm6-ymm11 -> free to use in the program
+    // r14 -> inputs of the group (double*), lane interleaved
+    #define inputs r14
+    // r15 -> registers of the group (double*), lane interleaved
+    #define registers r15
+    // QWORD PTR [rbp - 48] -> input length (size_t)
+    #define inputLength qword[rbp - 48]
+    // QWORD PTR [rbp - 56] -> register length (size_t)
+    #define registerLength qword[rbp - 56]
+    // QWORD PTR [rbp - 64] -> max process time (size_t)
+    #define maxProcessTime qword[rbp - 64]
+    // QWORD PTR [rbp - 72] -> where to save the process times of the lanes (size_t*)
+    #define processTimes qword[rbp - 72]
+    // QWORD PTR [rbp - 80] -> LOP iterations that didn't run on all the lanes of the loop (size_t)
+    #define divergentIterations qword[rbp - 80]
+    // [rbp - 96 - 16 * k] -> caller's xmm6 + k on windows
+    // YMMWORD PTR [rbp - 256 - 32 * slot] -> vector slots below
+    enum {
+        SIGN,              // 1 << 63, turns unsigned comparisons into signed ones
+        ONE,               // 1
+        LANE_IDS,          // 0, 1, 2, 3
+        INPUT_LENGTHS,     // input length
+        REGISTER_LENGTHS,  // register length
+        WRAP_PI,           // (size_t)-1 % inputLength, PI after DEC wraps P around
+        WRAP_PR,           // (size_t)-1 % registerLength
+        LOOP_END_PR,       // inputLength % registerLength, PR after a FOR loop ends
+        LOW_32,            // 0xffffffff
+        TWO_52,            // bits of 2^52
+        TWO_84,            // bits of 2^84
+        TWO_84_52,         // 2^84 + 2^52
+        SPILL_A,           // state while a function is called
+        SPILL_P,
+        SPILL_PI,
+        SPILL_PR,
+        SPILL_TIME,
+        SPILL_MASK,
+        TEMP,
+        SAVED_MASKS        // mask outside of every open block, one slot per nesting level
+    };
+    auto slot = [](size_t index, int lane = 0) { return rbp - (int)(256 + 32 * index) + 8 * lane; };
+    #define vec(index) yword[slot(index)]
+    const size_t countersBase = 256 + 32 * (SAVED_MASKS + std::max<size_t>(maxDepth, 1) - 1);
+    // QWORD PTR [rbp - countersBase - 8 - 16 * slot] -> counter of a FOR loop, the same in all lanes (size_t)
+    #define forCounter(slot) qword[rbp - (int)(countersBase + 8 + 16 * (slot))]
+    // QWORD PTR [rbp - countersBase - 16 - 16 * slot] -> counter % registerLength of a FOR loop (size_t)
+    #define forCounterPR(slot) qword[rbp - (int)(countersBase + 16 + 16 * (slot))]
+#ifdef _WIN64
+    constexpr size_t shadowSpace = 32;
+    constexpr int savedXmms = 6;  // xmm6-xmm11 belong to the caller
+#else
+    constexpr size_t shadowSpace = 0;
+#endif
+    // 40 bytes of pushes, the rest keeps the stack aligned to 16 bytes at every call
+    const size_t locals = countersBase + 16 * forSlots - 40 + shadowSpace;
+
+    // --- HELPERS ---
+    // fills all the lanes of a vector slot with a 64-bit register
+    auto fillSlot = [&](size_t index, const Xbyak::Reg64& value) {
+        for (int l = 0; l < lanes; l++) {
+            code.mov(qword[slot(index, l)], value);
+        }
+    };
+    // ymm = value in all the lanes
+    auto broadcast = [&](const Xbyak::Ymm& ymm, uint64_t value) {
+        code.mov(rax, value);
+        code.vmovq(Xbyak::Xmm(ymm.getIdx()), rax);
+        code.vpbroadcastq(ymm, Xbyak::Xmm(ymm.getIdx()));
+    };
+    // time of the active lanes += cost
+    auto charge = [&](uint64_t cost, const Xbyak::Ymm& lanesMask) {
+        if (cost == 0) {
+            return;
+        }
+        broadcast(ymm6, cost);
+        code.vpand(ymm6, ymm6, lanesMask);
+        code.vpaddq(laneTime, laneTime, ymm6);
+    };
+    // dst = values[index * lanes + lane] of every lane, dst can't be ymm7 or ymm8
+    auto gather = [&](const Xbyak::Ymm& dst, const Xbyak::Reg64& values, const Xbyak::Ymm& index) {
+        code.vpsllq(ymm7, index, 2);
+        code.vpaddq(ymm7, ymm7, vec(LANE_IDS));
+        code.vpcmpeqq(ymm8, ymm8, ymm8);  // the gather clears its mask
+        code.vgatherqpd(dst, ptr[values + ymm7 * 8], ymm8);
+    };
+    // values[index * lanes + lane] = A in the active lanes, there's no scatter in AVX2
+    auto scatter = [&](const Xbyak::Reg64& values, const Xbyak::Ymm& index) {
+        code.vpsllq(ymm7, index, 2);
+        code.vpaddq(ymm7, ymm7, vec(LANE_IDS));
+        code.vmovdqu(vec(TEMP), ymm7);
+        code.vmovupd(vec(SPILL_A), A);
+        code.vmovdqu(vec(SPILL_MASK), mask);
+        for (int l = 0; l < lanes; l++) {
+            Xbyak::Label inactive;
+            code.mov(rax, qword[slot(SPILL_MASK, l)]);
+            code.test(rax, rax);
+            code.jz(inactive);
+            code.mov(rcx, qword[slot(TEMP, l)]);
+            code.mov(rdx, qword[slot(SPILL_A, l)]);
+            code.mov(qword[values + rcx * 8], rdx);
+            code.L(inactive);
+        }
+    };
+    // dst = (double) P, P is unsigned, the high and low halves are converted exactly and added once
+    auto convertP = [&](const Xbyak::Ymm& dst) {
+        code.vpand(ymm7, P, vec(LOW_32));
+        code.vpor(ymm7, ymm7, vec(TWO_52));      // 2^52 + low
+        code.vpsrlq(dst, P, 32);
+        code.vpor(dst, dst, vec(TWO_84));        // 2^84 + high * 2^32
+        code.vsubpd(dst, dst, vec(TWO_84_52));
+        code.vaddpd(dst, dst, ymm7);
+    };
+    // ymm6 = function(ymm6) in every lane, the state lives in the frame during the call
+    auto callMath = [&](void (*function)(double*)) {
+        code.vmovupd(vec(SPILL_A), A);
+        code.vmovdqu(vec(SPILL_P), P);
+        code.vmovdqu(vec(SPILL_PI), PI);
+        code.vmovdqu(vec(SPILL_PR), PR);
+        code.vmovdqu(vec(SPILL_TIME), laneTime);
+        code.vmovdqu(vec(SPILL_MASK), mask);
+        code.vmovupd(vec(TEMP), ymm6);
+        code.vzeroupper();  // the callee uses SSE
+#if defined(__unix__)
+        code.lea(rdi, ptr[slot(TEMP)]);
+#elif defined(_WIN64)
+        code.lea(rcx, ptr[slot(TEMP)]);
+#endif
+        code.mov(rax, (uint64_t)(void*)function);
+        code.call(rax);
+        code.vmovupd(A, vec(SPILL_A));
+        code.vmovdqu(P, vec(SPILL_P));
+        code.vmovdqu(PI, vec(SPILL_PI));
+        code.vmovdqu(PR, vec(SPILL_PR));
+        code.vmovdqu(laneTime, vec(SPILL_TIME));
+        code.vmovdqu(mask, vec(SPILL_MASK));
+        code.vmovupd(ymm6, vec(TEMP));
+    };
+    const bool fastMath = mathMode == MathMode::Fast;
+    void (*sinLanes)(double*) = fastMath ? &applyToLanes<FastMath::sin> : &applyToLanes<libmSin>;
+    void (*cosLanes)(double*) = fastMath ? &applyToLanes<FastMath::cos> : &applyToLanes<libmCos>;
+    void (*expLanes)(double*) = fastMath ? &applyToLanes<FastMath::exp> : &applyToLanes<libmExp>;
+    // dst = P % length in every lane, AVX2 can't divide integers
+    auto laneModulo = [&](const Xbyak::Ymm& dst, size_t known, const Xbyak::Address& lengthAddress,
+                                     size_t spill) {
+        if (known == 1) {
+            code.vpxor(dst, dst, dst);
+            return;
+        }
+        code.vmovdqu(vec(TEMP), ymm6);
+        for (int l = 0; l < lanes; l++) {
+            code.mov(rax, qword[slot(TEMP, l)]);
+            if (known != 0 && std::has_single_bit(known)) {
+                code.mov(rdx, known - 1);
+                code.and_(rdx, rax);
+            } else {
+                code.xor_(edx, edx);
+                if (known == 0) {
+                    code.div(lengthAddress);
+                } else {
+                    code.mov(ecx, known);
+                    code.div(rcx);
+                }
+            }
+            code.mov(qword[slot(spill, l)], rdx);
+        }
+        code.vmovdqu(dst, vec(spill));
+    };
+
+    Xbyak::Label bail;
+    Xbyak::Label epilogue;
+
+    // --- ENTRY (lanes_fn_t) ---
+    const size_t entryOffset = code.getSize();
+    code.push(rbp);
+    code.mov(rbp, rsp);
+    code.push(rbx);
+    code.push(r12);
+    code.push(r13);
+    code.push(r14);
+    code.push(r15);
+    code.sub(rsp, locals);
+#if defined(__unix__)
+// System V AMD64 ABI:
+// 1: inputs          -> rdi
+// 2: inputLength     -> rsi
+// 3: registers       -> rdx
+// 4: registerLength  -> rcx
+// 5: maxProcessTime  -> r8
+// 6: processTimes    -> r9
+    code.mov(inputs, rdi);
+    code.mov(inputLength, rsi);
+    code.mov(registers, rdx);
+    code.mov(registerLength, rcx);
+    code.mov(maxProcessTime, r8);
+    code.mov(processTimes, r9);
+#elif defined(_WIN64)
+// Microsoft x64 ABI:
+// 1: inputs          -> rcx
+// 2: inputLength     -> rdx
+// 3: registers       -> r8
+// 4: registerLength  -> r9
+// 5-6: maxProcessTime, processTimes -> [rbp+48], [rbp+56] after push rbp/mov rbp,rsp
+    for (int k = 0; k < savedXmms; k++) {
+        code.vmovdqu(xword[rbp - (96 + 16 * k)], Xbyak::Xmm(6 + k));
+    }
+    code.mov(inputs, rcx);
+    code.mov(inputLength, rdx);
+    code.mov(registers, r8);
+    code.mov(registerLength, r9);
+    code.mov(rax, qword[rbp + 48]);
+    code.mov(maxProcessTime, rax);
+    code.mov(rax, qword[rbp + 56]);
+    code.mov(processTimes, rax);
+#else
+#   error "Unsupported platform / calling convention"
+#endif
+    // the program alone might not fit into the budget, only the checked scalar code stops exactly
+    code.mov(rax, remainingCost[0]);
+    code.cmp(rax, maxProcessTime);
+    code.ja(bail, Xbyak::CodeGenerator::LabelType::T_NEAR);
+
+    // constants of the group
+    code.mov(rax, (uint64_t)1 << 63);
+    fillSlot(SIGN, rax);
+    code.mov(eax, 1);
+    fillSlot(ONE, rax);
+    for (int l = 0; l < lanes; l++) {
+        code.mov(qword[slot(LANE_IDS, l)], l);
+    }
+    code.mov(eax, 0xffffffff);
+    fillSlot(LOW_32, rax);
+    code.mov(rax, std::bit_cast<uint64_t>(0x1p52));
+    fillSlot(TWO_52, rax);
+    code.mov(rax, std::bit_cast<uint64_t>(0x1p84));
+    fillSlot(TWO_84, rax);
+    code.mov(rax, std::bit_cast<uint64_t>(0x1p84 + 0x1p52));
+    fillSlot(TWO_84_52, rax);
+    code.mov(rcx, inputLength);
+    fillSlot(INPUT_LENGTHS, rcx);
+    code.mov(rax, -1);
+    code.xor_(edx, edx);
+    code.div(rcx);
+    fillSlot(WRAP_PI, rdx);
+    code.mov(rcx, registerLength);
+    fillSlot(REGISTER_LENGTHS, rcx);
+    code.mov(rax, -1);
+    code.xor_(edx, edx);
+    code.div(rcx);
+    fillSlot(WRAP_PR, rdx);
+    code.mov(rax, inputLength);
+    code.xor_(edx, edx);
+    code.div(rcx);
+    fillSlot(LOOP_END_PR, rdx);
+
+    // registers are cleared before every group
+    code.xor_(eax, eax);
+    code.mov(rcx, registerLength);
+    code.shl(rcx, 2);  // lanes registers each
+    Xbyak::Label clearRegisters;
+    code.L(clearRegisters);
+    code.mov(ptr[registers + rcx * 8 - 8], rax);
+    code.sub(rcx, 1);
+    code.jnz(clearRegisters);
+
+    // reset the state, every lane starts
+    code.vxorpd(A, A, A);
+    code.vpxor(P, P, P);
+    code.vpxor(PI, PI, PI);
+    code.vpxor(PR, PR, PR);
+    code.vpxor(laneTime, laneTime, laneTime);
+    code.vpcmpeqq(mask, mask, mask);
+    code.mov(divergentIterations, 0);
+
+    // --- PROGRAM ---
+    // Lanes share one instruction stream. A block leaves the lanes that skip it out of the mask
+    // and brings them back at its END, a loop runs until none of its lanes wants another iteration.
+    // Time is charged per lane when a block is entered, like in the fast scalar copy. When a lane
+    // might go over the budget before the next loop check, the group gives up and runs case by case
+    // in the scalar code, which stops exactly where the interpreter does.
+    std::vector<Xbyak::Label> body(length);   // first instruction inside a block
+    std::vector<Xbyak::Label> close(length);  // END of a block, the mask is restored there
+    // ymm9 = lanes of the mask that enter the block of the structural instruction
+    auto emitCondition = [&](uint8_t opcode) {
+        switch (opcode) {
+            case LOP_A: {
+                gather(ymm6, inputs, PI);
+                code.vcmppd(ymm9, ymm6, A, 0x1E);  // I[P] > A, ordered
+                break;
+            }
+            case LOP_P: {
+                code.vpxor(ymm9, P, vec(SIGN));
+                code.vmovdqu(ymm10, vec(INPUT_LENGTHS));
+                code.vpxor(ymm10, ymm10, vec(SIGN));
+                code.vpcmpgtq(ymm9, ymm10, ymm9);  // P < inputLength, unsigned
+                break;
+            }
+            case JMP_I:
+            case EMPTY_JMP_I: {
+                gather(ymm6, inputs, PI);
+                code.vcmppd(ymm9, A, ymm6, 0x19);  // !(A >= I[P])
+                break;
+            }
+            case JMP_R:
+            case EMPTY_JMP_R: {
+                gather(ymm6, registers, PR);
+                code.vcmppd(ymm9, A, ymm6, 0x19);  // !(A >= R[P])
+                break;
+            }
+            case JMP_P:
+            case EMPTY_JMP_P: {
+                convertP(ymm6);
+                code.vcmppd(ymm9, ymm6, A, 0x19);  // !((double) P >= A)
+                break;
+            }
+            default: {
+                break;
+            }
+        }
+        code.vpand(ymm9, ymm9, mask);
+    };
+    // jump back to the body of the loop at index o, unless a lane might go over the budget
+    auto loopBack = [&](size_t o) {
+        code.mov(rax, maxProcessTime);
+        code.mov(rcx, remainingCost[o + 1]);
+        code.sub(rax, rcx);
+        code.jb(bail, Xbyak::CodeGenerator::LabelType::T_NEAR);  // the rest alone might not fit
+        code.vmovq(xmm6, rax);
+        code.vpbroadcastq(ymm6, xmm6);
+        code.vpxor(ymm6, ymm6, vec(SIGN));
+        code.vpxor(ymm7, laneTime, vec(SIGN));
+        code.vpcmpgtq(ymm7, ymm7, ymm6);  // time > max - remaining, unsigned
+        code.vptest(ymm7, mask);
+        code.jnz(bail, Xbyak::CodeGenerator::LabelType::T_NEAR);
+        code.jmp(body[o], Xbyak::CodeGenerator::LabelType::T_NEAR);
+    };
+
+    for (size_t i = 0; i < length; i++) {
+        const IrInstruction& instruction = program[i];
+        const uint8_t opcode = instruction.opcode;
+        if (GAsmIR::isBlockStart(program, i)) {
+            charge(GAsmIR::blockCost(program, i), mask);
+        }
+        if (GAsmParser::isStructural(opcode)) {
+            code.vmovdqu(vec(SAVED_MASKS + blocks.depth[i]), mask);
+            if (opcode == FOR) {
+                // P = 0 in the active lanes, the counter is the same in all of them
+                code.vpxor(ymm6, ymm6, ymm6);
+                code.vpblendvb(P, P, ymm6, mask);
+                code.vpblendvb(PI, PI, ymm6, mask);
+                code.vpblendvb(PR, PR, ymm6, mask);
+                code.mov(forCounter(blocks.forSlot[i]), 0);
+                code.mov(forCounterPR(blocks.forSlot[i]), 0);
+            } else {
+                emitCondition(opcode);
+                code.vmovdqa(mask, ymm9);
+                code.vptest(mask, mask);
+                code.jz(close[i], Xbyak::CodeGenerator::LabelType::T_NEAR);  // every lane skips
+            }
+            code.L(body[i]);
+            continue;
+        }
+        switch (opcode) {
+            case MOV_P_A: {
+                // P = (int) A, sign extended like in the interpreter
+                code.vcvttpd2dq(xmm6, A);
+                code.vpmovsxdq(ymm6, xmm6);
+                laneModulo(ymm10, knownRegisters, registerLength, SPILL_PR);
+                laneModulo(ymm11, knownInputs, inputLength, SPILL_PI);
+                code.vpblendvb(P, P, ymm6, mask);
+                code.vpblendvb(PI, PI, ymm11, mask);
+                code.vpblendvb(PR, PR, ymm10, mask);
+                break;
+            }
+            case MOV_A_P: {
+                convertP(ymm6);
+                code.vblendvpd(A, A, ymm6, mask);
+                break;
+            }
+            case MOV_A_R:
+            case MOV_A_I: {
+                gather(ymm6, opcode == MOV_A_R ? registers : inputs, opcode == MOV_A_R ? PR : PI);
+                code.vblendvpd(A, A, ymm6, mask);
+                break;
+            }
+            case MOV_R_A: {
+                scatter(registers, PR);
+                break;
+            }
+            case MOV_I_A: {
+                scatter(inputs, PI);
+                break;
+            }
+            case ADD_R: case SUB_R: case DIV_R: case MUL_R:
+            case ADD_I: case SUB_I: case DIV_I: case MUL_I: {
+                const bool fromRegisters = opcode <= MUL_R;
+                gather(ymm6, fromRegisters ? registers : inputs, fromRegisters ? PR : PI);
+                switch (fromRegisters ? opcode : opcode - ADD_I + ADD_R) {
+                    case ADD_R: code.vaddpd(ymm6, A, ymm6); break;
+                    case SUB_R: code.vsubpd(ymm6, A, ymm6); break;
+                    case DIV_R: code.vdivpd(ymm6, A, ymm6); break;
+                    default: code.vmulpd(ymm6, A, ymm6); break;
+                }
+                code.vblendvpd(A, A, ymm6, mask);
+                break;
+            }
+            case SIN_R: case COS_R: case EXP_R:
+            case SIN_I: case COS_I: case EXP_I: {
+                const bool fromRegisters = opcode <= EXP_R;
+                gather(ymm6, fromRegisters ? registers : inputs, fromRegisters ? PR : PI);
+                const uint8_t function = fromRegisters ? opcode : opcode - SIN_I + SIN_R;
+                callMath(function == SIN_R ? sinLanes : function == COS_R ? cosLanes : expLanes);
+                code.vblendvpd(A, A, ymm6, mask);
+                break;
+            }
+            case INC: {
+                // P++, the remainders wrap to 0 at the length and when P wraps around
+                code.vpaddq(ymm6, P, vec(ONE));
+                code.vpxor(ymm9, ymm9, ymm9);
+                code.vpcmpeqq(ymm9, ymm6, ymm9);  // P == 0
+                code.vpaddq(ymm10, PI, vec(ONE));
+                code.vpcmpeqq(ymm11, ymm10, vec(INPUT_LENGTHS));
+                code.vpor(ymm11, ymm11, ymm9);
+                code.vpandn(ymm10, ymm11, ymm10);
+                code.vpaddq(ymm7, PR, vec(ONE));
+                code.vpcmpeqq(ymm11, ymm7, vec(REGISTER_LENGTHS));
+                code.vpor(ymm11, ymm11, ymm9);
+                code.vpandn(ymm7, ymm11, ymm7);
+                code.vpblendvb(P, P, ymm6, mask);
+                code.vpblendvb(PI, PI, ymm10, mask);
+                code.vpblendvb(PR, PR, ymm7, mask);
+                break;
+            }
+            case DEC: {
+                // P--, the remainders wrap to length - 1 at 0 and to (size_t)-1 % length when P wraps around
+                code.vpsubq(ymm6, P, vec(ONE));
+                code.vpcmpeqq(ymm9, ymm9, ymm9);
+                code.vpcmpeqq(ymm9, ymm6, ymm9);  // P == (size_t)-1
+                code.vpxor(ymm11, ymm11, ymm11);
+                code.vpcmpeqq(ymm11, PI, ymm11);
+                code.vblendvpd(ymm10, PI, vec(INPUT_LENGTHS), ymm11);
+                code.vpsubq(ymm10, ymm10, vec(ONE));
+                code.vblendvpd(ymm10, ymm10, vec(WRAP_PI), ymm9);
+                code.vpxor(ymm11, ymm11, ymm11);
+                code.vpcmpeqq(ymm11, PR, ymm11);
+                code.vblendvpd(ymm7, PR, vec(REGISTER_LENGTHS), ymm11);
+                code.vpsubq(ymm7, ymm7, vec(ONE));
+                code.vblendvpd(ymm7, ymm7, vec(WRAP_PR), ymm9);
+                code.vpblendvb(P, P, ymm6, mask);
+                code.vpblendvb(PI, PI, ymm10, mask);
+                code.vpblendvb(PR, PR, ymm7, mask);
+                break;
+            }
+            case RES: {
+                code.vpxor(ymm6, ymm6, ymm6);
+                code.vpblendvb(P, P, ymm6, mask);
+                code.vpblendvb(PI, PI, ymm6, mask);
+                code.vpblendvb(PR, PR, ymm6, mask);
+                break;
+            }
+            case EMPTY_JMP_I:
+            case EMPTY_JMP_R:
+            case EMPTY_JMP_P: {
+                // the block only takes time in the lanes that don't skip it
+                emitCondition(opcode);
+                charge(instruction.bodyCost, ymm9);
+                break;
+            }
+            case END: {
+                // END without a block does nothing
+                if (blocks.match[i] == length) {
+                    break;
+                }
+                const size_t o = blocks.match[i];
+                const size_t forSlot = blocks.forSlot[i];
+                switch (program[o].opcode) {
+                    case FOR: {
+                        // P = ++counter in the active lanes
+                        code.mov(rax, forCounter(forSlot));
+                        code.add(rax, 1);
+                        code.mov(forCounter(forSlot), rax);
+                        Xbyak::Label endLoop;
+                        code.cmp(rax, inputLength);
+                        code.jae(endLoop, Xbyak::CodeGenerator::LabelType::T_NEAR);  // end if P >= length
+                        code.vmovq(xmm6, rax);
+                        code.vpbroadcastq(ymm6, xmm6);
+                        code.mov(rcx, forCounterPR(forSlot));
+                        code.add(rcx, 1);
+                        code.xor_(edx, edx);
+                        code.cmp(rcx, registerLength);
+                        code.cmove(rcx, rdx);
+                        code.mov(forCounterPR(forSlot), rcx);
+                        code.vmovq(xmm7, rcx);
+                        code.vpbroadcastq(ymm7, xmm7);
+                        code.vpblendvb(P, P, ymm6, mask);
+                        code.vpblendvb(PI, PI, ymm6, mask);  // P < inputLength
+                        code.vpblendvb(PR, PR, ymm7, mask);
+                        loopBack(o);
+                        // end loop, P == inputLength
+                        code.L(endLoop);
+                        code.vpxor(ymm6, ymm6, ymm6);
+                        code.vpblendvb(P, P, vec(INPUT_LENGTHS), mask);
+                        code.vpblendvb(PI, PI, ymm6, mask);
+                        code.vpblendvb(PR, PR, vec(LOOP_END_PR), mask);
+                        break;
+                    }
+                    case LOP_A:
+                    case LOP_P: {
+                        // lanes whose condition still holds run another iteration
+                        Xbyak::Label endLoop, allLanes;
+                        emitCondition(program[o].opcode);
+                        code.vptest(ymm9, ymm9);
+                        code.jz(endLoop, Xbyak::CodeGenerator::LabelType::T_NEAR);
+                        code.vpxor(ymm10, ymm9, vec(SAVED_MASKS + blocks.depth[i]));
+                        code.vptest(ymm10, ymm10);
+                        code.jz(allLanes);
+                        code.add(divergentIterations, 1);
+                        code.cmp(divergentIterations, maxDivergentIterations);
+                        code.ja(bail, Xbyak::CodeGenerator::LabelType::T_NEAR);
+                        code.L(allLanes);
+                        code.vmovdqa(mask, ymm9);
+                        loopBack(o);
+                        code.L(endLoop);
+                        break;
+                    }
+                    default: {
+                        // this case is for JMP_I, JMP_R, JMP_P
+                        break;
+                    }
+                }
+                // lanes that skipped the block or left the loop earlier come back
+                code.L(close[o]);
+                code.vmovdqu(mask, vec(SAVED_MASKS + blocks.depth[i]));
+                break;
+            }
+            default: {
+                // unknown opcode, only takes time
+                break;
+            }
+        }
+    }
+    // blocks without END skip to the end of the program
+    for (size_t i = 0; i < length; i++) {
+        if (GAsmParser::isStructural(program[i].opcode) && blocks.match[i] == length) {
+            code.L(close[i]);
+        }
+    }
+
+    // every lane finished within the budget
+    code.mov(rax, processTimes);
+    code.vmovdqu(yword[rax], laneTime);
+    code.xor_(eax, eax);
+    code.jmp(epilogue, Xbyak::CodeGenerator::LabelType::T_NEAR);
+
+    code.L(bail);
+    code.mov(eax, 1);
+
+    code.L(epilogue);
+    code.vzeroupper();
+#ifdef _WIN64
+    for (int k = 0; k < savedXmms; k++) {
+        code.vmovdqu(Xbyak::Xmm(6 + k), xword[rbp - (96 + 16 * k)]);
+    }
+#endif
+    code.add(rsp, locals);
+    code.pop(r15);
+    code.pop(r14);
+    code.pop(r13);
+    code.pop(r12);
+    code.pop(rbx);
+    code.pop(rbp);
+    code.ret();
+    return entryOffset;
+}
@@ -3,3 +3,19 @@
 //
 
 #include "Individual.h"
+
+std::vector<uint8_t> Individual::getEffectiveBytecode() const {
+    std::vector<bool> effective = GAsmIR::effective(bytecode_);
+    std::vector<uint8_t> result;
+    for (size_t i = 0; i < bytecode_.size(); i++) {
+        if (effective[i]) {
+            result.push_back(bytecode_[i]);
+        }
+    }
+    return result;
+}
+
+std::string Individual::effectiveToString() const {
+    std::vector<uint8_t> bytecode = getEffectiveBytecode();
+    return GAsmParser::bytecode2Text(bytecode.data(), bytecode.size());
+}
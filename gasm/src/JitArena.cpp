@@ -0,0 +1,293 @@
+//
+// Regions of executable memory mapped twice, written through one view and run from the other
+//
+
+#include <cstring>
+#include <stdexcept>
+#include "JitArena.h"
+
+#if defined(__unix__)
+#include <sys/mman.h>
+#include <unistd.h>
+#elif defined(_WIN64)
+#include <windows.h>
+#else
+#   error "Unsupported platform"
+#endif
+
+static constexpr size_t hugePageSize = 2 * 1024 * 1024;
+
+static size_t roundUp(size_t size, size_t granularity) {
+    return (size + granularity - 1) / granularity * granularity;
+}
+
+// views are mapped in multiples of it
+static size_t mappingGranularity() {
+#if defined(__unix__)
+    return (size_t)sysconf(_SC_PAGESIZE);
+#elif defined(_WIN64)
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return info.dwAllocationGranularity;
+#endif
+}
+
+#if defined(__unix__)
+// maps the file read-write and read-execute, the file itself is no longer needed afterwards
+static bool mapViews(int fd, size_t size, uint8_t*& write, uint8_t*& execute) {
+    if (fd < 0) {
+        return false;
+    }
+    bool mapped = false;
+    if (ftruncate(fd, (off_t)size) == 0) {
+        void* w = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        void* x = w == MAP_FAILED ? MAP_FAILED : mmap(nullptr, size, PROT_READ | PROT_EXEC, MAP_SHARED, fd, 0);
+        if (x != MAP_FAILED) {
+            write = (uint8_t*)w;
+            execute = (uint8_t*)x;
+            mapped = true;
+        } else if (w != MAP_FAILED) {
+            munmap(w, size);
+        }
+    }
+    close(fd);
+    return mapped;
+}
+#elif defined(_WIN64)
+static bool mapViews(DWORD flags, size_t size, uint8_t*& write, uint8_t*& execute) {
+    HANDLE mapping = CreateFileMappingW(INVALID_HANDLE_VALUE, nullptr, PAGE_EXECUTE_READWRITE | flags,
+                                        (DWORD)(size >> 32), (DWORD)size, nullptr);
+    if (mapping == nullptr) {
+        return false;
+    }
+    void* w = MapViewOfFile(mapping, FILE_MAP_WRITE, 0, 0, size);
+    void* x = w == nullptr ? nullptr : MapViewOfFile(mapping, FILE_MAP_READ | FILE_MAP_EXECUTE, 0, 0, size);
+    CloseHandle(mapping);  // the views keep the memory
+    if (x == nullptr) {
+        if (w != nullptr) {
+            UnmapViewOfFile(w);
+        }
+        return false;
+    }
+    write = (uint8_t*)w;
+    execute = (uint8_t*)x;
+    return true;
+}
+#endif
+
+JitBlock::JitBlock(JitBlock&& other) noexcept
+    : arena_(other.arena_), region_(other.region_), code_(other.code_), size_(other.size_) {
+    other.region_ = nullptr;
+    other.code_ = nullptr;
+    other.size_ = 0;
+}
+
+JitBlock& JitBlock::operator=(JitBlock&& other) noexcept {
+    if (this != &other) {
+        if (region_ != nullptr) {
+            arena_->release(region_, size_);
+        }
+        arena_ = other.arena_;
+        region_ = other.region_;
+        code_ = other.code_;
+        size_ = other.size_;
+        other.region_ = nullptr;
+        other.code_ = nullptr;
+        other.size_ = 0;
+    }
+    return *this;
+}
+
+JitBlock::~JitBlock() {
+    if (region_ != nullptr) {
+        arena_->release(region_, size_);
+    }
+}
+
+JitArena::~JitArena() {
+    while (!regions_.empty()) {
+        unmap(regions_.back().get());
+    }
+}
+
+JitArena& JitArena::global() {
+    // leaked on purpose, compiled programs in static objects are destroyed after it otherwise
+    static JitArena* arena = new JitArena();
+    return *arena;
+}
+
+JitArena::Region* JitArena::map(size_t size) {
+    auto region = std::make_unique<Region>();
+    region->hugePages = hugePages_;
+    bool mapped = false;
+#if defined(__unix__)
+    if (hugePages_) {
+#ifdef MFD_HUGETLB
+        // fails when the system has no huge pages reserved
+        size_t hugeSize = roundUp(size, hugePageSize);
+        mapped = mapViews(memfd_create("gasm-jit", MFD_CLOEXEC | MFD_HUGETLB), hugeSize, region->write, region->execute);
+        if (mapped) {
+            size = hugeSize;
+        }
+#endif
+    }
+    if (!mapped) {
+        size = roundUp(size, mappingGranularity());
+        mapped = mapViews(memfd_create("gasm-jit", MFD_CLOEXEC), size, region->write, region->execute);
+#ifdef MADV_HUGEPAGE
+        if (mapped && hugePages_) {
+            // transparent huge pages, only a hint
+            madvise(region->execute, size, MADV_HUGEPAGE);
+        }
+#endif
+    }
+#elif defined(_WIN64)
+    if (hugePages_ && GetLargePageMinimum() != 0) {
+        // needs the lock pages in memory privilege
+        size_t largeSize = roundUp(size, GetLargePageMinimum());
+        mapped = mapViews(SEC_COMMIT | SEC_LARGE_PAGES, largeSize, region->write, region->execute);
+        if (mapped) {
+            size = largeSize;
+        }
+    }
+    if (!mapped) {
+        size = roundUp(size, mappingGranularity());
+        mapped = mapViews(SEC_COMMIT, size, region->write, region->execute);
+    }
+#endif
+    if (!mapped) {
+        throw std::runtime_error("Cannot map executable memory for compiled programs");
+    }
+    region->size = size;
+    mappedBytes_ += size;
+    regions_.push_back(std::move(region));
+    return regions_.back().get();
+}
+
+void JitArena::unmap(Region* region) {
+#if defined(__unix__)
+    munmap(region->write, region->size);
+    munmap(region->execute, region->size);
+#elif defined(_WIN64)
+    UnmapViewOfFile(region->write);
+    UnmapViewOfFile(region->execute);
+#endif
+    mappedBytes_ -= region->size;
+    for (auto it = regions_.begin(); it != regions_.end(); ++it) {
+        if (it->get() == region) {
+            regions_.erase(it);
+            break;
+        }
+    }
+}
+
+void JitArena::retire(Region* region) {
+    // still has programs, the last one to die frees the region
+    if (region->blocks != 0) {
+        return;
+    }
+    freedRegions_++;
+    if (spare_ == nullptr && region->size == regionSize_ && region->hugePages == hugePages_) {
+        region->used = 0;
+        spare_ = region;
+        return;
+    }
+    unmap(region);
+}
+
+void JitArena::release(void* region, size_t size) {
+    std::lock_guard<std::mutex> guard(mutex_);
+    auto* r = (Region*)region;
+    r->blocks--;
+    usedBytes_ -= size;
+    blocks_--;
+    if (r != current_) {
+        retire(r);
+    }
+}
+
+JitBlock JitArena::allocate(const uint8_t* code, size_t size) {
+    std::lock_guard<std::mutex> guard(mutex_);
+    const size_t padded = roundUp(size, alignment);
+    Region* region;
+    if (padded > regionSize_) {
+        // too big to share a region, freed as soon as the program dies
+        region = map(padded);
+    } else {
+        if (current_ == nullptr || current_->size - current_->used < padded) {
+            Region* full = current_;
+            if (spare_ != nullptr) {
+                current_ = spare_;
+                spare_ = nullptr;
+            } else {
+                current_ = map(regionSize_);
+            }
+            if (full != nullptr) {
+                retire(full);
+            }
+        }
+        region = current_;
+    }
+    // the other threads only run code from the execute view, writing the unused part is safe
+    std::memcpy(region->write + region->used, code, size);
+    const uint8_t* executable = region->execute + region->used;
+    region->used += padded;
+    region->blocks++;
+    usedBytes_ += padded;
+    blocks_++;
+    allocations_++;
+    return {this, region, executable, padded};
+}
+
+void JitArena::newGeneration() {
+    std::lock_guard<std::mutex> guard(mutex_);
+    if (current_ == nullptr || current_->used == 0) {
+        return;
+    }
+    Region* old = current_;
+    current_ = nullptr;
+    retire(old);
+}
+
+JitArenaStats JitArena::getStats() const {
+    std::lock_guard<std::mutex> guard(mutex_);
+    JitArenaStats stats;
+    stats.regions = regions_.size();
+    stats.mappedBytes = mappedBytes_;
+    stats.usedBytes = usedBytes_;
+    stats.blocks = blocks_;
+    stats.allocations = allocations_;
+    stats.freedRegions = freedRegions_;
+    return stats;
+}
+
+size_t JitArena::getRegionSize() const {
+    std::lock_guard<std::mutex> guard(mutex_);
+    return regionSize_;
+}
+
+void JitArena::setRegionSize(size_t regionSize) {
+    if (regionSize == 0) {
+        throw std::invalid_argument("Region size should be greater than 0");
+    }
+    std::lock_guard<std::mutex> guard(mutex_);
+    regionSize_ = roundUp(regionSize, mappingGranularity());
+    if (spare_ != nullptr && spare_->size != regionSize_) {
+        unmap(spare_);
+        spare_ = nullptr;
+    }
+}
+
+bool JitArena::getHugePages() const {
+    std::lock_guard<std::mutex> guard(mutex_);
+    return hugePages_;
+}
+
+void JitArena::setHugePages(bool hugePages) {
+    std::lock_guard<std::mutex> guard(mutex_);
+    hugePages_ = hugePages;
+    if (spare_ != nullptr && spare_->hugePages != hugePages_) {
+        unmap(spare_);
+        spare_ = nullptr;
+    }
+}
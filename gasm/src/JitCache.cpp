@@ -0,0 +1,89 @@
+//
+// LRU cache of compiled programs keyed by their bytecode
+//
+
+#include "JitCache.h"
+
+uint64_t JitCache::hash(const uint8_t* data, size_t length) {
+    // FNV-1a, programs are short so it's good enough
+    uint64_t h = 0xcbf29ce484222325ULL;
+    for (size_t i = 0; i < length; i++) {
+        h ^= data[i];
+        h *= 0x100000001b3ULL;
+    }
+    return h;
+}
+
+std::shared_ptr<const CompiledProgram> JitCache::find(const std::vector<uint8_t>& key) {
+    std::lock_guard<std::mutex> guard(mutex_);
+    auto it = index_.find(key);
+    if (it == index_.end()) {
+        misses_++;
+        return nullptr;
+    }
+    hits_++;
+    lru_.splice(lru_.begin(), lru_, it->second);  // mark as most recently used
+    return it->second->second;
+}
+
+bool JitCache::contains(const std::vector<uint8_t>& key) const {
+    std::lock_guard<std::mutex> guard(mutex_);
+    return index_.find(key) != index_.end();
+}
+
+std::shared_ptr<const CompiledProgram> JitCache::insert(const std::vector<uint8_t>& key,
+                                                        std::shared_ptr<const CompiledProgram> program) {
+    std::lock_guard<std::mutex> guard(mutex_);
+    auto it = index_.find(key);
+    if (it != index_.end()) {
+        // another thread compiled the same program first, share its code
+        lru_.splice(lru_.begin(), lru_, it->second);
+        return it->second->second;
+    }
+    bytes_ += program->size;
+    lru_.emplace_front(key, std::move(program));
+    index_.emplace(key, lru_.begin());
+    evict();
+    return lru_.front().second;
+}
+
+void JitCache::evict() {
+    // interpreters still running an evicted program keep it alive
+    while (bytes_ > maxBytes_ && lru_.size() > 1) {
+        Entry& last = lru_.back();
+        bytes_ -= last.second->size;
+        index_.erase(last.first);
+        lru_.pop_back();
+        evictions_++;
+    }
+}
+
+void JitCache::clear() {
+    std::lock_guard<std::mutex> guard(mutex_);
+    index_.clear();
+    lru_.clear();
+    bytes_ = 0;
+}
+
+JitCacheStats JitCache::getStats() const {
+    std::lock_guard<std::mutex> guard(mutex_);
+    JitCacheStats stats;
+    stats.hits = hits_;
+    stats.misses = misses_;
+    stats.evictions = evictions_;
+    stats.entries = lru_.size();
+    stats.bytes = bytes_;
+    stats.maxBytes = maxBytes_;
+    return stats;
+}
+
+size_t JitCache::getMaxBytes() const {
+    std::lock_guard<std::mutex> guard(mutex_);
+    return maxBytes_;
+}
+
+void JitCache::setMaxBytes(size_t maxBytes) {
+    std::lock_guard<std::mutex> guard(mutex_);
+    maxBytes_ = maxBytes;
+    evict();
+}
@@ -0,0 +1,174 @@
+//
+// CPU affinity and NUMA topology read from the system, no libnuma needed
+//
+
+#include <fstream>
+#include <sstream>
+#include <thread>
+#include "Placement.h"
+
+#if defined(__linux__)
+#include <sched.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#elif defined(_WIN64)
+#include <windows.h>
+#endif
+
+#if defined(__linux__)
+// "0-3,8,10-11" as in /sys/devices/system/node/node*/cpulist
+static std::vector<int> parseCpuList(const std::string& list) {
+    std::vector<int> cpus;
+    std::stringstream ranges(list);
+    std::string range;
+    while (std::getline(ranges, range, ',')) {
+        if (range.empty() || range == "\n") {
+            continue;
+        }
+        size_t dash = range.find('-');
+        int first = std::stoi(range.substr(0, dash));
+        int last = dash == std::string::npos ? first : std::stoi(range.substr(dash + 1));
+        for (int cpu = first; cpu <= last; cpu++) {
+            cpus.push_back(cpu);
+        }
+    }
+    return cpus;
+}
+
+static std::vector<int> cpusOfSet(const cpu_set_t& set) {
+    std::vector<int> cpus;
+    for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+        if (CPU_ISSET(cpu, &set)) {
+            cpus.push_back(cpu);
+        }
+    }
+    return cpus;
+}
+#endif
+
+const std::vector<std::vector<int>>& Placement::nodes() {
+    static const std::vector<std::vector<int>> nodes = []() {
+        std::vector<std::vector<int>> found;
+#if defined(__linux__)
+        // node numbers may have holes, a few missing ones in a row end the search
+        for (int node = 0, missing = 0; missing < 8; node++) {
+            std::ifstream file("/sys/devices/system/node/node" + std::to_string(node) + "/cpulist");
+            if (!file) {
+                missing++;
+                continue;
+            }
+            missing = 0;
+            std::string list;
+            std::getline(file, list);
+            found.resize(node + 1);
+            found[node] = parseCpuList(list);
+        }
+#endif
+        if (found.empty()) {
+            unsigned int count = std::thread::hardware_concurrency();
+            found.emplace_back();
+            for (int cpu = 0; cpu < (int)(count == 0 ? 1 : count); cpu++) {
+                found[0].push_back(cpu);
+            }
+        }
+        return found;
+    }();
+    return nodes;
+}
+
+int Placement::nodeOfCpu(int cpu) {
+    const std::vector<std::vector<int>>& all = nodes();
+    for (size_t node = 0; node < all.size(); node++) {
+        for (int c : all[node]) {
+            if (c == cpu) {
+                return (int)node;
+            }
+        }
+    }
+    return -1;
+}
+
+std::vector<int> Placement::availableCpus() {
+    std::vector<int> allowed;
+#if defined(__linux__)
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    if (sched_getaffinity(getpid(), sizeof(set), &set) == 0) {
+        allowed = cpusOfSet(set);
+    }
+#endif
+    std::vector<int> cpus;
+    for (const std::vector<int>& node : nodes()) {
+        for (int cpu : node) {
+            bool isAllowed = allowed.empty();
+            for (int a : allowed) {
+                isAllowed = isAllowed || a == cpu;
+            }
+            if (isAllowed) {
+                cpus.push_back(cpu);
+            }
+        }
+    }
+    return cpus;
+}
+
+std::vector<int> Placement::threadCpus() {
+#if defined(__linux__)
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    if (sched_getaffinity(0, sizeof(set), &set) == 0) {
+        return cpusOfSet(set);
+    }
+#endif
+    return availableCpus();
+}
+
+bool Placement::pinThread(const std::vector<int>& cpus) {
+    if (cpus.empty()) {
+        return false;
+    }
+#if defined(__linux__)
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (int cpu : cpus) {
+        if (cpu >= 0 && cpu < CPU_SETSIZE) {
+            CPU_SET(cpu, &set);
+        }
+    }
+    return sched_setaffinity(0, sizeof(set), &set) == 0;  // 0 is the calling thread
+#elif defined(_WIN64)
+    DWORD_PTR mask = 0;
+    for (int cpu : cpus) {
+        if (cpu >= 0 && cpu < 64) {
+            mask |= (DWORD_PTR)1 << cpu;
+        }
+    }
+    return mask != 0 && SetThreadAffinityMask(GetCurrentThread(), mask) != 0;
+#else
+    return false;
+#endif
+}
+
+int Placement::currentCpu() {
+#if defined(__linux__)
+    return sched_getcpu();
+#elif defined(_WIN64)
+    return (int)GetCurrentProcessorNumber();
+#else
+    return -1;
+#endif
+}
+
+int Placement::nodeOfAddress(const void* address) {
+#if defined(__linux__) && defined(SYS_get_mempolicy)
+    // MPOL_F_NODE | MPOL_F_ADDR of <numaif.h>, the node of the page instead of the policy
+    constexpr unsigned long nodeOfPage = 1 | 2;
+    int node = -1;
+    if (syscall(SYS_get_mempolicy, &node, nullptr, 0, address, nodeOfPage) == 0) {
+        return node;
+    }
+#else
+    (void)address;
+#endif
+    return -1;
+}
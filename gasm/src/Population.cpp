@@ -0,0 +1,175 @@
+//
+// Genomes of the whole population in one slab, fitness and rank in arrays beside it
+//
+
+#include <algorithm>
+#include <cstring>
+#include <new>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include "Population.h"
+
+#if defined(__x86_64__) || defined(_M_X64)
+#include <immintrin.h>
+#define GASM_SPIN_PAUSE() _mm_pause()
+#else
+#define GASM_SPIN_PAUSE() std::this_thread::yield()
+#endif
+
+void Population::SlabDeleter::operator()(uint8_t* slab) const {
+    ::operator delete[](slab, std::align_val_t(cacheLine));
+}
+
+void Population::resize(size_t count, size_t maxSize) {
+    for (size_t i = 0; i < std::min(count, count_); i++) {
+        if (lengths_[i] > maxSize) {
+            throw std::invalid_argument("Individual " + std::to_string(i) + " is longer than " + std::to_string(maxSize));
+        }
+    }
+    const size_t stride = (std::max<size_t>(maxSize, 1) + cacheLine - 1) / cacheLine * cacheLine;
+    if (count != count_ || stride != stride_) {
+        std::unique_ptr<uint8_t[], SlabDeleter> genomes;
+        if (count > 0) {
+            genomes.reset(static_cast<uint8_t*>(::operator new[](count * stride, std::align_val_t(cacheLine))));
+        }
+        for (size_t i = 0; i < std::min(count, count_); i++) {
+            std::memcpy(genomes.get() + i * stride, genomes_.get() + i * stride_, lengths_[i]);
+        }
+        genomes_ = std::move(genomes);
+        stride_ = stride;
+    }
+    if (count != count_) {
+        sequences_ = std::make_unique<std::atomic<uint64_t>[]>(count);
+    }
+    count_ = count;
+    maxSize_ = maxSize;
+    lengths_.resize(count, 0);
+    fitness_.resize(count, 0.0);
+    rank_.resize(count, 0.0);
+    errors_.resize(count * caseCount_, 0.0f);
+}
+
+void Population::setCaseCount(size_t caseCount) {
+    caseCount_ = caseCount;
+    errors_.assign(count_ * caseCount, 0.0f);
+}
+
+static void checkErrors(size_t given, size_t caseCount) {
+    if (given != caseCount) {
+        throw std::invalid_argument("Individual has " + std::to_string(given) + " case errors, the population keeps "
+                                    + std::to_string(caseCount));
+    }
+}
+
+void Population::assignErrors(size_t i, std::span<const double> errors) {
+    if (caseCount_ == 0) {
+        return;
+    }
+    checkErrors(errors.size(), caseCount_);
+    std::copy(errors.begin(), errors.end(), errors_.begin() + (std::ptrdiff_t)(i * caseCount_));
+}
+
+void Population::assign(size_t i, std::span<const uint8_t> genome) {
+    if (genome.size() > maxSize_) {
+        throw std::invalid_argument("Individual of " + std::to_string(genome.size())
+                                    + " instructions is longer than individualMaxSize " + std::to_string(maxSize_));
+    }
+    if (!genome.empty()) {
+        std::memmove(genomes_.get() + i * stride_, genome.data(), genome.size());
+    }
+    lengths_[i] = (uint32_t)genome.size();
+}
+
+std::vector<std::span<const uint8_t>> Population::genomes() const {
+    std::vector<std::span<const uint8_t>> all;
+    all.reserve(count_);
+    for (size_t i = 0; i < count_; i++) {
+        all.push_back((*this)[i]);
+    }
+    return all;
+}
+
+uint64_t Population::beginWrite(size_t i) {
+    std::atomic<uint64_t>& sequence = sequences_[i];
+    uint64_t current = sequence.load(std::memory_order_relaxed);
+    // another writer of the slot holds it while the sequence is odd
+    while ((current & 1) != 0 || !sequence.compare_exchange_weak(current, current + 1, std::memory_order_relaxed)) {
+        GASM_SPIN_PAUSE();
+        current = sequence.load(std::memory_order_relaxed);
+    }
+    // the writes below can't be seen before the odd sequence
+    std::atomic_thread_fence(std::memory_order_release);
+    return current + 1;
+}
+
+void Population::publish(size_t i, std::span<const uint8_t> genome, double fitness, double rank,
+                         std::span<const double> errors) {
+    if (genome.size() > maxSize_) {
+        throw std::invalid_argument("Individual of " + std::to_string(genome.size())
+                                    + " instructions is longer than individualMaxSize " + std::to_string(maxSize_));
+    }
+    if (caseCount_ > 0) {
+        checkErrors(errors.size(), caseCount_);
+    }
+    uint64_t sequence = beginWrite(i);
+    uint64_t* slot = words(i);
+    for (size_t w = 0; w * 8 < genome.size(); w++) {
+        uint64_t word = 0;
+        std::memcpy(&word, genome.data() + w * 8, std::min<size_t>(8, genome.size() - w * 8));
+        std::atomic_ref<uint64_t>(slot[w]).store(word, std::memory_order_relaxed);
+    }
+    std::atomic_ref<uint32_t>(lengths_[i]).store((uint32_t)genome.size(), std::memory_order_relaxed);
+    std::atomic_ref<double>(fitness_[i]).store(fitness, std::memory_order_relaxed);
+    std::atomic_ref<double>(rank_[i]).store(rank, std::memory_order_relaxed);
+    for (size_t c = 0; c < caseCount_; c++) {
+        std::atomic_ref<float>(errors_[i * caseCount_ + c]).store((float)errors[c], std::memory_order_relaxed);
+    }
+    sequences_[i].store(sequence + 1, std::memory_order_release);
+}
+
+void Population::publishScores(size_t i, double fitness, double rank) {
+    uint64_t sequence = beginWrite(i);
+    std::atomic_ref<double>(fitness_[i]).store(fitness, std::memory_order_relaxed);
+    std::atomic_ref<double>(rank_[i]).store(rank, std::memory_order_relaxed);
+    sequences_[i].store(sequence + 1, std::memory_order_release);
+}
+
+void Population::copy(size_t i, std::vector<uint8_t>& out) const {
+    const std::atomic<uint64_t>& sequence = sequences_[i];
+    const uint64_t* slot = words(i);
+    for (;;) {
+        uint64_t before = sequence.load(std::memory_order_acquire);
+        if ((before & 1) != 0) {
+            GASM_SPIN_PAUSE();
+            continue;
+        }
+        // a length read mid-write still is one some writer stored, at most maxSize
+        size_t length = std::atomic_ref<uint32_t>(const_cast<uint32_t&>(lengths_[i])).load(std::memory_order_relaxed);
+        out.resize(length);
+        for (size_t w = 0; w * 8 < length; w++) {
+            uint64_t word = std::atomic_ref<uint64_t>(const_cast<uint64_t&>(slot[w])).load(std::memory_order_relaxed);
+            std::memcpy(out.data() + w * 8, &word, std::min<size_t>(8, length - w * 8));
+        }
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (sequence.load(std::memory_order_relaxed) == before) {
+            return;
+        }
+    }
+}
+
+std::pair<double, double> Population::scores(size_t i) const {
+    const std::atomic<uint64_t>& sequence = sequences_[i];
+    for (;;) {
+        uint64_t before = sequence.load(std::memory_order_acquire);
+        if ((before & 1) != 0) {
+            GASM_SPIN_PAUSE();
+            continue;
+        }
+        std::pair<double, double> result{fitnessOf(i), rankOf(i)};
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (sequence.load(std::memory_order_relaxed) == before) {
+            return result;
+        }
+    }
+}
@@ -0,0 +1,39 @@
+//
+// Small, fast random streams that a seed and a few counters fully determine
+//
+
+#include <random>
+#include "Random.h"
+
+// splitmix64, spreads any key over the whole state
+static uint64_t mix(uint64_t& x) {
+    uint64_t z = (x += 0x9e3779b97f4a7c15ULL);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+}
+
+Random::Random(uint64_t seed) {
+    for (uint64_t& word : state_) {
+        word = mix(seed);
+    }
+}
+
+Random::Random(uint64_t seed, uint64_t stream, uint64_t index) {
+    uint64_t key = seed;
+    key = mix(key) ^ stream;
+    key = mix(key) ^ index;
+    for (uint64_t& word : state_) {
+        word = mix(key);
+    }
+}
+
+Random& Random::local() {
+    static thread_local Random random(entropy());
+    return random;
+}
+
+uint64_t Random::entropy() {
+    std::random_device device;
+    return ((uint64_t)device() << 32) ^ device();
+}
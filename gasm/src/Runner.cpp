@@ -49,9 +49,19 @@ Runner &Runner::operator=(Runner &&other) noexcept {
     return *this;
 }
 
+std::span<const double> Runner::caseErrors(const GAsm* gasm) const {
+    if (!gasm->collectErrors_) {
+        return {};
+    }
+    // GAsm checked it is a CaseFitness
+    return static_cast<const CaseFitness&>(*fitnessFunction_).caseErrors();
+}
+
 void Runner::dispatchGrow(GAsm *gasm, size_t start, size_t end, bool verbose) {
     size_t size = end - start;
     auto initStart = std::chrono::high_resolution_clock::now();
+    child_.reserve(gasm->individualMaxSize);
+    jit_.reserve(gasm->individualMaxSize);
     for (size_t i = start; i < end; i++) {
         if (verbose) {
             int progress = ((int) i + 1) * 100 / (int) size;
@@ -59,38 +69,51 @@ void Runner::dispatchGrow(GAsm *gasm, size_t start, size_t end, bool verbose) {
                     std::chrono::high_resolution_clock::now() - initStart).count();
             printProgressBar(progress, elapsed);
         }
-        (*growFunction_)(gasm, gasm->population_[i]);
-        std::pair<double, double> fitRank = (*fitnessFunction_)(gasm, jit_, gasm->population_[i]);
-        gasm->fitness_[i] = fitRank.first;
-        gasm->rank_[i] = fitRank.second;
+        random_ = gasm->stream(i);
+        (*growFunction_)(gasm, random_, child_);
+        Random::local() = Random(random_());  // draws of the RNG instruction
+        std::pair<double, double> fitRank = (*fitnessFunction_)(gasm, jit_, child_);
+        gasm->population_.assign(i, child_);
+        gasm->population_.fitness()[i] = fitRank.first;
+        gasm->population_.rank()[i] = fitRank.second;
+        gasm->population_.assignErrors(i, caseErrors(gasm));
     }
 }
 
 void Runner::dispatchEvolve(GAsm *gasm, size_t start, size_t end, bool verbose) {
     size_t size = end - start;
-    static thread_local std::mt19937 engine(std::random_device{}());
-    std::uniform_real_distribution<double> dist(0, 1);
     auto genStart = std::chrono::high_resolution_clock::now();
+    child_.reserve(gasm->individualMaxSize);
+    jit_.reserve(gasm->individualMaxSize);
+    parent1_.reserve(gasm->individualMaxSize);
+    parent2_.reserve(gasm->individualMaxSize);
     for (size_t i = start; i < end; i++) {
+        random_ = gasm->stream(i);
         selectionFunction_->selectMinimal = !gasm->minimize; // worst is not minimized
-        size_t worstIndex = (*selectionFunction_)(gasm);
-        std::vector<uint8_t> worstInd = gasm->getIndividual(worstIndex);
+        size_t worstIndex = (*selectionFunction_)(gasm, random_);
+        const double cutoff = gasm->getFitness(worstIndex);
+        // other runners may replace the parents meanwhile, each copy is of one whole genome
+        gasm->copyIndividual(worstIndex, child_);
         selectionFunction_->selectMinimal = gasm->minimize;  // best is minimized
-        if (dist(engine) < gasm->crossoverProbability) {
-            size_t bestIndex1 = (*selectionFunction_)(gasm);
-            size_t bestIndex2 = (*selectionFunction_)(gasm);
-            std::vector<uint8_t> bestInd1 = gasm->getIndividual(bestIndex1);
-            std::vector<uint8_t> bestInd2 = gasm->getIndividual(bestIndex2);
+        if (random_.chance(gasm->crossoverProbability)) {
+            size_t bestIndex1 = (*selectionFunction_)(gasm, random_);
+            size_t bestIndex2 = (*selectionFunction_)(gasm, random_);
+            gasm->copyIndividual(bestIndex1, parent1_);
+            gasm->copyIndividual(bestIndex2, parent2_);
 
-            (*crossoverFunction_)(gasm, worstInd, bestInd1, bestInd2);
+            (*crossoverFunction_)(gasm, random_, child_, parent1_, parent2_);
         } else {
-            size_t bestIndex = (*selectionFunction_)(gasm);
-            std::vector<uint8_t> bestInd = gasm->getIndividual(bestIndex);
-            (*mutationFunction_)(gasm, worstInd, bestInd);
+            size_t bestIndex = (*selectionFunction_)(gasm, random_);
+            gasm->copyIndividual(bestIndex, parent1_);
+            (*mutationFunction_)(gasm, random_, child_, parent1_);
         }
 
-        std::pair<double, double> fitRank = (*fitnessFunction_)(gasm, jit_, worstInd);
-        gasm->setIndividual(worstIndex, worstInd, fitRank.first, fitRank.second);
+        Random::local() = Random(random_());
+        std::pair<double, double> fitRank = gasm->racing ? fitnessFunction_->bounded(gasm, jit_, child_, cutoff)
+                                                         : (*fitnessFunction_)(gasm, jit_, child_);
+        if (!gasm->racing || !gasm->worse(fitRank.first, cutoff)) {
+            gasm->setIndividual(worstIndex, child_, fitRank.first, fitRank.second, caseErrors(gasm));
+        }
         if (verbose) {
             int progress = ((int)i + 1) * 100 / (int) size;
             double elapsed = std::chrono::duration<double>(
@@ -98,4 +121,81 @@ void Runner::dispatchEvolve(GAsm *gasm, size_t start, size_t end, bool verbose)
             printProgressBar(progress, elapsed);
         }
     }
-}
\ No newline at end of file
+}
+
+void Runner::dispatchGenerational(GAsm *gasm, size_t start, size_t end, bool verbose) {
+    size_t size = end - start;
+    auto genStart = std::chrono::high_resolution_clock::now();
+    // the parents don't change until the swap, so they are read in place
+    const Population& parents = gasm->population_;
+    Population& offspring = gasm->offspring_;
+    child_.reserve(gasm->individualMaxSize);
+    jit_.reserve(gasm->individualMaxSize);
+    selectionFunction_->selectMinimal = gasm->minimize;
+    for (size_t i = start; i < end; i++) {
+        if (i < gasm->elites_.size()) {
+            size_t elite = gasm->elites_[i];
+            offspring.assign(i, parents[elite]);
+            offspring.fitness()[i] = parents.fitness()[elite];
+            offspring.rank()[i] = parents.rank()[elite];
+            std::span<const float> errors = parents.errors(elite);
+            eliteErrors_.assign(errors.begin(), errors.end());
+            offspring.assignErrors(i, eliteErrors_);
+            continue;
+        }
+        // what the slot keeps when the operator gives up
+        std::span<const uint8_t> previous = parents[i];
+        child_.assign(previous.begin(), previous.end());
+        random_ = gasm->stream(i);
+        if (random_.chance(gasm->crossoverProbability)) {
+            size_t bestIndex1 = (*selectionFunction_)(gasm, random_);
+            size_t bestIndex2 = (*selectionFunction_)(gasm, random_);
+            (*crossoverFunction_)(gasm, random_, child_, parents[bestIndex1], parents[bestIndex2]);
+        } else {
+            size_t bestIndex = (*selectionFunction_)(gasm, random_);
+            (*mutationFunction_)(gasm, random_, child_, parents[bestIndex]);
+        }
+
+        Random::local() = Random(random_());
+
+        std::pair<double, double> fitRank = (*fitnessFunction_)(gasm, jit_, child_);
+        offspring.assign(i, child_);
+        offspring.fitness()[i] = fitRank.first;
+        offspring.rank()[i] = fitRank.second;
+        offspring.assignErrors(i, caseErrors(gasm));
+        if (verbose) {
+            int progress = ((int)(i - start) + 1) * 100 / (int) size;
+            double elapsed = std::chrono::duration<double>(
+                    std::chrono::high_resolution_clock::now() - genStart).count();
+            printProgressBar(progress, elapsed);
+        }
+    }
+}
+
+// the cases changed, the individuals are scored again on them
+void Runner::dispatchRescore(GAsm *gasm, size_t start, size_t end) {
+    const CaseFitness* caseFitness = gasm->sampling == Sampling::Dynamic
+                                     ? dynamic_cast<const CaseFitness*>(fitnessFunction_.get()) : nullptr;
+    Population& population = gasm->population_;
+    for (size_t i = start; i < end; i++) {
+        std::span<const uint8_t> genome = population[i];
+        child_.assign(genome.begin(), genome.end());
+        // streams past the population, the ones of the slots are for breeding
+        Random::local() = Random(gasm->stream(population.size() + i)());
+        std::pair<double, double> fitRank = (*fitnessFunction_)(gasm, jit_, child_);
+        population.fitness()[i] = fitRank.first;
+        population.rank()[i] = fitRank.second;
+        population.assignErrors(i, caseErrors(gasm));
+        if (caseFitness != nullptr) {
+            std::span<const double> errors = caseFitness->caseErrors();
+            double mean = 0.0;
+            for (double error : errors) {
+                mean += error;
+            }
+            mean /= (double)errors.size();
+            for (size_t k = 0; k < errors.size() && k < caseFailures_.size(); k++) {
+                caseFailures_[k] += errors[k] > mean ? 1 : 0;
+            }
+        }
+    }
+}
@@ -0,0 +1,112 @@
+//
+// Catalog of the fused handlers and the n-gram counts of the population they are chosen from
+//
+
+#include <algorithm>
+#include <iterator>
+#include <unordered_map>
+#include "Superinstructions.h"
+
+const std::vector<Superinstruction>& Superinstructions::catalog() {
+    static const std::vector<Superinstruction> superinstructions = [] {
+        std::vector<Superinstruction> all;
+        #define CATALOG2(a, b) all.push_back({{a, b, 0}, 2});
+        #define CATALOG3(a, b, c) all.push_back({{a, b, c}, 3});
+        GASM_SUPERINSTRUCTIONS(CATALOG2, CATALOG3)
+        #undef CATALOG2
+        #undef CATALOG3
+        for (size_t i = 0; i < all.size(); i++) {
+            all[i].catalogIndex = i;
+        }
+        return all;
+    }();
+    return superinstructions;
+}
+
+// opcodes in the low bytes, the length above them
+static uint32_t keyOf(const uint8_t* opcodes, size_t length) {
+    uint32_t key = (uint32_t)length << 24;
+    for (size_t i = 0; i < length; i++) {
+        key |= (uint32_t)opcodes[i] << (8 * i);
+    }
+    return key;
+}
+
+// only instructions that neither jump nor are jumped to can be fused
+static bool fusable(uint8_t opcode) {
+    return !GAsmIR::endsStraightLine(opcode) && !(EMPTY_JMP_I <= opcode && opcode <= EMPTY_JMP_P);
+}
+
+std::vector<Superinstruction> Superinstructions::mine(const std::vector<std::span<const uint8_t>>& programs,
+                                                      const IrPasses& passes) {
+    std::unordered_map<uint32_t, uint64_t> counts;
+    std::vector<uint8_t> program;
+    std::vector<IrInstruction> ir;
+    uint8_t window[maxLength];
+    for (std::span<const uint8_t> genome : programs) {
+        // the interpreter runs the lowered program, so that's what is counted
+        program.assign(genome.begin(), genome.end());
+        GAsmIR::lower(program, passes, ir);
+        size_t run = 0;  // fusable instructions right before i
+        for (size_t i = 0; i < ir.size(); i++) {
+            if (!fusable(ir[i].opcode)) {
+                run = 0;
+                continue;
+            }
+            run++;
+            for (size_t length = 2; length <= std::min(run, maxLength); length++) {
+                for (size_t j = 0; j < length; j++) {
+                    window[j] = ir[i + 1 - length + j].opcode;
+                }
+                counts[keyOf(window, length)]++;
+            }
+        }
+    }
+
+    std::unordered_map<uint32_t, size_t> handlers;
+    for (const Superinstruction& s : catalog()) {
+        handlers[keyOf(s.opcodes, s.length)] = s.catalogIndex;
+    }
+    std::vector<Superinstruction> mined;
+    mined.reserve(counts.size());
+    for (const auto& [key, count] : counts) {
+        Superinstruction s;
+        s.length = key >> 24;
+        for (size_t j = 0; j < s.length; j++) {
+            s.opcodes[j] = (uint8_t)(key >> (8 * j));
+        }
+        s.count = count;
+        auto handler = handlers.find(key);
+        s.catalogIndex = handler == handlers.end() ? SIZE_MAX : handler->second;
+        mined.push_back(s);
+    }
+    // ties broken by the key, so the order doesn't depend on the hash map
+    std::sort(mined.begin(), mined.end(), [](const Superinstruction& a, const Superinstruction& b) {
+        if (a.count != b.count) return a.count > b.count;
+        return keyOf(a.opcodes, a.length) < keyOf(b.opcodes, b.length);
+    });
+    return mined;
+}
+
+std::vector<size_t> Superinstructions::select(const std::vector<Superinstruction>& mined, size_t count) {
+    // ranked by the dispatches they would remove, a sequence of 3 saves two
+    std::vector<Superinstruction> handled;
+    std::copy_if(mined.begin(), mined.end(), std::back_inserter(handled),
+                 [](const Superinstruction& s) { return s.catalogIndex != SIZE_MAX; });
+    std::stable_sort(handled.begin(), handled.end(), [](const Superinstruction& a, const Superinstruction& b) {
+        return a.count * (a.length - 1) > b.count * (b.length - 1);
+    });
+    std::vector<size_t> selected;
+    for (size_t i = 0; i < handled.size() && i < count; i++) {
+        selected.push_back(handled[i].catalogIndex);
+    }
+    return selected;
+}
+
+std::string Superinstructions::toString(const Superinstruction& superinstruction) {
+    std::string text;
+    for (size_t i = 0; i < superinstruction.length; i++) {
+        text += (i == 0 ? "" : "; ") + GAsmParser::bytecode2Text(superinstruction.opcodes + i, 1);
+    }
+    return text;
+}
@@ -0,0 +1,134 @@
+//
+// Persistent workers stealing batches of a job from each other
+//
+
+#include <algorithm>
+#include <stdexcept>
+#include "WorkerPool.h"
+
+WorkerPool::WorkerPool(size_t workers) {
+    if (workers == 0) {
+        throw std::invalid_argument("Worker pool should have at least 1 worker");
+    }
+    queues_.reserve(workers);
+    for (size_t w = 0; w < workers; w++) {
+        queues_.push_back(std::make_unique<Queue>());
+    }
+    threads_.reserve(workers - 1);
+    for (size_t w = 1; w < workers; w++) {
+        threads_.emplace_back([this, w]() { loop(w); });
+    }
+}
+
+WorkerPool::~WorkerPool() {
+    {
+        std::lock_guard<std::mutex> guard(mutex_);
+        stop_ = true;
+    }
+    wake_.notify_all();
+    for (std::thread& thread : threads_) {
+        thread.join();
+    }
+}
+
+bool WorkerPool::take(size_t worker, Batch& batch) {
+    {
+        Queue& own = *queues_[worker];
+        std::lock_guard<std::mutex> guard(own.mutex);
+        if (!own.batches.empty()) {
+            batch = own.batches.front();
+            own.batches.pop_front();
+            return true;
+        }
+    }
+    // the others in turn, starting from the next worker so the thieves spread out
+    for (size_t i = 1; i < queues_.size() && stealing_; i++) {
+        Queue& victim = *queues_[(worker + i) % queues_.size()];
+        std::lock_guard<std::mutex> guard(victim.mutex);
+        if (!victim.batches.empty()) {
+            batch = victim.batches.back();
+            victim.batches.pop_back();
+            steals_++;
+            return true;
+        }
+    }
+    return false;
+}
+
+void WorkerPool::work(size_t worker) {
+    Batch batch{};
+    while (take(worker, batch)) {
+        // the job outlives every batch, run only returns after the last one
+        try {
+            (*job_)(worker, batch.begin, batch.end);
+        } catch (...) {
+            std::lock_guard<std::mutex> guard(mutex_);
+            if (!error_) {
+                error_ = std::current_exception();
+            }
+        }
+        std::lock_guard<std::mutex> guard(mutex_);
+        if (--pending_ == 0) {
+            finished_.notify_all();
+        }
+    }
+}
+
+void WorkerPool::loop(size_t worker) {
+    size_t seen = 0;
+    for (;;) {
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            wake_.wait(lock, [this, seen]() { return stop_ || round_ != seen; });
+            if (stop_) {
+                return;
+            }
+            seen = round_;
+        }
+        work(worker);
+    }
+}
+
+void WorkerPool::run(size_t count, size_t batchSize, const Job& job) {
+    if (batchSize == 0) {
+        throw std::invalid_argument("Batch size should be greater than 0");
+    }
+    runBatches(count, batchSize, job, true);
+}
+
+void WorkerPool::runOnEach(const Job& job) {
+    // dealt round-robin, every worker gets exactly one
+    runBatches(size(), 1, job, false);
+}
+
+void WorkerPool::runBatches(size_t count, size_t batchSize, const Job& job, bool stealing) {
+    if (count == 0) {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> guard(mutex_);
+        stealing_ = stealing;  // before the batches show up in the deques
+        job_ = &job;
+        error_ = nullptr;
+        pending_ = 0;
+        for (size_t begin = 0; begin < count; begin += batchSize) {
+            Queue& queue = *queues_[pending_ % queues_.size()];
+            std::lock_guard<std::mutex> queueGuard(queue.mutex);
+            queue.batches.push_back({begin, std::min(begin + batchSize, count)});
+            pending_++;
+        }
+        round_++;
+    }
+    wake_.notify_all();
+    work(0);
+    std::exception_ptr error;
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        finished_.wait(lock, [this]() { return pending_ == 0; });
+        job_ = nullptr;
+        error = error_;
+    }
+    if (error) {
+        std::rethrow_exception(error);
+    }
+}
@@ -9,25 +9,97 @@
 #include "functions.h"
 #include "GAsm.h"
 #include "GAsmParser.h"
+#include <algorithm>
 #include <cstdlib>
+#include <limits>
+#include <numeric>
+#include <span>
+#include <stdexcept>
 #include <iostream>
 
-std::pair<double, double> Fitness::operator()(const GAsm* self, GAsmInterpreter& jit, const std::vector<uint8_t> &individual) {
+std::pair<double, double> CaseFitness::operator()(const GAsm* self, GAsmInterpreter& jit, const std::vector<uint8_t> &individual) {
     jit.setProgram(individual);
+    // the copy on this runner's NUMA node when data is replicated
+    const std::vector<std::vector<double>>& inputs = self->caseInputs();
     double score = 0.0;
-    double avgTime = 0.0;
-    for (int i = 0; i < self->inputs.size(); i += 1) {
-        std::vector<double> input = self->inputs[i];
-        const std::vector<double>& target = self->targets[i];
-        avgTime += (double)jit.run(input, self->maxProcessTime);
-
-        double diff = input[0] - target[0];
-        score += std::isfinite(diff) ? std::fabs(diff) : self->nanPenalty;
+    // all the cases are evaluated in one call
+    double avgTime = (double)jit.runCases(inputs, self->maxProcessTime);
+    errors_.resize(inputs.size());
+    for (size_t i = 0; i < inputs.size(); i++) {
+        errors_[i] = caseError(self, i, jit.getCaseOutput(i));
+        score += errors_[i];
     }
-    avgTime /= (double)self->inputs.size();
+    avgTime /= (double)inputs.size();
     return {score, avgTime};
 }
 
+std::pair<double, double> CaseFitness::bounded(const GAsm* self, GAsmInterpreter& jit, const std::vector<uint8_t> &individual,
+                                               double cutoff) {
+    // a maximized score can't be bounded by the cases run so far
+    if (!self->minimize || !(cutoff < std::numeric_limits<double>::infinity())) {
+        return (*this)(self, jit, individual);
+    }
+    const std::vector<std::vector<double>>& inputs = self->caseInputs();
+    const size_t caseCount = inputs.size();
+    if (order_.size() != caseCount) {
+        order_.resize(caseCount);
+        std::iota(order_.begin(), order_.end(), 0);
+        inOrder_ = order_;
+        hardness_.assign(caseCount, 0.0);
+    }
+    // the generators are drawn case after case, a program using them has to see the cases in their order
+    const bool drawsGenerators = std::any_of(individual.begin(), individual.end(), [](uint8_t opcode) {
+        return opcode == SET || opcode == RNG; });
+    const std::vector<size_t>& order = drawsGenerators ? inOrder_ : order_;
+    raced_.assign(caseCount, 0.0);
+    jit.setProgram(individual);
+
+    double partial = 0.0;
+    double time = 0.0;
+    size_t done = 0;
+    // a batch fills the SIMD lanes of the interpreter and of the compiled code
+    while (done < caseCount) {
+        std::span<const size_t> batch(order.data() + done, std::min(GAsmInterpreter::caseLanes, caseCount - done));
+        time += (double)jit.runCases(inputs, batch, self->maxProcessTime);
+        for (size_t k = 0; k < batch.size(); k++) {
+            const size_t i = batch[k];
+            raced_[i] = caseError(self, i, jit.getCaseOutput(k));
+            partial += raced_[i];
+            hardness_[i] += (raced_[i] - hardness_[i]) * hardnessDecay;
+        }
+        done += batch.size();
+        if (partial > cutoff) {
+            break;
+        }
+    }
+    if (++races_ % reorderInterval == 0) {
+        reorder();
+    }
+    if (done < caseCount) {
+        return {partial, time / (double)done};
+    }
+    // summed in case order, a finished race scores exactly what operator() does
+    errors_.swap(raced_);
+    double score = 0.0;
+    for (double error : errors_) {
+        score += error;
+    }
+    return {score, time / (double)caseCount};
+}
+
+void CaseFitness::reorder() {
+    // ties by index, a stable sort would allocate a buffer every time
+    std::sort(order_.begin(), order_.end(), [this](size_t a, size_t b) {
+        return hardness_[a] > hardness_[b] || (hardness_[a] == hardness_[b] && a < b); });
+}
+
+double Fitness::caseError(const GAsm* self, size_t i, std::span<const double> output) {
+    const std::vector<double>& target = self->caseTargets()[i];
+
+    double diff = output[0] - target[0];
+    return std::isfinite(diff) ? std::fabs(diff) : self->nanPenalty;
+}
+
 std::unique_ptr<FitnessFunction> Fitness::clone() const {
     return std::make_unique<Fitness>(*this);
 }
@@ -47,36 +119,22 @@ static inline long long roundToInt(double x, long long clampAbs = 1'000'000'000L
     return v;
 }
 
-std::pair<double, double> FitnessAnyPositionConstant::operator()(
-    const GAsm* self, GAsmInterpreter& jit, const std::vector<uint8_t>& individual
-) {
-    jit.setProgram(individual);
-
-    double score = 0.0;
-    double avgTime = 0.0;
+double FitnessAnyPositionConstant::caseError(const GAsm* self, size_t i, std::span<const double> io) {
+    const auto& target = self->caseTargets()[i]; // target[0] = C
 
-    for (int i = 0; i < (int)self->inputs.size(); ++i) {
-        std::vector<double> io = self->inputs[i];
-        const auto& target = self->targets[i]; // target[0] = C
-        avgTime += (double)jit.run(io, self->maxProcessTime);
+    const double C = target[0];
 
-        const double C = target[0];
-
-        // bierzemy najlepsze trafienie "gdziekolwiek"
-        double best = self->nanPenalty;
-        for (double v : io) {
-            // if (!std::isfinite(v)) { best = std::min(best, self->nanPenalty); continue; }
-
-            long long vi = roundToInt(v);
-            double err = std::fabs((double)(vi - C));   // błąd liczony po int
-            best = std::min(best, err);
-        }
+    // bierzemy najlepsze trafienie "gdziekolwiek"
+    double best = self->nanPenalty;
+    for (double v : io) {
+        // if (!std::isfinite(v)) { best = std::min(best, self->nanPenalty); continue; }
 
-        score += best;
+        long long vi = roundToInt(v);
+        double err = std::fabs((double)(vi - C));   // błąd liczony po int
+        best = std::min(best, err);
     }
 
-    avgTime /= (double)self->inputs.size();
-    return {score, avgTime};
+    return best;
 }
 
 std::unique_ptr<FitnessFunction> FitnessAnyPositionConstant::clone() const {
@@ -92,8 +150,8 @@ static inline long long truncToInt(double x, long long clampAbs = 1'000'000'000L
     return v;
 }
 
-static inline double unchangedPenalty(const std::vector<double>& before,
-                                      const std::vector<double>& after,
+static inline double unchangedPenalty(std::span<const double> before,
+                                      std::span<const double> after,
                                       size_t startIdx,
                                       double weight,
                                       double eps = 1e-12) {
@@ -112,32 +170,18 @@ static inline double intAbsErr(long long pred, long long truth) {
     return (double)std::llabs(pred - truth);
 }
 
-std::pair<double, double> FitnessSumSub::operator()(
-    const GAsm* self, GAsmInterpreter& jit, const std::vector<uint8_t>& individual
-) {
-    jit.setProgram(individual);
-
-    double score = 0.0;
-    double avgTime = 0.0;
-
+double FitnessSumSub::caseError(const GAsm* self, size_t i, std::span<const double> io) {
     const double extraWriteWeight = 5.0;
 
-    for (int i = 0; i < (int)self->inputs.size(); ++i) {
-        std::vector<double> io = self->inputs[i];
-        std::vector<double> before = io;
-        const auto& target = self->targets[i];
-
-        avgTime += (double)jit.run(io, self->maxProcessTime);
+    const std::vector<double>& before = self->caseInputs()[i];
+    const auto& target = self->caseTargets()[i];
 
-        long long pred  = truncToInt(io[0]);
-        long long truth = truncToInt(target[0]);
+    long long pred  = truncToInt(io[0]);
+    long long truth = truncToInt(target[0]);
 
-        score += isFinite(io[0]) ? intAbsErr(pred, truth) : self->nanPenalty;
-        score += unchangedPenalty(before, io, 1, extraWriteWeight);
-    }
-
-    avgTime /= (double)self->inputs.size();
-    return {score, avgTime};
+    double error = isFinite(io[0]) ? intAbsErr(pred, truth) : self->nanPenalty;
+    error += unchangedPenalty(before, io, 1, extraWriteWeight);
+    return error;
 }
 
 std::unique_ptr<FitnessFunction> FitnessSumSub::clone() const {
@@ -145,44 +189,31 @@ std::unique_ptr<FitnessFunction> FitnessSumSub::clone() const {
 }
 
 
-std::pair<double, double> FitnessNegToZeroVec::operator()(
-    const GAsm* self, GAsmInterpreter& jit, const std::vector<uint8_t>& individual
-) {
-    jit.setProgram(individual);
-
-    double score = 0.0;
-    double avgTime = 0.0;
-
+double FitnessNegToZeroVec::caseError(const GAsm* self, size_t i, std::span<const double> io) {
     // USTAW: ile elementów wektora ma być przetwarzane (musi odpowiadać generatorowi danych)
     const int L = 8;
 
     // kara za zmiany poza pierwszymi L elementami (żeby nie "produkował" śmieci)
     const double extraWriteWeight = 1.0;
 
-    for (int i = 0; i < (int)self->inputs.size(); ++i) {
-        std::vector<double> io = self->inputs[i];
-        std::vector<double> before = io;
-        const auto& target = self->targets[i]; // target ma długość L
-
-        avgTime += (double)jit.run(io, self->maxProcessTime);
+    const std::vector<double>& before = self->caseInputs()[i];
+    const auto& target = self->caseTargets()[i]; // target ma długość L
 
-        // błąd sumowany po elementach 0..L-1
-        for (int j = 0; j < L; ++j) {
-            if (!std::isfinite(io[j])) {
-                score += self->nanPenalty;
-                continue;
-            }
-            long long pred  = truncToInt(io[j]);
-            long long truth = truncToInt(target[j]);
-            score += (double)std::llabs(pred - truth);
+    double error = 0.0;
+    // błąd sumowany po elementach 0..L-1
+    for (int j = 0; j < L; ++j) {
+        if (!std::isfinite(io[j])) {
+            error += self->nanPenalty;
+            continue;
         }
-
-        // nie psuj reszty bufora (SENT)
-        score += unchangedPenalty(before, io, (size_t)L, extraWriteWeight);
+        long long pred  = truncToInt(io[j]);
+        long long truth = truncToInt(target[j]);
+        error += (double)std::llabs(pred - truth);
     }
 
-    avgTime /= (double)self->inputs.size();
-    return {score, avgTime};
+    // nie psuj reszty bufora (SENT)
+    error += unchangedPenalty(before, io, (size_t)L, extraWriteWeight);
+    return error;
 }
 
 std::unique_ptr<FitnessFunction> FitnessNegToZeroVec::clone() const {
@@ -191,14 +222,7 @@ std::unique_ptr<FitnessFunction> FitnessNegToZeroVec::clone() const {
 
 
 
-std::pair<double, double> FitnessBooleanK::operator()(
-    const GAsm* self, GAsmInterpreter& jit, const std::vector<uint8_t>& individual
-) {
-    jit.setProgram(individual);
-
-    double score = 0.0;
-    double avgTime = 0.0;
-
+double FitnessBooleanK::caseError(const GAsm* self, size_t i, std::span<const double> io) {
     const int k = 5;                 // <-- ustaw na aktualne k
     const bool addConstants = true;  // jeśli w danych dajesz [1,0]
     const int startProtected = k + (addConstants ? 2 : 0);
@@ -207,32 +231,26 @@ std::pair<double, double> FitnessBooleanK::operator()(
     const double softWeight = 0.05;        // miękki składnik (opcjonalnie)
     const double extraWriteWeight = 0.2;   // nie za duże! (program może używać rejestrów)
 
-    for (int i = 0; i < (int)self->inputs.size(); ++i) {
-        std::vector<double> io = self->inputs[i];
-        std::vector<double> before = io;
-        const auto& target = self->targets[i]; // target[0] = 0/1
+    const std::vector<double>& before = self->caseInputs()[i];
+    const auto& target = self->caseTargets()[i]; // target[0] = 0/1
 
-        avgTime += (double)jit.run(io, self->maxProcessTime);
-
-        int truth = (target[0] >= 0.5) ? 1 : 0;
-
-        if (!std::isfinite(io[0])) {
-            score += self->nanPenalty;
-        } else {
-            int pred = (io[0] >= 0.5) ? 1 : 0;
+    int truth = (target[0] >= 0.5) ? 1 : 0;
 
-            if (pred != truth) score += wrongCasePenalty;
+    double error = 0.0;
+    if (!std::isfinite(io[0])) {
+        error += self->nanPenalty;
+    } else {
+        int pred = (io[0] >= 0.5) ? 1 : 0;
 
-            // // miękki sygnał (pomaga w uczeniu, ale nie dominuje)
-            // score += softWeight * std::fabs(io[0] - (double)truth);
-        }
+        if (pred != truth) error += wrongCasePenalty;
 
-        // nie psuj reszty bufora poza wejściem + stałe
-        score += unchangedPenalty(before, io, (size_t)startProtected, extraWriteWeight);
+        // // miękki sygnał (pomaga w uczeniu, ale nie dominuje)
+        // error += softWeight * std::fabs(io[0] - (double)truth);
     }
 
-    avgTime /= (double)self->inputs.size();
-    return {score, avgTime};
+    // nie psuj reszty bufora poza wejściem + stałe
+    error += unchangedPenalty(before, io, (size_t)startProtected, extraWriteWeight);
+    return error;
 }
 
 std::unique_ptr<FitnessFunction> FitnessBooleanK::clone() const {
@@ -241,14 +259,7 @@ std::unique_ptr<FitnessFunction> FitnessBooleanK::clone() const {
 
 
 
-std::pair<double, double> FitnessArithSeq::operator()(
-    const GAsm* self, GAsmInterpreter& jit, const std::vector<uint8_t>& individual
-) {
-    jit.setProgram(individual);
-
-    double score = 0.0;
-    double avgTime = 0.0;
-
+double FitnessArithSeq::caseError(const GAsm* self, size_t i, std::span<const double> io) {
     constexpr int outStart = 3;
     constexpr int Tmax = 5;                   // MUSI pasować do generatora danych
     constexpr long long SENT_INT = 0;
@@ -257,47 +268,38 @@ std::pair<double, double> FitnessArithSeq::operator()(
     const double extraOutputPenalty = 5.0;    // kara za wpisanie czegoś tam, gdzie ma być SENT
     const double nanOutPenalty = 20.0;
 
-    for (int i = 0; i < (int)self->inputs.size(); ++i) {
-        std::vector<double> io = self->inputs[i];
-        const auto& target = self->targets[i];   // target.size() == Tmax
-
-        avgTime += (double)jit.run(io, self->maxProcessTime);
+    const auto& target = self->caseTargets()[i];   // target.size() == Tmax
 
-        for (int j = 0; j < Tmax; ++j) {
-            double outv = io[outStart + j];
-            long long pred = truncToInt(outv);
-            long long truth = truncToInt(target[j]); // albo (long long)target[j] jeśli trzymasz całe
+    double error = 0.0;
+    for (int j = 0; j < Tmax; ++j) {
+        double outv = io[outStart + j];
+        long long pred = truncToInt(outv);
+        long long truth = truncToInt(target[j]); // albo (long long)target[j] jeśli trzymasz całe
 
-            if (!isFinite(outv)) {
-                score += nanOutPenalty;
-                continue;
-            }
-            score += wrongElemWeight * (double)std::llabs(pred - truth);
-            // if (truth == SENT_INT) {
-            //     // tu nic nie powinno być "wydrukowane"
-            //     if (pred != SENT_INT) score += extraOutputPenalty;
-            // } else {
-            //     // element powinien być dokładny (na intach)
-            //     score += wrongElemWeight * (double)std::llabs(pred - truth);
-            // }
+        if (!isFinite(outv)) {
+            error += nanOutPenalty;
+            continue;
         }
+        error += wrongElemWeight * (double)std::llabs(pred - truth);
+        // if (truth == SENT_INT) {
+        //     // tu nic nie powinno być "wydrukowane"
+        //     if (pred != SENT_INT) error += extraOutputPenalty;
+        // } else {
+        //     // element powinien być dokładny (na intach)
+        //     error += wrongElemWeight * (double)std::llabs(pred - truth);
+        // }
     }
-
-    avgTime /= (double)self->inputs.size();
-    return {score, avgTime};
+    return error;
 }
 
 std::unique_ptr<FitnessFunction> FitnessArithSeq::clone() const {
     return std::make_unique<FitnessArithSeq>(*this);
 }
 
-size_t TournamentSelection::operator()(const GAsm *self) {
-    static thread_local std::mt19937 rng(std::random_device{}());
-    std::uniform_int_distribution<size_t> dist(0, self->populationSize - 1);
-
-    size_t bestIndex = dist(rng);
+size_t TournamentSelection::operator()(const GAsm *self, Random& random) {
+    size_t bestIndex = random.below(self->populationSize);
     for (unsigned int i = 1; i < _tournamentSize; i++) {
-        size_t idx = dist(rng);
+        size_t idx = random.below(self->populationSize);
         if (selectMinimal ? self->getFitness(idx) < self->getFitness(bestIndex) : self->getFitness(idx) > self->getFitness(bestIndex)) {
             bestIndex = idx;
         }
@@ -309,11 +311,11 @@ std::unique_ptr<SelectionFunction> TournamentSelection::clone() const {
     return std::make_unique<TournamentSelection>(*this);
 }
 
-size_t RouletteSelection::operator()(const GAsm* self) {
-    static thread_local std::mt19937 rng(std::random_device{}());
+size_t RouletteSelection::operator()(const GAsm* self, Random& random) {
     size_t size = self->populationSize;
 
-    std::vector<double> weights(size);
+    static thread_local std::vector<double> weights;  // no allocation per selection
+    weights.resize(size);
 
     // Convert fitness to weights
     if (selectMinimal) {
@@ -327,9 +329,7 @@ size_t RouletteSelection::operator()(const GAsm* self) {
     }
 
     double total = std::accumulate(weights.begin(), weights.end(), 0.0);
-    std::uniform_real_distribution<double> dist(0.0, total);
-
-    double r = dist(rng);
+    double r = random.unit() * total;
     double acc = 0.0;
 
     for (size_t i = 0; i < weights.size(); i++) {
@@ -345,12 +345,12 @@ std::unique_ptr<SelectionFunction> RouletteSelection::clone() const {
     return std::make_unique<RouletteSelection>(*this);
 }
 
-size_t RankSelection::operator()(const GAsm* self) {
-    static thread_local std::mt19937 rng(std::random_device{}());
+size_t RankSelection::operator()(const GAsm* self, Random& random) {
     size_t n = self->populationSize;
 
     // Lower rank = better if minimizing
-    std::vector<double> weights(n);
+    static thread_local std::vector<double> weights;
+    weights.resize(n);
 
     for (size_t i = 0; i < n; i++) {
         double rank = self->getRank(i); // 0 = best
@@ -358,9 +358,7 @@ size_t RankSelection::operator()(const GAsm* self) {
     }
 
     double total = std::accumulate(weights.begin(), weights.end(), 0.0);
-    std::uniform_real_distribution<double> dist(0.0, total);
-
-    double r = dist(rng);
+    double r = random.unit() * total;
     double acc = 0.0;
 
     for (size_t i = 0; i < n; i++) {
@@ -376,18 +374,15 @@ std::unique_ptr<SelectionFunction> RankSelection::clone() const {
     return std::make_unique<RankSelection>(*this);
 }
 
-size_t TruncationSelection::operator()(const GAsm* self) {
-    static thread_local std::mt19937 rng(std::random_device{}());
+size_t TruncationSelection::operator()(const GAsm* self, Random& random) {
     size_t n = self->populationSize;
 
     size_t topCount = std::max<size_t>(1, size_t((double)n * _percent));
 
     // Choose a random individual from the top X%
-    std::uniform_int_distribution<size_t> dist(0, topCount - 1);
-
     // Rank-based truncation:
     // rank=0 is the best
-    size_t selectedRank = dist(rng);
+    size_t selectedRank = random.below(topCount);
 
     // Find index with that rank
     for (size_t i = 0; i < n; i++)
@@ -401,11 +396,11 @@ std::unique_ptr<SelectionFunction> TruncationSelection::clone() const {
     return std::make_unique<TruncationSelection>(*this);
 }
 
-size_t BoltzmannSelection::operator()(const GAsm* self) {
-    static thread_local std::mt19937 rng(std::random_device{}());
+size_t BoltzmannSelection::operator()(const GAsm* self, Random& random) {
     size_t size = self->populationSize;
 
-    std::vector<double> weights(size);
+    static thread_local std::vector<double> weights;
+    weights.resize(size);
 
     for (size_t i = 0; i < size; i++) {
         double f = self->getFitness(i);
@@ -420,9 +415,7 @@ size_t BoltzmannSelection::operator()(const GAsm* self) {
     }
 
     double total = std::accumulate(weights.begin(), weights.end(), 0.0);
-    std::uniform_real_distribution<double> dist(0.0, total);
-
-    double r = dist(rng);
+    double r = random.unit() * total;
     double acc = 0.0;
 
     for (size_t i = 0; i < weights.size(); i++) {
@@ -438,18 +431,102 @@ std::unique_ptr<SelectionFunction> BoltzmannSelection::clone() const {
     return std::make_unique<BoltzmannSelection>(*this);
 }
 
+size_t LexicaseSelection::operator()(const GAsm *self, Random& random) {
+    const ErrorMatrix& matrix = self->caseErrors();
+    const size_t individuals = matrix.individuals();
+    const size_t caseCount = matrix.cases();
+    if (individuals == 0 || caseCount == 0) {
+        throw std::invalid_argument("Lexicase selection needs the errors of the population on the cases");
+    }
+    // steady-state picks the one to replace the other way round
+    if (selectMinimal != self->minimize) {
+        const size_t a = random.below(individuals);
+        const size_t b = random.below(individuals);
+        return (selectMinimal ? self->getFitness(b) < self->getFitness(a) : self->getFitness(b) > self->getFitness(a)) ? b : a;
+    }
+    if (cases_.size() != caseCount) {
+        cases_.resize(caseCount);
+        std::iota(cases_.begin(), cases_.end(), 0);
+    }
+    // partial Fisher-Yates
+    size_t used = 0;
+    swaps_.clear();
+    auto nextCase = [&]() {
+        const size_t other = used + random.below(caseCount - used);
+        std::swap(cases_[used], cases_[other]);
+        swaps_.push_back((uint32_t)other);
+        return cases_[used++];
+    };
+
+    // first case, the best are a run at one end of the sorted order
+    size_t c = nextCase();
+    std::span<const float> column = matrix.column(c);
+    std::span<const uint32_t> order = matrix.order(c);
+    float epsilon = _epsilon ? matrix.deviation(c) : 0.0f;
+    if (selectMinimal) {
+        const float threshold = column[order[0]] + epsilon;
+        size_t count = 1;
+        while (count < individuals && column[order[count]] <= threshold) count++;
+        pool_.assign(order.begin(), order.begin() + (std::ptrdiff_t)count);
+    } else {
+        const float threshold = column[order[individuals - 1]] - epsilon;
+        size_t first = individuals - 1;
+        while (first > 0 && column[order[first - 1]] >= threshold) first--;
+        pool_.assign(order.begin() + (std::ptrdiff_t)first, order.end());
+    }
+
+    while (pool_.size() > 1 && used < caseCount) {
+        c = nextCase();
+        column = matrix.column(c);
+        epsilon = _epsilon ? matrix.deviation(c) : 0.0f;
+        const size_t size = pool_.size();
+        values_.resize(size);
+        for (size_t k = 0; k < size; k++) {
+            values_[k] = column[pool_[k]];
+        }
+        size_t kept = 0;
+        if (selectMinimal) {
+            float best = values_[0];
+            for (size_t k = 1; k < size; k++) {
+                best = values_[k] < best ? values_[k] : best;
+            }
+            const float threshold = best + epsilon;
+            for (size_t k = 0; k < size; k++) {
+                pool_[kept] = pool_[k];
+                kept += values_[k] <= threshold ? 1 : 0;
+            }
+        } else {
+            float best = values_[0];
+            for (size_t k = 1; k < size; k++) {
+                best = values_[k] > best ? values_[k] : best;
+            }
+            const float threshold = best - epsilon;
+            for (size_t k = 0; k < size; k++) {
+                pool_[kept] = pool_[k];
+                kept += values_[k] >= threshold ? 1 : 0;
+            }
+        }
+        pool_.resize(kept);
+    }
+    for (size_t k = used; k-- > 0;) {
+        std::swap(cases_[k], cases_[swaps_[k]]);
+    }
+    return pool_[random.below(pool_.size())];
+}
+
+std::unique_ptr<SelectionFunction> LexicaseSelection::clone() const {
+    return std::make_unique<LexicaseSelection>(*this);
+}
+
 
-void OnePointCrossover::operator()(const GAsm *self, std::vector<uint8_t> &worstIndividual,
-                                   const std::vector<uint8_t> &bestIndividual1,
-                                   const std::vector<uint8_t> &bestIndividual2) {
+void OnePointCrossover::operator()(const GAsm *self, Random& random, std::vector<uint8_t> &worstIndividual,
+                                   std::span<const uint8_t> bestIndividual1,
+                                   std::span<const uint8_t> bestIndividual2) {
     if (bestIndividual1.empty() || bestIndividual2.empty()) return;
 
     size_t minSize = std::min(bestIndividual1.size(), bestIndividual2.size());
 
-    static thread_local std::mt19937 rng(std::random_device{}());
-    std::uniform_int_distribution<size_t> dist(0, minSize - 1);
-
-    int crossPoint = (int)dist(rng);
+    int crossPoint = (int)random.below(minSize);
 
     worstIndividual.resize(bestIndividual2.size());
 
@@ -461,20 +538,17 @@ std::unique_ptr<CrossoverFunction> OnePointCrossover::clone() const {
     return std::make_unique<OnePointCrossover>(*this);
 }
 
-void TwoPointCrossover::operator()(const GAsm *self, std::vector<uint8_t> &worstIndividual,
-                                   const std::vector<uint8_t> &bestIndividual1,
-                                   const std::vector<uint8_t> &bestIndividual2) {
+void TwoPointCrossover::operator()(const GAsm *self, Random& random, std::vector<uint8_t> &worstIndividual,
+                                   std::span<const uint8_t> bestIndividual1,
+                                   std::span<const uint8_t> bestIndividual2) {
     if (bestIndividual1.empty() || bestIndividual2.empty()) return;
 
     size_t minSize = std::min(bestIndividual1.size(), bestIndividual2.size());
 
-    static thread_local std::mt19937 rng(std::random_device{}());
-    std::uniform_int_distribution<size_t> dist(0, minSize - 1);
-
-    int crossPoint1 = (int)dist(rng);
+    int crossPoint1 = (int)random.below(minSize);
     int crossPoint2;
     do {
-        crossPoint2 = (int)dist(rng);
+        crossPoint2 = (int)random.below(minSize);
     } while (crossPoint1 == crossPoint2);
 
     if (crossPoint1 > crossPoint2) {
@@ -492,20 +566,17 @@ std::unique_ptr<CrossoverFunction> TwoPointCrossover::clone() const {
     return std::make_unique<TwoPointCrossover>(*this);
 }
 
-void TwoPointSizeCrossover::operator()(const GAsm *self, std::vector<uint8_t> &worstIndividual,
-                                       const std::vector<uint8_t> &bestIndividual1,
-                                       const std::vector<uint8_t> &bestIndividual2) {
+void TwoPointSizeCrossover::operator()(const GAsm *self, Random& random, std::vector<uint8_t> &worstIndividual,
+                                       std::span<const uint8_t> bestIndividual1,
+                                       std::span<const uint8_t> bestIndividual2) {
     if (bestIndividual1.empty() || bestIndividual2.empty()) return;
 
     size_t minSize = std::min(bestIndividual1.size(), bestIndividual2.size());
 
-    static thread_local std::mt19937 rng(std::random_device{}());
-    std::uniform_int_distribution<size_t> dist(0, minSize - 1);
-
-    int crossPoint1 = (int)dist(rng);
+    int crossPoint1 = (int)random.below(minSize);
     int crossPoint2;
     do {
-        crossPoint2 = (int)dist(rng);
+        crossPoint2 = (int)random.below(minSize);
     } while (crossPoint1 == crossPoint2);
 
     if (crossPoint1 > crossPoint2) {
@@ -524,21 +595,18 @@ std::unique_ptr<CrossoverFunction> TwoPointSizeCrossover::clone() const {
     return std::make_unique<TwoPointSizeCrossover>(*this);
 }
 
-void UniformPointCrossover::operator()(const GAsm *self, std::vector<uint8_t> &worstIndividual,
-                                       const std::vector<uint8_t> &bestIndividual1,
-                                       const std::vector<uint8_t> &bestIndividual2) {
+void UniformPointCrossover::operator()(const GAsm *self, Random& random, std::vector<uint8_t> &worstIndividual,
+                                       std::span<const uint8_t> bestIndividual1,
+                                       std::span<const uint8_t> bestIndividual2) {
     if (bestIndividual1.empty() || bestIndividual2.empty()) return;
 
-    const std::vector<uint8_t>& biggerIndividual = bestIndividual1.size() > bestIndividual2.size() ? bestIndividual1 : bestIndividual2;
-    const std::vector<uint8_t>& smallerIndividual = bestIndividual1.size() > bestIndividual2.size() ? bestIndividual2 : bestIndividual1;
-
-    static thread_local std::mt19937 rng(std::random_device{}());
-    std::uniform_int_distribution<size_t> dist(0, 1);
+    std::span<const uint8_t> biggerIndividual = bestIndividual1.size() > bestIndividual2.size() ? bestIndividual1 : bestIndividual2;
+    std::span<const uint8_t> smallerIndividual = bestIndividual1.size() > bestIndividual2.size() ? bestIndividual2 : bestIndividual1;
 
     worstIndividual.resize(biggerIndividual.size());
 
     for (int i = 0; i < smallerIndividual.size(); i++) {
-        if (dist(rng) == 1) {
+        if (random.below(2) == 1) {
             // fuck push_back and other vector methods
             worstIndividual[i] = smallerIndividual[i];
         } else {
@@ -552,17 +620,14 @@ std::unique_ptr<CrossoverFunction> UniformPointCrossover::clone() const {
     return std::make_unique<UniformPointCrossover>(*this);
 }
 
-void HardMutation::operator()(const GAsm *self, std::vector<uint8_t> &worstIndividual,
-                              const std::vector<uint8_t> &bestIndividual) {
-    static thread_local std::mt19937 rng(std::random_device{}());
-    std::uniform_real_distribution<double> probDist(0.0, 1.0);
-    std::uniform_int_distribution<int> byteDist(0, 31); // bytecode range is 0-31
+void HardMutation::operator()(const GAsm *self, Random& random, std::vector<uint8_t> &worstIndividual,
+                              std::span<const uint8_t> bestIndividual) {
 
-    worstIndividual = bestIndividual;
+    worstIndividual.assign(bestIndividual.begin(), bestIndividual.end());
 
     for (unsigned char& i : worstIndividual) {
-        if (probDist(rng) < self->mutationProbability) {
-            i = GAsmParser::base322Bytecode(byteDist(rng)); // mutate this byte
+        if (random.chance(self->mutationProbability)) {
+            i = GAsmParser::base322Bytecode((int)random.below(32)); // mutate this byte, bytecode range is 0-31
         }
     }
 }
@@ -571,29 +636,14 @@ std::unique_ptr<MutationFunction> HardMutation::clone() const {
     return std::make_unique<HardMutation>(*this);
 }
 
-static std::array<std::uniform_int_distribution<int>, INSTRUCTION_GROUPS> makeDists() {
-    std::array<std::uniform_int_distribution<int>, INSTRUCTION_GROUPS> arr;
-
-    for (int i = 0; i < INSTRUCTION_GROUPS; i++) {
-        arr[i] = std::uniform_int_distribution<int>(0, GAsmParser::instructionGroupLengths[i] - 1);
-    }
-
-    return arr;
-}
-
-void SoftMutation::operator()(const GAsm *self, std::vector<uint8_t> &worstIndividual,
-                              const std::vector<uint8_t> &bestIndividual) {
-    static thread_local std::mt19937 rng(std::random_device{}());
-    std::uniform_real_distribution<double> probDist(0.0, 1.0);
-
-    static const std::array<std::uniform_int_distribution<int>, INSTRUCTION_GROUPS> dists = makeDists();
-
-    worstIndividual = bestIndividual;
+void SoftMutation::operator()(const GAsm *self, Random& random, std::vector<uint8_t> &worstIndividual,
+                              std::span<const uint8_t> bestIndividual) {
+    worstIndividual.assign(bestIndividual.begin(), bestIndividual.end());
 
     for (unsigned char& i : worstIndividual) {
-        if (probDist(rng) < self->mutationProbability) {
-            auto dist = dists[i >> 4];
-            i = dist(rng) | (i & 0b11110000); // mutate the end of this byte
+        if (random.chance(self->mutationProbability)) {
+            // mutate the end of this byte
+            i = (uint8_t)random.below(GAsmParser::instructionGroupLengths[i >> 4]) | (i & 0b11110000);
         }
     }
 }
@@ -602,16 +652,14 @@ std::unique_ptr<MutationFunction> SoftMutation::clone() const {
     return std::make_unique<SoftMutation>(*this);
 }
 
-void FullGrow::operator()(const GAsm *self, std::vector<uint8_t> &individual) {
+void FullGrow::operator()(const GAsm *self, Random& random, std::vector<uint8_t> &individual) {
     individual.clear();
 
-    static thread_local std::mt19937 engine(std::random_device{}());
-    std::uniform_int_distribution<int> dist(0, 31);
 
     individual.resize(self->individualMaxSize);
     std::generate(individual.begin(),
                   individual.end(),
-                  [&](){ return GAsmParser::base322Bytecode(dist(engine));}
+                  [&](){ return GAsmParser::base322Bytecode((int)random.below(32));}
     );
 }
 
@@ -619,16 +667,14 @@ std::unique_ptr<GrowFunction> FullGrow::clone() const {
     return std::make_unique<FullGrow>(*this);
 }
 
-void SizeGrow::operator()(const GAsm *self, std::vector<uint8_t> &individual) {
+void SizeGrow::operator()(const GAsm *self, Random& random, std::vector<uint8_t> &individual) {
     individual.clear();
 
-    static thread_local std::mt19937 engine(std::random_device{}());
-    std::uniform_int_distribution<int> dist(0, 31);
 
     individual.resize(size_);
     std::generate_n(individual.begin(),
                     size_,
-                    [&](){ return GAsmParser::base322Bytecode(dist(engine));}
+                    [&](){ return GAsmParser::base322Bytecode((int)random.below(32));}
     );
 }
 
@@ -636,37 +682,33 @@ std::unique_ptr<GrowFunction> SizeGrow::clone() const {
     return std::make_unique<SizeGrow>(*this);
 }
 
-void TreeGrow::operator()(const GAsm *self, std::vector<uint8_t> &individual) {
+void TreeGrow::operator()(const GAsm *self, Random& random, std::vector<uint8_t> &individual) {
     individual.clear();
     individual.reserve(self->individualMaxSize);
-    this->grow(individual, self->individualMaxSize);
+    this->grow(random, individual, self->individualMaxSize);
 }
 
-void TreeGrow::grow(std::vector<uint8_t> &individual, size_t maxSize) { //NOLINT, it's recursive
+void TreeGrow::grow(Random& random, std::vector<uint8_t> &individual, size_t maxSize) { //NOLINT, it's recursive
     bool forceStructural = individual.empty();
     bool mustBeLeaf = (this->_depth == 0);
     // 10 instructions - inna niż 10 też może być
     // tree -> 10 instructions
     // continue another 10 instructions
 
-    static thread_local std::mt19937 engine(std::random_device{}());
-    std::uniform_int_distribution<int> dist(0, 3);
-    bool chooseStructural = (dist(engine) == 0);
+    bool chooseStructural = (random.below(4) == 0);
 
     // TODO
     // double p = 0.45 * (double(depth) / 10.0);      // startDepth
     // std::bernoulli_distribution chooseStructure(p);
-    // bool chooseStructural = chooseStructure(engine);
+    // bool chooseStructural = chooseStructure(random);
 
     if ((chooseStructural && !mustBeLeaf) || forceStructural) {
         // wybieramy FOR / LOP A / LOP P / JMP ...
-        std::uniform_int_distribution<int> pickDistr(0, (int)GAsmParser::structuralOpcodesLength - 1);
-        uint8_t op = ( GAsmParser::structuralOpcodes[pickDistr(engine)]);
+        uint8_t op = ( GAsmParser::structuralOpcodes[random.below(GAsmParser::structuralOpcodesLength)]);
 
         individual.push_back(op);
 
-        std::uniform_int_distribution<int> childCountDist(1, 4);
-        int childCount = childCountDist(engine);
+        int childCount = 1 + (int)random.below(4);
 
         for (int i = 0; i < childCount; i++) {
 
@@ -674,7 +716,7 @@ void TreeGrow::grow(std::vector<uint8_t> &individual, size_t maxSize) { //NOLINT
                 break;
             } else {
                 _depth--;
-                grow(individual, maxSize);
+                grow(random, individual, maxSize);
                 _depth++;
             }
         }
@@ -683,8 +725,7 @@ void TreeGrow::grow(std::vector<uint8_t> &individual, size_t maxSize) { //NOLINT
     }
 
     // zwykla instrukcja
-    std::uniform_int_distribution<int> nd(0, (int)GAsmParser::normalOpcodesLength - 1);
-    individual.push_back(GAsmParser::normalOpcodes[nd(engine)]);
+    individual.push_back(GAsmParser::normalOpcodes[random.below(GAsmParser::normalOpcodesLength)]);
 }
 
 std::unique_ptr<GrowFunction> TreeGrow::clone() const {